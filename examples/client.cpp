@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <string>
 #include <sstream>
 #include <iostream>
@@ -16,14 +17,20 @@ enum ExecutionMode
     NORMAL      = 0,
     READ_DELAY  = 1,
     WRITE_DELAY = 2,
-    SUMMARIZE   = 3
+    SUMMARIZE   = 3,
+    REUSE       = 4,
+    CRASH_ONCE  = 5
 };
 
+// the first CRASH_ONCE child to create this file dies on its second chunk; the others carry on
+static const char* const CRASH_MARKER = "/tmp/stream_test_client.crashed";
+
 int basicLoop(ExecutionMode mode)
 {
     char* line = NULL;
     size_t len = 0;
     int read = getline(&line, &len, stdin);
+    size_t nChunks = 0;
     while(read > 0)
     {
         char * end = line;
@@ -33,11 +40,20 @@ int basicLoop(ExecutionMode mode)
         {
             return 1;
         }
+        if(mode == CRASH_ONCE && nLines != 0 && ++nChunks == 2 && open(CRASH_MARKER, O_CREAT | O_EXCL | O_WRONLY, 0644) >= 0)
+        {
+            abort();
+        }
         if (nLines == 0)
         {
             cout<<0<<std::endl;
             cout<<std::flush;
-            return 0;
+            if(mode != REUSE)
+            {
+                return 0;
+            }
+            read = getline(&line, &len, stdin); //stay alive for the next query
+            continue;
         }
         ostringstream output;
         output<<nLines+1<<"\n";
@@ -134,6 +150,14 @@ int main(int argc, char* argv[])
         {
             return basicLoop(WRITE_DELAY);
         }
+        else if (modeString == "REUSE")
+        {
+            return basicLoop(REUSE);
+        }
+        else if (modeString == "CRASH_ONCE")
+        {
+            return basicLoop(CRASH_ONCE);
+        }
         else if (modeString == "SUMMARIZE")
         {
             return summarizeLoop();
@@ -0,0 +1,125 @@
+/*
+ * An example library for format:'native'. For every chunk of ARRAY it returns one row with the number of cells
+ * and the sum of the first attribute, which must be a double; nulls are skipped. With PROGRAM 'SUMMARIZE' it
+ * returns a single row with the totals from stream_native_finalize instead. For example:
+ *
+ * stream(foo, 'SUMMARIZE', format:'native', library:'/path/to/libstream_test_native.so', types:('int64','double'),
+ *        names:('count','sum'))
+ */
+#include <stdint.h>
+#include <string.h>
+#include <new>
+#include <string>
+#include "../src/stream_native.h"
+
+struct Row
+{
+    int64_t count;
+    double  sum;
+};
+
+struct State
+{
+    bool        summarize;
+    int64_t     count;
+    double      sum;
+    Row         output;   // output memory, valid until the next call
+    std::string error;
+};
+
+// stream_native_finalize deletes the State before SciDB copies the last output, so that row lives here instead.
+// Every query calls the library from its own thread, so queries never share it.
+static thread_local Row t_finalOutput;
+
+// Why stream_native_init failed, for stream_native_error, which then gets no State.
+static thread_local char const* t_initError = NULL;
+
+static void emit(stream_native_column* outputs, Row& row, int64_t count, double sum)
+{
+    row.count = count;
+    row.sum   = sum;
+    outputs[0].length = 1;
+    outputs[0].values = &row.count;
+    outputs[1].length = 1;
+    outputs[1].values = &row.sum;
+}
+
+extern "C" {
+
+int32_t stream_native_abi_version(void)
+{
+    return STREAM_NATIVE_ABI_VERSION;
+}
+
+int32_t stream_native_init(void** state, char const* args, int32_t num_outputs, stream_native_column const* outputs)
+{
+    if(num_outputs != 2 || outputs[0].type != STREAM_NATIVE_INT64 || outputs[1].type != STREAM_NATIVE_DOUBLE)
+    {
+        t_initError = "types must be ('int64', 'double')";
+        return 1;
+    }
+    State* s = new (std::nothrow) State();
+    if(s == NULL)
+    {
+        t_initError = "out of memory";
+        return 2;
+    }
+    s->summarize = strcmp(args, "SUMMARIZE") == 0;
+    s->count = 0;
+    s->sum   = 0;
+    *state = s;
+    return 0;
+}
+
+int32_t stream_native_process_batch(void* state, int32_t array, int32_t num_inputs, stream_native_column const* inputs,
+                                    stream_native_column* outputs)
+{
+    State* s = static_cast<State*>(state);
+    if(array != 0)
+    {
+        return 0;    // nothing to do with ARRAY2
+    }
+    if(num_inputs < 1 || inputs[0].type != STREAM_NATIVE_DOUBLE)
+    {
+        s->error = "the first attribute must be a double";
+        return 1;
+    }
+    double const* values = static_cast<double const*>(inputs[0].values);
+    double sum = 0;
+    for(int64_t i = 0; i < inputs[0].length; ++i)
+    {
+        if(inputs[0].validity == NULL || (inputs[0].validity[i / 8] & (1 << (i % 8))))
+        {
+            sum += values[i];
+        }
+    }
+    s->count += inputs[0].length;
+    s->sum   += sum;
+    if(!s->summarize)
+    {
+        emit(outputs, s->output, inputs[0].length, sum);
+    }
+    return 0;
+}
+
+int32_t stream_native_finalize(void* state, stream_native_column* outputs)
+{
+    State* s = static_cast<State*>(state);
+    if(s->summarize)
+    {
+        emit(outputs, t_finalOutput, s->count, s->sum);
+    }
+    delete s;
+    return 0;
+}
+
+char const* stream_native_error(void* state)
+{
+    if(state == NULL)
+    {
+        return t_initError;    // stream_native_init failed before allocating the state
+    }
+    return static_cast<State*>(state)->error.c_str();
+}
+
+}
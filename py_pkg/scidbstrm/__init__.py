@@ -1,5 +1,7 @@
 import dill
 import io
+import mmap
+import os
 import struct
 import sys
 
@@ -9,7 +11,6 @@ try:
     import numpy
     import pandas
 except KeyError:
-    import os
     os.environ.setdefault('PATH', '')
     import numpy
     import pandas
@@ -23,6 +24,13 @@ python_map = ("'" +
               '"import scidbstrm; scidbstrm.map(scidbstrm.read_func())"' +
               "'")
 
+python_map_arrow = ("'" +
+                    'python{major} -uc '.format(
+                        major=sys.version_info.major) +
+                    '"import scidbstrm; scidbstrm.map(' +
+                    "scidbstrm.read_func('arrow'), format='arrow')" +
+                    '"' + "'")
+
 
 # Python 2 and 3 compatibility fix for reading/writing binary data
 # to/from STDIN/STDOUT
@@ -36,10 +44,79 @@ else:
     stdout = sys.stdout
 
 
+class _SharedMemory(object):
+    """The memory region SciDB shares with this process when ``stream``
+    runs with ``transport:'shm'``. SciDB places each request in the
+    first half of the region and sends its location down the pipe as
+    an (offset, length, sequence) record; the response goes in the
+    second half and its record goes back up. A message that does not
+    fit follows its record on the pipe instead.
+
+    """
+    RECORD = struct.Struct('=QQQ')
+    INLINE = 2 ** 64 - 1
+
+    def __init__(self, fd):
+        size = os.fstat(fd).st_size
+        self.half = size // 2
+        self.view = memoryview(mmap.mmap(fd, size))
+        self.seq = 0
+
+    def receive(self):
+        offset, length, self.seq = self.RECORD.unpack(
+            stdin.read(self.RECORD.size))
+        if offset == self.INLINE:
+            return memoryview(stdin.read(length))
+        return self.view[offset:offset + length]
+
+    def send(self, parts):
+        length = sum(len(part) for part in parts)
+        if length > self.half:
+            stdout.write(self.RECORD.pack(self.INLINE, length, self.seq))
+            for part in parts:
+                stdout.write(part)
+            return
+        pos = self.half
+        for part in parts:
+            self.view[pos:pos + len(part)] = part
+            pos += len(part)
+        stdout.write(self.RECORD.pack(self.half, length, self.seq))
+
+
+_shm = None
+
+
+def _shared_memory():
+    """Return the region shared with SciDB, or None if the data comes
+    down the pipes. Checked on first use so that copies forked from
+    ``scidbstrm.zygote`` find their own region.
+
+    """
+    global _shm
+    if _shm is None:
+        fd = os.environ.get('SCIDB_STREAM_SHM_FD')
+        _shm = _SharedMemory(int(fd)) if fd else False
+    return _shm or None
+
+
 def read():
     """Read a data chunk from SciDB. Returns a Pandas DataFrame or None.
 
     """
+    shm = _shared_memory()
+    if shm is not None:
+        msg = shm.receive()
+        sz = struct.unpack('<Q', msg[:8])[0]
+        if not sz:
+            return None
+        import pyarrow
+        import pyarrow.feather
+        # Read in place; to_pandas copies the data out before the
+        # region is reused for the next request
+        return pyarrow.feather.read_table(
+            pyarrow.BufferReader(pyarrow.py_buffer(msg[8:8 + sz]))
+        ).to_pandas()
+
     sz = struct.unpack('<Q', stdin.read(8))[0]
 
     if sz:
@@ -54,19 +131,135 @@ def write(df=None):
     """Write a data chunk to SciDB.
 
     """
+    shm = _shared_memory()
     if df is None:
-        stdout.write(struct.pack('<Q', 0))
+        if shm is not None:
+            shm.send((struct.pack('<Q', 0),))
+        else:
+            stdout.write(struct.pack('<Q', 0))
         return
 
     buf = io.BytesIO()
     df.to_feather(buf)
-    byt = buf.getvalue()
+    byt = buf.getbuffer() if hasattr(buf, 'getbuffer') else buf.getvalue()
     sz = len(byt)
 
+    if shm is not None:
+        shm.send((struct.pack('<Q', sz), byt))
+        return
     stdout.write(struct.pack('<Q', sz))
     stdout.write(byt)
 
 
+class _ArrowRequests(object):
+    """The Arrow IPC streams SciDB sends with ``format:'arrow'``, as a
+    file object for ``pyarrow.ipc.open_stream``. With shared memory the
+    streams span successive messages.
+
+    """
+    def __init__(self):
+        self.shm = _shared_memory()
+        self.msg = memoryview(b'')
+        self.head = b''
+        self.closed = False
+
+    def read(self, n):
+        parts = [self.head[:n]]
+        self.head = self.head[n:]
+        n -= len(parts[0])
+        if self.shm is None:
+            parts.append(stdin.read(n))
+        while self.shm is not None and n:
+            if not len(self.msg):
+                self.msg = self.shm.receive()
+            parts.append(self.msg[:n].tobytes())
+            self.msg = self.msg[n:]
+            n -= len(parts[-1])
+        return b''.join(parts)
+
+    def unread(self, data):
+        self.head = data + self.head
+
+    def readable(self):
+        return True
+
+    def seekable(self):
+        return False
+
+    def close(self):
+        pass
+
+
+_arrow_requests = None
+_arrow_reader = None
+_arrow_writer = None
+_arrow_schema = None
+_arrow_sink = None
+_ARROW_EOS = struct.pack('<Ii', 0xFFFFFFFF, 0)
+
+
+def read_arrow():
+    """Read a data chunk from SciDB streaming with ``format:'arrow'``.
+    Returns a Pandas DataFrame or None.
+
+    """
+    global _arrow_requests, _arrow_reader
+    import pyarrow
+    if _arrow_requests is None:
+        _arrow_requests = _ArrowRequests()
+    while True:
+        if _arrow_reader is not None:
+            try:
+                return _arrow_reader.read_next_batch().to_pandas()
+            except StopIteration:
+                _arrow_reader = None
+        # End-of-stream where the next stream would start: last chunk
+        head = _arrow_requests.read(8)
+        if head == _ARROW_EOS:
+            return None
+        _arrow_requests.unread(head)
+        _arrow_reader = pyarrow.ipc.open_stream(_arrow_requests)
+
+
+def write_arrow(df=None, last=False):
+    """Write a data chunk to SciDB streaming with ``format:'arrow'``.
+    Set `last` when answering the last chunk.
+
+    """
+    global _arrow_writer, _arrow_schema, _arrow_sink
+    import pyarrow
+    if _arrow_sink is None:
+        _arrow_sink = io.BytesIO()
+    _arrow_sink.seek(0)
+    _arrow_sink.truncate()
+    if df is not None:
+        # Later chunks of the stream take on the schema of the first
+        batch = pyarrow.RecordBatch.from_pandas(
+            df, schema=_arrow_schema, preserve_index=False)
+        if _arrow_writer is None:
+            _arrow_schema = batch.schema
+            _arrow_writer = pyarrow.ipc.new_stream(_arrow_sink, _arrow_schema)
+        _arrow_writer.write_batch(batch)
+    if df is None or last:
+        # No data, or no more data: end the stream
+        if _arrow_writer is not None:
+            _arrow_writer.close()
+            _arrow_writer = None
+            _arrow_schema = None
+        else:
+            _arrow_sink.write(_ARROW_EOS)
+
+    # One message per response, whatever went into it
+    byt = (_arrow_sink.getbuffer() if hasattr(_arrow_sink, 'getbuffer')
+           else _arrow_sink.getvalue())
+    shm = _shared_memory()
+    if shm is not None:
+        shm.send((byt,))
+    else:
+        stdout.write(byt)
+    del byt                     # a live view keeps the sink from shrinking
+
+
 def pack_func(func):
     """Serialize function to upload to SciDB. The result can be used as
     `upload_data` in `input` or `load` operators.
@@ -77,35 +270,45 @@ def pack_func(func):
     )
 
 
-def read_func():
+def read_func(format='feather'):
     """Read and de-serialize function from SciDB.
 
     """
+    if format == 'arrow':
+        func = dill.loads(read_arrow().iloc[0, 0])
+        write_arrow()
+        return func
     func = dill.loads(read().iloc[0, 0])
     write()                     # SciDB expects a message back
     return func
 
 
-def map(map_fun, finalize_fun=None):
+def map(map_fun, finalize_fun=None, format='feather'):
     """Read SciDB chunks. For each chunk, call `map_fun` and stream its
     result back to SciDB. If `finalize_fun` is provided, call it after
-    all the chunks have been processed.
+    all the chunks have been processed. Set `format` to ``'arrow'``
+    when streaming with ``format:'arrow'``.
 
     """
+    arrow = format == 'arrow'
     while True:
 
         # Read DataFrame
-        df = read()
+        df = read_arrow() if arrow else read()
 
         if df is None:
             # End of stream
             break
 
         # Write DataFrame
-        write(map_fun(df))
+        if arrow:
+            write_arrow(map_fun(df))
+        else:
+            write(map_fun(df))
 
     # Write final DataFrame (if any)
-    if finalize_fun is None:
-        write()
+    final = None if finalize_fun is None else finalize_fun()
+    if arrow:
+        write_arrow(final, last=True)
     else:
-        write(finalize_fun())
+        write(final)
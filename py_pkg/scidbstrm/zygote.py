@@ -0,0 +1,127 @@
+"""Fork server for the ``zygote`` option of the SciDB ``stream``
+operator. Start it with::
+
+  stream(..., 'script.py arg1 arg2',
+         zygote:'python3 -m scidbstrm.zygote preload.py')
+
+The zygote imports ``scidbstrm`` (and with it NumPy and Pandas), runs
+the optional preload script once, and then forks a copy of itself
+for every ``stream`` child. The copy runs the program given to
+``stream`` -- a Python script followed by its arguments, or ``-c``
+followed by Python code -- with the pipes from SciDB as its standard
+input and output, and the shared memory region, if any, as descriptor
+3. Requires Python 3.
+
+"""
+
+import os
+import runpy
+import shlex
+import signal
+import socket
+import struct
+import sys
+import traceback
+
+import scidbstrm
+
+
+def _recv_request(sock):
+    """Read one request: the program to run, the two pipe ends attached
+    to it and, with ``transport:'shm'``, the shared memory region.
+    Returns (None, None) when SciDB closes the socket.
+
+    """
+    fds_size = socket.CMSG_SPACE(3 * struct.calcsize('i'))
+    hdr, ancdata, _, _ = sock.recvmsg(8, fds_size)
+    if not hdr:
+        return None, None
+    fds = []
+    for level, kind, data in ancdata:
+        if level == socket.SOL_SOCKET and kind == socket.SCM_RIGHTS:
+            fds.extend(struct.unpack('=%di' % (len(data) // 4), data))
+    while len(hdr) < 8:
+        hdr += sock.recv(8 - len(hdr))
+    sz = struct.unpack('=Q', hdr)[0]
+    program = b''
+    while len(program) < sz:
+        part = sock.recv(sz - len(program))
+        if not part:
+            return None, None
+        program += part
+    return program.decode(), fds
+
+
+def _run(program):
+    """Run the program in this process, as ``python`` would.
+
+    """
+    argv = shlex.split(program)
+    if argv[0] == '-c':
+        sys.argv = ['-c'] + argv[2:]
+        exec(compile(argv[1], '<string>', 'exec'), {'__name__': '__main__'})
+    else:
+        sys.argv = argv
+        runpy.run_path(argv[0], run_name='__main__')
+
+
+def _child(sock, fds, program):
+    signal.signal(signal.SIGCHLD, signal.SIG_DFL)
+    sock.close()
+    targets = (0, 1, 3)[:len(fds)]
+    for fd, target in zip(fds, targets):
+        if fd != target:
+            os.dup2(fd, target)
+    for fd in fds:
+        if fd not in targets:
+            os.close(fd)
+    if len(fds) > 2:
+        os.environ['SCIDB_STREAM_SHM_FD'] = '3'
+    code = 0
+    try:
+        _run(program)
+    except SystemExit as e:
+        code = e.code if isinstance(e.code, int) else 1
+    except BaseException:
+        traceback.print_exc()
+        code = 1
+    try:
+        scidbstrm.stdout.flush()
+    except Exception:
+        code = code or 1
+    os._exit(code)
+
+
+def serve(preload=None):
+    """Serve fork requests from SciDB on standard input until SciDB
+    goes away.
+
+    """
+    sock = socket.socket(fileno=os.dup(0))
+    # Keep stray output of the preload away from the protocol
+    devnull = os.open(os.devnull, os.O_RDWR)
+    os.dup2(devnull, 0)
+    os.dup2(2, 1)
+    os.close(devnull)
+    if preload:
+        runpy.run_path(preload, run_name='__zygote__')
+    sys.stdout.flush()
+    signal.signal(signal.SIGCHLD, signal.SIG_IGN)  # reap copies
+
+    while True:
+        program, fds = _recv_request(sock)
+        if program is None:
+            return
+        try:
+            pid = os.fork()
+        except OSError:
+            pid = -1
+        if pid == 0:
+            _child(sock, fds, program)
+        for fd in fds:
+            os.close(fd)
+        sock.sendall(struct.pack('=q', pid))
+
+
+if __name__ == '__main__':
+    serve(sys.argv[1] if len(sys.argv) > 1 else None)
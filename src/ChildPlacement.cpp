@@ -0,0 +1,185 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* Copyright (C) 2008-2020 Paradigm4 Inc.
+* All Rights Reserved.
+*
+* stream is a plugin for SciDB, an Open Source Array DBMS maintained
+* by Paradigm4. See http://www.paradigm4.com/
+*
+* stream is free software: you can redistribute it and/or modify
+* it under the terms of the AFFERO GNU General Public License as published by
+* the Free Software Foundation.
+*
+* stream is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND,
+* INCLUDING ANY IMPLIED WARRANTY OF MERCHANTABILITY,
+* NON-INFRINGEMENT, OR FITNESS FOR A PARTICULAR PURPOSE. See
+* the AFFERO GNU General Public License for the complete license terms.
+*
+* You should have received a copy of the AFFERO GNU General Public License
+* along with stream.  If not, see <http://www.gnu.org/licenses/agpl-3.0.html>
+*
+* END_COPYRIGHT
+*/
+
+#include "ChildPlacement.h"
+
+#include <algorithm>
+#include <ctype.h>
+#include <dirent.h>
+#include <fstream>
+#include <stdlib.h>
+#include <string.h>
+
+using std::string;
+using std::vector;
+
+namespace scidb { namespace stream
+{
+
+/**
+ * Parse a kernel CPU list such as "0-3,8-11".
+ */
+static vector<int> parseCpuList(string const& list)
+{
+    vector<int> res;
+    char const* p = list.c_str();
+    while(*p != '\0' && *p != '\n')
+    {
+        char* end = NULL;
+        long first = strtol(p, &end, 10);
+        long last = first;
+        if(end == p)
+        {
+            break;
+        }
+        if(*end == '-')
+        {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+        }
+        for(long cpu = first; cpu <= last; ++cpu)
+        {
+            res.push_back(cpu);
+        }
+        p = *end == ',' ? end + 1 : end;
+    }
+    return res;
+}
+
+vector<int> ChildPlacement::nodeCpus(cpu_set_t const& allowed)
+{
+    char const* const nodeDir = "/sys/devices/system/node";
+    vector<int> res;
+    DIR* dir = opendir(nodeDir);
+    if(dir == NULL)
+    {
+        return res;
+    }
+    int const current = sched_getcpu();
+    size_t bestCount = 0;
+    bool bestHasCurrent = false;
+    while(struct dirent* entry = readdir(dir))
+    {
+        if(strncmp(entry->d_name, "node", 4) != 0 || !isdigit(entry->d_name[4]))
+        {
+            continue;
+        }
+        std::ifstream in(string(nodeDir) + "/" + entry->d_name + "/cpulist");
+        string list;
+        std::getline(in, list);
+        vector<int> cpus = parseCpuList(list);
+        size_t count = 0;
+        bool hasCurrent = false;
+        for(size_t i = 0; i < cpus.size(); ++i)
+        {
+            count += CPU_ISSET(cpus[i], &allowed) ? 1 : 0;
+            hasCurrent = hasCurrent || cpus[i] == current;
+        }
+        //the node the instance may use most; on a tie, the one it is running on now
+        if(count > bestCount || (count == bestCount && count > 0 && hasCurrent && !bestHasCurrent))
+        {
+            res.swap(cpus);
+            bestCount = count;
+            bestHasCurrent = hasCurrent;
+        }
+    }
+    closedir(dir);
+    return res;
+}
+
+ChildPlacement::ChildPlacement(Affinity policy, InstanceID instance, size_t nChildren):
+    _policy(policy),
+    _offset(0)
+{
+    if(_policy == AFFINITY_NONE)
+    {
+        return;
+    }
+    cpu_set_t allowed;
+    if(sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+    {
+        _policy = AFFINITY_NONE;
+        return;
+    }
+    vector<int> const node = nodeCpus(allowed);
+    for(size_t i = 0; i < node.size(); ++i)
+    {
+        if(CPU_ISSET(node[i], &allowed))
+        {
+            _cpus.push_back(node[i]);
+        }
+    }
+    if(_cpus.empty())   //no NUMA information: all the CPUs of the instance are equally near
+    {
+        for(int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+        {
+            if(CPU_ISSET(cpu, &allowed))
+            {
+                _cpus.push_back(cpu);
+            }
+        }
+    }
+    std::sort(_cpus.begin(), _cpus.end());
+    _offset = (instance * nChildren) % std::max<size_t>(_cpus.size(), 1);
+    LOG4CXX_DEBUG(logger, "stream children placed on "<<_cpus.size()<<" cpus starting at "<<(_cpus.empty() ? -1 : _cpus[0]));
+}
+
+bool ChildPlacement::getCpus(size_t childIdx, cpu_set_t& cpus) const
+{
+    if(_policy == AFFINITY_NONE || _cpus.empty())
+    {
+        return false;
+    }
+    CPU_ZERO(&cpus);
+    if(_policy == AFFINITY_SPREAD)
+    {
+        CPU_SET(_cpus[(_offset + childIdx) % _cpus.size()], &cpus);
+        return true;
+    }
+    for(size_t i = 0; i < _cpus.size(); ++i)
+    {
+        CPU_SET(_cpus[i], &cpus);
+    }
+    return true;
+}
+
+ScopedAffinity::ScopedAffinity(cpu_set_t const* cpus):
+    _restore(false)
+{
+    if(cpus != NULL && sched_getaffinity(0, sizeof(_saved), &_saved) == 0)   //0 is the calling thread
+    {
+        _restore = sched_setaffinity(0, sizeof(*cpus), cpus) == 0;
+    }
+}
+
+ScopedAffinity::~ScopedAffinity()
+{
+    if(_restore)
+    {
+        sched_setaffinity(0, sizeof(_saved), &_saved);
+    }
+}
+
+} } //namespace
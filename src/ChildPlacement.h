@@ -0,0 +1,96 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* Copyright (C) 2008-2020 Paradigm4 Inc.
+* All Rights Reserved.
+*
+* stream is a plugin for SciDB, an Open Source Array DBMS maintained
+* by Paradigm4. See http://www.paradigm4.com/
+*
+* stream is free software: you can redistribute it and/or modify
+* it under the terms of the AFFERO GNU General Public License as published by
+* the Free Software Foundation.
+*
+* stream is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND,
+* INCLUDING ANY IMPLIED WARRANTY OF MERCHANTABILITY,
+* NON-INFRINGEMENT, OR FITNESS FOR A PARTICULAR PURPOSE. See
+* the AFFERO GNU General Public License for the complete license terms.
+*
+* You should have received a copy of the AFFERO GNU General Public License
+* along with stream.  If not, see <http://www.gnu.org/licenses/agpl-3.0.html>
+*
+* END_COPYRIGHT
+*/
+
+#ifndef SRC_CHILDPLACEMENT_H_
+#define SRC_CHILDPLACEMENT_H_
+
+#include <sched.h>
+#include <vector>
+#include <query/Query.h>
+
+#include "StreamSettings.h"
+
+namespace scidb { namespace stream
+{
+
+/**
+ * Decides which CPUs the children of an instance run on. Placing the CPUs places the memory too: under the
+ * default local allocation policy, a process gets its pages from the NUMA node it runs on, so a child kept on
+ * the node of its instance reads and writes the pipes and shared memory without crossing the interconnect.
+ */
+class ChildPlacement
+{
+public:
+    /**
+     * @param policy where the children should run
+     * @param instance the instance starting them; instances that share a node give their children different cores
+     * @param nChildren how many children the instance runs at once
+     */
+    ChildPlacement(Affinity policy, InstanceID instance, size_t nChildren);
+
+    /**
+     * @param childIdx the index of the child among those of the instance
+     * @param[out] cpus where the child should run
+     * @return false if the child should just inherit the CPUs of the instance
+     */
+    bool getCpus(size_t childIdx, cpu_set_t& cpus) const;
+
+private:
+    Affinity         _policy;
+    std::vector<int> _cpus;     // of the instance on its node, ascending
+    size_t           _offset;   // first core for spreading
+
+    /**
+     * @return the CPUs of the NUMA node that most of the given CPUs belong to, or an empty set if the host has no
+     *         NUMA information
+     */
+    static std::vector<int> nodeCpus(cpu_set_t const& allowed);
+};
+
+/**
+ * Restricts the calling thread to a set of CPUs for the lifetime of the object, so a child started meanwhile
+ * inherits the restriction from its very first instruction, before it can start threads of its own.
+ */
+class ScopedAffinity
+{
+public:
+    /**
+     * @param cpus where the thread should run, or NULL to leave it alone
+     */
+    explicit ScopedAffinity(cpu_set_t const* cpus);
+
+    ~ScopedAffinity();
+
+private:
+    cpu_set_t _saved;
+    bool      _restore;
+
+    ScopedAffinity(ScopedAffinity const&) = delete;
+    ScopedAffinity& operator=(ScopedAffinity const&) = delete;
+};
+
+} } //namespace
+
+#endif /* SRC_CHILDPLACEMENT_H_ */
@@ -0,0 +1,182 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* Copyright (C) 2008-2020 Paradigm4 Inc.
+* All Rights Reserved.
+*
+* stream is a plugin for SciDB, an Open Source Array DBMS maintained
+* by Paradigm4. See http://www.paradigm4.com/
+*
+* stream is free software: you can redistribute it and/or modify
+* it under the terms of the AFFERO GNU General Public License as published by
+* the Free Software Foundation.
+*
+* stream is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND,
+* INCLUDING ANY IMPLIED WARRANTY OF MERCHANTABILITY,
+* NON-INFRINGEMENT, OR FITNESS FOR A PARTICULAR PURPOSE. See
+* the AFFERO GNU General Public License for the complete license terms.
+*
+* You should have received a copy of the AFFERO GNU General Public License
+* along with stream.  If not, see <http://www.gnu.org/licenses/agpl-3.0.html>
+*
+* END_COPYRIGHT
+*/
+
+
+#include "ChildPool.h"
+#include "ChildSlots.h"
+#include <algorithm>
+#include <rbac/Session.h>
+
+using std::shared_ptr;
+using std::string;
+using std::unique_ptr;
+
+namespace scidb { namespace stream
+{
+
+static log4cxx::LoggerPtr logger(log4cxx::Logger::getLogger("scidb.operators.stream.childpool"));
+
+ChildPool::ChildPool():
+    _stopping(false)
+{}
+
+ChildPool::~ChildPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _cv.notify_all();
+    if(_reaper.joinable())
+    {
+        _reaper.join();
+    }
+}
+
+string ChildPool::makeKey(string const& key, shared_ptr<Query> const& query)
+{
+    string res = query->getSession()->getUser().getName();
+    res.push_back('\0');
+    res.append(key);
+    return res;
+}
+
+void ChildPool::evictExpired(std::list<Entry>& evicted)
+{
+    Clock::time_point const now = Clock::now();
+    for(auto it = _idle.begin(); it != _idle.end(); )
+    {
+        auto next = std::next(it);
+        if(it->expiry <= now)
+        {
+            evicted.splice(evicted.end(), _idle, it);
+        }
+        it = next;
+    }
+}
+
+void ChildPool::reap()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    while(!_stopping)
+    {
+        std::list<Entry> evicted;
+        evictExpired(evicted);
+        if(!evicted.empty())
+        {
+            lock.unlock();
+            LOG4CXX_DEBUG(logger, "Killing "<<evicted.size()<<" pooled children idle past their timeout");
+            evicted.clear();
+            lock.lock();
+            continue;
+        }
+        if(_idle.empty())
+        {
+            _cv.wait(lock);
+            continue;
+        }
+        Clock::time_point next = _idle.front().expiry;
+        for(auto it = _idle.begin(); it != _idle.end(); ++it)
+        {
+            next = std::min(next, it->expiry);
+        }
+        _cv.wait_until(lock, next);
+    }
+}
+
+unique_ptr<ChildProcess> ChildPool::acquire(string const& key, shared_ptr<Query>& query)
+{
+    string const fullKey = makeKey(key, query);
+    while(true)
+    {
+        std::list<Entry> evicted;
+        unique_ptr<ChildProcess> child;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            evictExpired(evicted);
+            for(auto it = _idle.rbegin(); it != _idle.rend(); ++it)   //most recently used first
+            {
+                if(it->key == fullKey)
+                {
+                    child = std::move(it->child);
+                    _idle.erase(std::next(it).base());
+                    break;
+                }
+            }
+        }
+        evicted.clear();
+        if(!child)
+        {
+            return child;
+        }
+        if(child->isIdle())
+        {
+            LOG4CXX_DEBUG(logger, "Reusing child for "<<key);
+            child->attach(query);
+            return child;
+        }
+        LOG4CXX_DEBUG(logger, "Discarding pooled child that is no longer idle");
+    }
+}
+
+void ChildPool::release(unique_ptr<ChildProcess> child, string const& key, shared_ptr<Query> const& query,
+                        size_t idleTimeoutSec)
+{
+    if(idleTimeoutSec == 0 || !child->isIdle())
+    {
+        return;
+    }
+    child->detach();
+    child->holdSlot(unique_ptr<ChildSlot>());   //an idle child does not run, so it leaves its slot to others
+    std::list<Entry> evicted;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if(!_reaper.joinable())
+        {
+            _reaper = std::thread(&ChildPool::reap, this);
+        }
+        evictExpired(evicted);
+        if(_idle.size() >= MAX_IDLE_CHILDREN)
+        {
+            evicted.splice(evicted.end(), _idle, _idle.begin());
+        }
+        _idle.push_back(Entry());
+        _idle.back().key    = makeKey(key, query);
+        _idle.back().child  = std::move(child);
+        _idle.back().expiry = Clock::now() + std::chrono::seconds(idleTimeoutSec);
+    }
+    _cv.notify_all();
+}
+
+void ChildPool::clear()
+{
+    std::list<Entry> evicted;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        evicted.swap(_idle);
+    }
+}
+
+} } //namespace
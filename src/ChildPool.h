@@ -0,0 +1,129 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* Copyright (C) 2008-2020 Paradigm4 Inc.
+* All Rights Reserved.
+*
+* stream is a plugin for SciDB, an Open Source Array DBMS maintained
+* by Paradigm4. See http://www.paradigm4.com/
+*
+* stream is free software: you can redistribute it and/or modify
+* it under the terms of the AFFERO GNU General Public License as published by
+* the Free Software Foundation.
+*
+* stream is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND,
+* INCLUDING ANY IMPLIED WARRANTY OF MERCHANTABILITY,
+* NON-INFRINGEMENT, OR FITNESS FOR A PARTICULAR PURPOSE. See
+* the AFFERO GNU General Public License for the complete license terms.
+*
+* You should have received a copy of the AFFERO GNU General Public License
+* along with stream.  If not, see <http://www.gnu.org/licenses/agpl-3.0.html>
+*
+* END_COPYRIGHT
+*/
+
+
+#ifndef SRC_CHILDPOOL_H_
+#define SRC_CHILDPOOL_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <query/Query.h>
+
+#include "ChildProcess.h"
+
+namespace scidb { namespace stream
+{
+
+/**
+ * Keeps children alive between queries, so a command with an expensive startup (loading R or Python libraries,
+ * reading a model) pays for it once per instance rather than once per query. A child is handed back to the pool
+ * after it answered the terminating message, and handed out again only to a later query that runs the same command
+ * on behalf of the same user. Children that exit, leave unread output behind or sit idle past their timeout are
+ * killed; a reaper thread kills the expired ones even if no query uses the pool again. An idle child gives up its
+ * host slot, if it had one. There is one pool per instance, owned by the plugin; it is safe to use from concurrent
+ * queries.
+ */
+class ChildPool
+{
+public:
+    /**
+     * The most idle children kept per instance; the longest idle child is evicted to make room.
+     */
+    static size_t const MAX_IDLE_CHILDREN = 16;
+
+    /**
+     * @return the pool of this instance
+     */
+    static ChildPool& getInstance();
+
+    ChildPool();
+
+    /**
+     * Stop the reaper and kill all idle children.
+     */
+    ~ChildPool();
+
+    /**
+     * Take an idle child that was released under the same key by the same user.
+     * @param key identifies what the child runs, such as its command line
+     * @param query the query context; the returned child is attached to it
+     * @return the child, or null if there is none idle
+     */
+    std::unique_ptr<ChildProcess> acquire(std::string const& key, std::shared_ptr<Query>& query);
+
+    /**
+     * Return a child to the pool once its interaction with the query is complete, giving up its host slot. The
+     * child is killed instead if it is not idle.
+     * @param child the child to keep
+     * @param key identifies what the child runs, such as its command line
+     * @param query the query the child was serving
+     * @param idleTimeoutSec how long the child may stay in the pool unused
+     */
+    void release(std::unique_ptr<ChildProcess> child, std::string const& key, std::shared_ptr<Query> const& query,
+                 size_t idleTimeoutSec);
+
+    /**
+     * Kill all idle children.
+     */
+    void clear();
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Entry
+    {
+        std::string                   key;
+        std::unique_ptr<ChildProcess> child;
+        Clock::time_point             expiry;
+    };
+
+    std::mutex              _mutex;
+    std::condition_variable _cv;        // wakes the reaper when a child is added or the pool goes away
+    std::list<Entry>        _idle;      // least recently released first
+    bool                    _stopping;
+    std::thread             _reaper;    // started with the first release
+
+    static std::string makeKey(std::string const& key, std::shared_ptr<Query> const& query);
+
+    /**
+     * Move the expired entries out of the pool. Must be called with the lock held; the evicted children should
+     * be destroyed after the lock is released, as killing a child may take a while.
+     */
+    void evictExpired(std::list<Entry>& evicted);
+
+    /**
+     * The reaper thread: kill each idle child when it expires.
+     */
+    void reap();
+};
+
+} } //namespace
+
+#endif /* SRC_CHILDPOOL_H_ */
@@ -24,18 +24,30 @@
 */
 
 #include "ChildProcess.h"
+#include "ChildSlots.h"
+#include "Zygote.h"
+#include <algorithm>
+#include <chrono>
 #include <limits>
 #include <sstream>
 #include <memory>
 #include <string>
+#include <string.h>
 #include <vector>
 #include <ctype.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <poll.h>
+#include <spawn.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <query/Query.h>
 
 using std::shared_ptr;
@@ -45,60 +57,446 @@ namespace scidb { namespace stream
 {
 
 static log4cxx::LoggerPtr logger(log4cxx::Logger::getLogger("scidb.operators.stream.childprocess"));
+static std::atomic<uint64_t> lastChildId(0);
 
-ChildProcess::ChildProcess(string const& commandLine, shared_ptr<Query>& query, size_t const readBufSize):
+/**
+ * Tells a child that has a shared memory region which descriptor it is on.
+ */
+#define SHM_ENV_VAR "SCIDB_STREAM_SHM_FD"
+
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 34)
+#define STREAM_HAVE_CLOSEFROM_NP 1
+#endif
+
+#ifndef STREAM_HAVE_CLOSEFROM_NP
+/**
+ * Close every descriptor from first up in a freshly forked child. Only async-signal-safe calls are allowed here.
+ */
+static void closeInheritedFds(int first)
+{
+#ifdef SYS_close_range
+    if(syscall(SYS_close_range, first, ~0U, 0) == 0)
+    {
+        return;
+    }
+#endif
+    //old kernel: one call per possible descriptor, which is slow when the limit is large
+    struct rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    for(unsigned long i = first; i<limit.rlim_max; i = i+1)
+    {
+        close(i);
+    }
+}
+#endif
+
+pid_t ChildProcess::spawn(string const& commandLine, int stdinFd, int stdoutFd, int shmFd)
+{
+    //child needs to close all open FDs - just in case its parent is listening on a port (ahem)
+    //we wouldn't want the child to clog up said port for no reason
+    std::chrono::steady_clock::time_point const start = std::chrono::steady_clock::now();
+    char const* const argv[] = { "/bin/bash", "-c", commandLine.c_str(), NULL };
+    char const* const envp[] = { shmFd < 0 ? NULL : SHM_ENV_VAR "=3", NULL };
+    int const firstToClose = shmFd < 0 ? 3 : 4;
+    pid_t pid;
+#ifdef STREAM_HAVE_CLOSEFROM_NP
+    //posix_spawn shares the address space with the child until exec, so nothing of the (large) parent is copied
+    char const* const method = "posix_spawn";
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, stdoutFd, 1);    // stdout writes to parent
+    posix_spawn_file_actions_adddup2(&actions, stdinFd, 0);     // parent writes to stdin
+    if(shmFd >= 0)
+    {
+        posix_spawn_file_actions_adddup2(&actions, shmFd, 3);   // shared memory, if any, is always fd 3
+    }
+    posix_spawn_file_actions_addclosefrom_np(&actions, firstToClose);
+    int err = posix_spawn(&pid, argv[0], &actions, NULL, const_cast<char* const*>(argv), const_cast<char* const*>(envp));
+    posix_spawn_file_actions_destroy(&actions);
+    if(err != 0)
+    {
+        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "posix_spawn failed, bummer; errno "<<err;
+    }
+#else
+    char const* const method = "fork";
+    pid = ::fork ();
+    switch (pid)
+    {
+    case -1:
+        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "fork failed, bummer";
+    case 0:                    // child
+        dup2 (stdoutFd, 1);    // stdout writes to parent
+        dup2 (stdinFd, 0);     // parent writes to stdin
+        if(shmFd == 3)
+        {
+            fcntl(3, F_SETFD, 0);
+        }
+        else if(shmFd >= 0)
+        {
+            dup2 (shmFd, 3);   // shared memory, if any, is always fd 3
+        }
+        closeInheritedFds(firstToClose);
+        execve (argv[0], const_cast<char* const*>(argv), const_cast<char* const*>(envp));
+        abort ();  //if execve returns, it means we're in trouble. bail asap.
+    default:  // parent
+        break;
+    }
+#endif
+    LOG4CXX_DEBUG(logger, "Started child "<<pid<<" with "<<method<<" in "<<
+                  std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count()<<" us");
+    return pid;
+}
+
+ChildProcess::ChildProcess(string const& commandLine, shared_ptr<Query>& query, size_t const shmSize, size_t const readBufSize):
+        _id(++lastChildId),
         _alive(false),
+        _interrupted(false),
         _pollTimeoutMillis(100),
         _query(query),
         _readBuf(readBufSize),
         _readBufIdx(0),
-        _readBufEnd(0)
+        _readBufEnd(0),
+        _pidFd(-1),
+        _peer(OWN_CHILD),
+        _spliceWrites(false),
+        _killTimeoutMillis(500),
+        _shm(NULL),
+        _shmSize(0),
+        _shmSeq(0),
+        _shmMsgPtr(NULL),
+        _shmMsgLeft(0),
+        _shmMsgInline(false)
 {
     LOG4CXX_DEBUG(logger, "Executing "<<commandLine);
+    int const shmFd = shmSize > 0 ? mapShm(shmSize) : -1;
     int parent_child[2];          // pipe descriptors parent writes to child
     int child_parent[2];          // pipe descriptors child writes to parent
-    pipe (parent_child);
-    pipe (child_parent);
-    _childPid = ::fork ();
-    switch (_childPid )
+    try
     {
-    case -1:
-        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "fork failed, bummer";
-    case 0:                    // child
-        close (1);
-        dup (child_parent[1]);    // stdout writes to parent
-        close (0);
-        dup (parent_child[0]);    // parent writes to stdin
-        close (parent_child[1]);
-        close (child_parent[0]);
-        //child needs to close all open FDs - just in case its parent is listening on a port (ahem)
-        //we wouldn't want the child to clog up said port for no reason
-        struct rlimit limit;
-        getrlimit(RLIMIT_NOFILE, &limit);
-        for(unsigned long i = 3; i<limit.rlim_max; i = i+1)
+        openPipes(parent_child, child_parent);
+        try
         {
-            close(i);
+            _childPid = spawn(commandLine, parent_child[0], child_parent[1], shmFd);
         }
-        execle ("/bin/bash", "/bin/bash", "-c", commandLine.c_str(), NULL, NULL);
-        abort ();  //if execle returns, it means we're in trouble. bail asap.
-        break;
-    default:  // parent
-        close (parent_child[0]);
-        close (child_parent[1]);
-        _childInFd  = parent_child[1];
-        _childOutFd = child_parent[0];
-        int flags = fcntl(_childOutFd, F_GETFL, 0);
-        if(fcntl(_childOutFd, F_SETFL, flags | O_NONBLOCK) < 0 )
+        catch(...)
+        {
+            closePipes(parent_child, child_parent);
+            throw;
+        }
+    }
+    catch(...)
+    {
+        unmapShm(shmFd);
+        throw;
+    }
+    unmapShm(shmFd, false);
+    connect(parent_child, child_parent);
+}
+
+ChildProcess::ChildProcess(Zygote& zygote, string const& program, shared_ptr<Query>& query, size_t const shmSize, size_t const readBufSize):
+        _id(++lastChildId),
+        _alive(false),
+        _interrupted(false),
+        _pollTimeoutMillis(100),
+        _query(query),
+        _readBuf(readBufSize),
+        _readBufIdx(0),
+        _readBufEnd(0),
+        _pidFd(-1),
+        _peer(ZYGOTE_CHILD),
+        _spliceWrites(false),
+        _killTimeoutMillis(500),
+        _shm(NULL),
+        _shmSize(0),
+        _shmSeq(0),
+        _shmMsgPtr(NULL),
+        _shmMsgLeft(0),
+        _shmMsgInline(false)
+{
+    LOG4CXX_DEBUG(logger, "Forking zygote for "<<program);
+    int const shmFd = shmSize > 0 ? mapShm(shmSize) : -1;
+    int parent_child[2];
+    int child_parent[2];
+    try
+    {
+        openPipes(parent_child, child_parent);
+        try
         {
-            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "fcntl failed, bummer";
+            _childPid = zygote.spawn(program, parent_child[0], child_parent[1], shmFd, query);
         }
-        flags = fcntl(_childInFd, F_GETFL, 0);
-        if(fcntl(_childInFd, F_SETFL, flags | O_NONBLOCK) < 0 )
+        catch(...)
         {
-            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "fcntl failed, bummer";
+            closePipes(parent_child, child_parent);
+            throw;
         }
     }
+    catch(...)
+    {
+        unmapShm(shmFd);
+        throw;
+    }
+    unmapShm(shmFd, false);
+    connect(parent_child, child_parent);
+}
+
+ChildProcess::ChildProcess(ServerAddress const& server, shared_ptr<Query>& query, size_t const readBufSize):
+        _id(++lastChildId),
+        _alive(false),
+        _interrupted(false),
+        _pollTimeoutMillis(100),
+        _query(query),
+        _readBuf(readBufSize),
+        _readBufIdx(0),
+        _readBufEnd(0),
+        _childPid(-1),
+        _pidFd(-1),
+        _peer(SERVER),
+        _spliceWrites(false),
+        _killTimeoutMillis(0),
+        _shm(NULL),
+        _shmSize(0),
+        _shmSeq(0),
+        _shmMsgPtr(NULL),
+        _shmMsgLeft(0),
+        _shmMsgInline(false)
+{
+    LOG4CXX_DEBUG(logger, "Connecting to "<<server.path);
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if(server.path.size() >= sizeof(addr.sun_path))
+    {
+        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "socket path is too long";
+    }
+    memcpy(addr.sun_path, server.path.data(), server.path.size());
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(sock < 0)
+    {
+        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "could not create socket; errno "<<errno;
+    }
+    if(::connect(sock, (struct sockaddr*) &addr, sizeof(addr)) != 0)
+    {
+        int const err = errno;
+        close(sock);
+        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "could not connect to "<<server.path<<"; errno "<<err;
+    }
+    //same batching as the enlarged pipes
+    int bufSize = PIPE_SIZE;
+    setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &bufSize, sizeof(bufSize));
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &bufSize, sizeof(bufSize));
+    //two descriptors for the one socket, so the rest of the class need not care
+    int outFd = fcntl(sock, F_DUPFD_CLOEXEC, 0);
+    if(outFd < 0)
+    {
+        close(sock);
+        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "could not duplicate socket; errno "<<errno;
+    }
+    _childInFd  = sock;
+    _childOutFd = outFd;
     _alive = true;
+    makeNonBlocking();
+}
+
+ChildProcess::~ChildProcess()
+{
+    terminate();
+    unmapShm(-1);
+}
+
+int ChildProcess::mapShm(size_t shmSize)
+{
+    size_t const pageSize = sysconf(_SC_PAGESIZE);
+    size_t const half = (shmSize / 2 + pageSize - 1) / pageSize * pageSize;   //page-aligned halves
+#ifdef MFD_CLOEXEC
+    int fd = memfd_create("scidb-stream", MFD_CLOEXEC);
+#else
+    int fd = -1;
+    errno = ENOSYS;
+#endif
+    if(fd < 0)
+    {
+        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "could not create shared memory; errno "<<errno;
+    }
+    void* shm = MAP_FAILED;
+    if(ftruncate(fd, 2 * half) == 0)
+    {
+        shm = mmap(NULL, 2 * half, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if(shm == MAP_FAILED)
+    {
+        close(fd);
+        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "could not map shared memory; errno "<<errno;
+    }
+    _shm     = (char*) shm;
+    _shmSize = 2 * half;
+    return fd;
+}
+
+void ChildProcess::unmapShm(int shmFd, bool unmap)
+{
+    if(shmFd >= 0)
+    {
+        close(shmFd);   //the child has its own copy; the mapping stays valid without it
+    }
+    if(unmap && _shm != NULL)
+    {
+        munmap(_shm, _shmSize);
+        _shm = NULL;
+    }
+}
+
+void ChildProcess::openPipes(int parent_child[2], int child_parent[2])
+{
+    if(pipe (parent_child) < 0)
+    {
+        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "pipe failed, bummer";
+    }
+    if(pipe (child_parent) < 0)
+    {
+        close (parent_child[0]);
+        close (parent_child[1]);
+        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "pipe failed, bummer";
+    }
+}
+
+void ChildProcess::closePipes(int parent_child[2], int child_parent[2])
+{
+    close (parent_child[0]);
+    close (parent_child[1]);
+    close (child_parent[0]);
+    close (child_parent[1]);
+}
+
+void ChildProcess::connect(int parent_child[2], int child_parent[2])
+{
+    close (parent_child[0]);
+    close (child_parent[1]);
+    _childInFd  = parent_child[1];
+    _childOutFd = child_parent[0];
+    _pidFd = openPidFd(_childPid);
+    //fewer, larger transfers per chunk; the system may cap the size (fs.pipe-max-size), which is fine
+    fcntl(_childInFd,  F_SETPIPE_SZ, PIPE_SIZE);
+    fcntl(_childOutFd, F_SETPIPE_SZ, PIPE_SIZE);
+    _alive = true;   //from here on, terminate() cleans up
+    makeNonBlocking();
+}
+
+void ChildProcess::makeNonBlocking()
+{
+    int flags = fcntl(_childOutFd, F_GETFL, 0);
+    if(fcntl(_childOutFd, F_SETFL, flags | O_NONBLOCK) < 0 )
+    {
+        terminate();
+        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "fcntl failed, bummer";
+    }
+    flags = fcntl(_childInFd, F_GETFL, 0);
+    if(fcntl(_childInFd, F_SETFL, flags | O_NONBLOCK) < 0 )
+    {
+        terminate();
+        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "fcntl failed, bummer";
+    }
+}
+
+bool ChildProcess::hasExited(int& status)
+{
+    if(_peer == SERVER)
+    {
+        //nothing to wait for: a server that goes away closes the connection, which the reads and writes notice
+        status = -1;
+        return false;
+    }
+    return hasExited(_childPid, _pidFd, _peer == OWN_CHILD, status);
+}
+
+bool ChildProcess::hasExited(pid_t pid, int pidFd, bool own, int& status)
+{
+    if(!own)
+    {
+        //not our child, so we can't wait for it: the pidfd tells us, or the pid is gone once the zygote reaps it
+        status = -1;
+        if(pidFd >= 0)
+        {
+            struct pollfd pollstat [1];
+            pollstat[0].fd = pidFd;
+            pollstat[0].events = POLLIN;
+            return poll(pollstat, 1, 0) > 0;
+        }
+        return kill(pid, 0) != 0 && errno == ESRCH;
+    }
+    return waitpid (pid, &status, WNOHANG) == pid;
+}
+
+int ChildProcess::openPidFd(pid_t pid)
+{
+#ifdef SYS_pidfd_open
+    return syscall(SYS_pidfd_open, pid, 0);  //readable once the process exits; -1 on kernels before 5.3
+#else
+    return -1;
+#endif
+}
+
+void ChildProcess::signalProcess(pid_t pid, int pidFd, int sig)
+{
+#ifdef SYS_pidfd_send_signal
+    if(pidFd >= 0 && syscall(SYS_pidfd_send_signal, pidFd, sig, NULL, 0) == 0)
+    {
+        return;   //the pidfd names this very process, even if the pid has been recycled
+    }
+#endif
+    kill (pid, sig);
+}
+
+bool ChildProcess::waitForExit(pid_t pid, int pidFd, bool own, int timeoutMillis)
+{
+    int status;
+    if(pidFd >= 0)
+    {
+        struct pollfd pollstat [1];
+        pollstat[0].fd = pidFd;
+        pollstat[0].events = POLLIN;
+        int ret;
+        do
+        {
+            ret = poll(pollstat, 1, timeoutMillis);  //woken the moment the process exits
+        } while(ret < 0 && errno == EINTR);
+        if(ret <= 0)
+        {
+            return false;
+        }
+        if(own)
+        {
+            waitpid (pid, &status, 0);   //a zombie by now, so this does not block
+        }
+        return true;
+    }
+    //no pidfd: check with a backoff from 0.1 ms, so a prompt exit is still seen promptly
+    std::chrono::steady_clock::time_point const deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMillis);
+    useconds_t sleepMicros = 100;
+    while(!hasExited(pid, pidFd, own, status))
+    {
+        if(timeoutMillis >= 0 && std::chrono::steady_clock::now() >= deadline)
+        {
+            return false;
+        }
+        usleep(sleepMicros);
+        sleepMicros = std::min<useconds_t>(sleepMicros * 2, 10000);
+    }
+    return true;
+}
+
+void ChildProcess::endProcess(pid_t pid, int pidFd, bool own, int killTimeoutMillis)
+{
+    if(waitForExit(pid, pidFd, own, 0))   //a child that answered its final message may well be gone already
+    {
+        return;
+    }
+    signalProcess(pid, pidFd, SIGTERM);
+    if(!waitForExit(pid, pidFd, own, killTimeoutMillis))
+    {
+        LOG4CXX_WARN(logger, "process "<<pid<<" did not exit in time, sending sigkill and waiting indefinitely");
+        signalProcess(pid, pidFd, SIGKILL);
+        waitForExit(pid, pidFd, own, -1);
+    }
 }
 
 void ChildProcess::terminate()
@@ -108,73 +506,333 @@ void ChildProcess::terminate()
         _alive = false;
         close (_childInFd);
         close (_childOutFd);
-        kill (_childPid, SIGTERM);
-        pid_t res = 0;
-        size_t retries = 0;
-        while( res == 0 && retries < 50) // allow up to ~0.5 seconds for child to stop
+        if(_peer != SERVER)
         {
-            usleep(10000);
-            res = waitpid (_childPid, NULL, WNOHANG);
-            ++retries;
+            endProcess(_childPid, _pidFd, _peer == OWN_CHILD, _killTimeoutMillis);
         }
-        if( res == 0 )
+        if(_pidFd >= 0)
         {
-            LOG4CXX_WARN(logger, "child did not exit in time, sending sigkill and waiting indefinitely");
-            kill (_childPid, SIGKILL);
-            waitpid (_childPid, NULL, 0);
+            close (_pidFd);
         }
+        _slot.reset();
         LOG4CXX_DEBUG(logger, "child terminated");
     }
 }
 
-void ChildProcess::readIntoBuf(bool throwIfChildDead)
+void ChildProcess::closeFds()
 {
-    _readBufIdx = 0;
-    _readBufEnd = 0;
-    LOG4CXX_TRACE(logger, "read into buf from child");
-    if(!isAlive())
+    close (_childInFd);
+    close (_childOutFd);
+    if(_pidFd >= 0)
     {
-        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "internal error: attempt to read froom dead child";
+        close (_pidFd);
+    }
+    _slot.reset();   //the process is gone
+}
+
+void ChildProcess::holdSlot(std::unique_ptr<ChildSlot> slot)
+{
+    _slot = std::move(slot);
+}
+
+void ChildProcess::setAffinity(cpu_set_t const& cpus)
+{
+    if(_peer != SERVER && sched_setaffinity(_childPid, sizeof(cpus), &cpus) != 0)
+    {
+        LOG4CXX_WARN(logger, "could not set the affinity of child "<<_childPid<<"; errno "<<errno);
+    }
+}
+
+void ChildProcess::limitMemory(size_t bytes)
+{
+    struct rlimit limit;
+    limit.rlim_cur = bytes;
+    limit.rlim_max = bytes;
+    if(_peer != SERVER && prlimit(_childPid, RLIMIT_AS, &limit, NULL) != 0)
+    {
+        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "could not limit the memory of the child; errno "<<errno;
+    }
+}
+
+bool ChildProcess::isIdle()
+{
+    if(!_alive || _interrupted || _readBufIdx != _readBufEnd || _shmMsgLeft != 0)
+    {
+        return false;   //an interrupted child may still be working on a message nobody will read
+    }
+    int status;
+    if(hasExited(status))
+    {
+        _alive = false;   //already reaped, so nothing to kill
+        closeFds();
+        return false;
     }
     struct pollfd pollstat [1];
     pollstat[0].fd = _childOutFd;
     pollstat[0].events = POLLIN;
-    int ret = 0;
-    while( ret == 0 )
+    return poll(pollstat, 1, 0) == 0; //anything readable (data or hangup) means the child is not waiting for us
+}
+
+void ChildProcess::childDied(bool writing, int status)
+{
+    _alive = false;   //already reaped, so nothing to kill
+    closeFds();
+    LOG4CXX_WARN(logger, "Child terminated while "<<(writing ? "writing" : "reading")<<"; status "<<status);
+    if(WIFEXITED(status))
+    {
+        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "child process terminated early (regular exit)";
+    }
+    throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "child process terminated early (error)";
+}
+
+size_t ChildProcess::readSome(char* dest, size_t maxBytes)
+{
+    errno = 0;
+    ssize_t nRead = read(_childOutFd, dest, maxBytes);
+    if(nRead < 0 && (errno == EAGAIN || errno == EINTR))
+    {
+        return 0;
+    }
+    if(nRead <= 0)
+    {
+        LOG4CXX_WARN(logger, "STREAM: child terminated early: read returned "<<nRead <<" errno "<<errno);
+        terminate();
+        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "error reading from child";
+    }
+    LOG4CXX_TRACE(logger, "Read "<<nRead<<" bytes from child");
+    return nRead;
+}
+
+void ChildProcess::bufferIncoming()
+{
+    if(_readBufEnd == _readBuf.size())
+    {
+        if(_readBufIdx > 0)
+        {
+            memmove(&_readBuf[0], &_readBuf[_readBufIdx], _readBufEnd - _readBufIdx);
+            _readBufEnd -= _readBufIdx;
+            _readBufIdx = 0;
+        }
+        else
+        {
+            _readBuf.resize(_readBuf.size() * 2);   //the child keeps talking while we are still writing
+        }
+    }
+    _readBufEnd += readSome(&_readBuf[_readBufEnd], _readBuf.size() - _readBufEnd);
+}
+
+int ChildProcess::pollChild(bool writing, bool throwIfChildDead)
+{
+    struct pollfd pollstat [3];
+    pollstat[0].fd = _childOutFd;
+    pollstat[0].events = POLLIN;
+    pollstat[1].fd = writing ? _childInFd : -1;
+    pollstat[1].events = POLLOUT;
+    pollstat[2].fd = throwIfChildDead ? _pidFd : -1;
+    pollstat[2].events = POLLIN;
+    while(true)
     {
         Query::validateQueryPtr(_query); //are we still OK to execute the query?
+        if(_interrupted)
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << (writing ? "write to child interrupted" : "read from child interrupted");
+        }
         int status;
-        if(throwIfChildDead && waitpid (_childPid, &status, WNOHANG) == _childPid) //that child still there?
+        if(throwIfChildDead && _pidFd < 0 && hasExited(status)) //no pidfd: that child still there?
         {
-            terminate();
-            LOG4CXX_WARN(logger, "Child terminated while reading; status "<<status);
-            if(WIFEXITED(status))
+            childDied(writing, status);
+        }
+        errno = 0;
+        int ret = poll(pollstat, 3, _pollTimeoutMillis); //chill out until the child talks to us, takes data, or exits
+        if (ret < 0)
+        {
+            if(errno == EINTR)
             {
-                throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "child process terminated early (regular exit)";
+                continue;
             }
-            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "child process terminated early (error)";
+            LOG4CXX_WARN(logger, "STREAM: poll failure errno "<<errno);
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "poll failed";
         }
-        errno = 0;
-        ret = poll(pollstat, 1, _pollTimeoutMillis); //chill out until the child gives us some data
+        if(ret == 0)
+        {
+            continue;
+        }
+        if(pollstat[0].revents == 0 && pollstat[2].revents != 0 && hasExited(status)) //exited, and nothing left to read
+        {
+            childDied(writing, status);
+        }
+        return (pollstat[0].revents != 0 ? CAN_READ : 0) | (pollstat[1].revents != 0 ? CAN_WRITE : 0);
     }
-    if (ret < 0)
+}
+
+void ChildProcess::readIntoBuf(bool throwIfChildDead)
+{
+    _readBufIdx = 0;
+    _readBufEnd = 0;
+    LOG4CXX_TRACE(logger, "read into buf from child");
+    if(!isAlive())
     {
-        LOG4CXX_WARN(logger, "STREAM: poll failure errno "<<errno);
-        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "poll failed";
+        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "internal error: attempt to read froom dead child";
     }
+    while(_readBufEnd == 0)
+    {
+        if(pollChild(false, throwIfChildDead) & CAN_READ)
+        {
+            bufferIncoming();
+        }
+    }
+}
+
+size_t ChildProcess::readDirect(char* outputBuf, size_t const maxBytes, bool throwIfChildDead)
+{
+    if(!isAlive())
+    {
+        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "internal error: attempt to read froom dead child";
+    }
+    size_t nRead = 0;
+    while(nRead == 0)
+    {
+        if(pollChild(false, throwIfChildDead) & CAN_READ)
+        {
+            nRead = readSome(outputBuf, maxBytes);
+        }
+    }
+    return nRead;
+}
+
+size_t ChildProcess::writeSome(char const* buf, size_t const bytes)
+{
     errno = 0;
-    ssize_t nRead = read(_childOutFd, &_readBuf[0], _readBuf.size());
-    if(nRead <= 0)
+    ssize_t writeRet;
+    if(_spliceWrites && bytes >= SPLICE_MIN_BYTES)
     {
-        LOG4CXX_WARN(logger, "STREAM: child terminated early: read returned "<<nRead <<" errno "<<errno);
+        //hand the pages themselves to the pipe; the caller leaves them alone until the child has responded
+        struct iovec iov;
+        iov.iov_base = const_cast<char*>(buf);
+        iov.iov_len  = bytes;
+        writeRet = vmsplice(_childInFd, &iov, 1, SPLICE_F_NONBLOCK);
+    }
+    else if(_peer == SERVER)
+    {
+        writeRet = send(_childInFd, buf, bytes, MSG_NOSIGNAL);  //a closed connection is an error, not a SIGPIPE
+    }
+    else
+    {
+        writeRet = write(_childInFd, buf, bytes);
+    }
+    if(writeRet < 0 && (errno == EAGAIN || errno == EINTR))
+    {
+        return 0;
+    }
+    if(writeRet <= 0)
+    {
+        LOG4CXX_WARN(logger, "STREAM: child terminated early: write returned "<<writeRet <<" errno "<<errno);
         terminate();
-        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "error reading from child";
+        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "error writing to child";
     }
-    LOG4CXX_TRACE(logger, "Read "<<nRead<<" bytes from child");
-    _readBufEnd = nRead;
+    return writeRet;
+}
+
+char* ChildProcess::lease(size_t bytes)
+{
+    if(_shm == NULL || bytes > _shmSize / 2)
+    {
+        return NULL;
+    }
+    return _shm;   //lockstep: the child is done with the previous request once it has responded
+}
+
+void ChildProcess::commit(size_t bytes)
+{
+    ShmRecord record = { 0, bytes, ++_shmSeq };
+    writePipe(&record, sizeof(record));
+}
+
+void ChildProcess::hardWrite(void const* head, size_t const headBytes, void const* buf, size_t const bytes)
+{
+    if(_shm == NULL)
+    {
+        writePipe(head, headBytes);
+        writePipe(buf, bytes);
+        return;
+    }
+    char* dst = lease(headBytes + bytes);
+    if(dst != NULL)
+    {
+        memcpy(dst, head, headBytes);
+        memcpy(dst + headBytes, buf, bytes);
+        commit(headBytes + bytes);
+        return;
+    }
+    ShmRecord record = { SHM_INLINE, headBytes + bytes, ++_shmSeq };
+    writePipe(&record, sizeof(record));
+    writePipe(head, headBytes);
+    writePipe(buf, bytes);
 }
 
 void ChildProcess::hardWrite(void const* buf, size_t const bytes)
+{
+    if(_shm == NULL)
+    {
+        writePipe(buf, bytes);
+        return;
+    }
+    char* dst = lease(bytes);
+    if(dst != NULL)
+    {
+        memcpy(dst, buf, bytes);
+        commit(bytes);
+        return;
+    }
+    ShmRecord record = { SHM_INLINE, bytes, ++_shmSeq };   //too large for the region: send it down the pipe
+    writePipe(&record, sizeof(record));
+    writePipe(buf, bytes);
+}
+
+size_t ChildProcess::shmRead(char* outputBuf, size_t const maxBytes, bool throwIfChildDead)
+{
+    while(_shmMsgLeft == 0)
+    {
+        ShmRecord record;
+        size_t got = 0;
+        while(got < sizeof(record))
+        {
+            got += pipeRead(((char*) &record) + got, sizeof(record) - got, throwIfChildDead);
+        }
+        if(record.seq != _shmSeq)
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "child response does not match the last request";
+        }
+        if(record.offset == SHM_INLINE)
+        {
+            _shmMsgInline = true;
+        }
+        else if(record.offset < _shmSize / 2 || record.offset > _shmSize || record.length > _shmSize - record.offset)
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "child response lies outside its shared memory region";
+        }
+        else
+        {
+            _shmMsgInline = false;
+            _shmMsgPtr = _shm + record.offset;
+        }
+        _shmMsgLeft = record.length;
+    }
+    size_t bytesToReturn = maxBytes < _shmMsgLeft ? maxBytes : _shmMsgLeft;
+    if(_shmMsgInline)
+    {
+        bytesToReturn = pipeRead(outputBuf, bytesToReturn, throwIfChildDead);
+    }
+    else
+    {
+        memcpy(outputBuf, _shmMsgPtr, bytesToReturn);
+        _shmMsgPtr += bytesToReturn;
+    }
+    _shmMsgLeft -= bytesToReturn;
+    return bytesToReturn;
+}
+
+void ChildProcess::writePipe(void const* buf, size_t const bytes)
 {
     if(!isAlive())
     {
@@ -184,42 +842,16 @@ void ChildProcess::hardWrite(void const* buf, size_t const bytes)
     size_t bytesWritten = 0;
     while(bytesWritten != bytes)
     {
-        struct pollfd pollstat [1];
-        pollstat[0].fd = _childInFd;
-        pollstat[0].events = POLLOUT;
-        int ret = 0;
-        while( ret == 0 )
-        {
-            Query::validateQueryPtr(_query); //are we still OK to execute the query?
-            int status;
-            if(waitpid (_childPid, &status, WNOHANG) == _childPid) //that child still there?
-            {
-                terminate();
-                LOG4CXX_WARN(logger, "Child terminated while writing; status "<<status);
-                if(WIFEXITED(status))
-                {
-                    throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "child process terminated early (regular exit)";
-                }
-                throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "child process terminated early (error)";
-            }
-            errno = 0;
-            ret = poll(pollstat, 1, _pollTimeoutMillis); //chill out until the child can accept some data
-        }
-        if (ret < 0)
+        int const ready = pollChild(true, true);
+        if(ready & CAN_READ)
         {
-            LOG4CXX_WARN(logger, "STREAM: poll failure errno "<<errno);
-            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "poll failed";
+            bufferIncoming(); //anything the child says meanwhile is kept for the next read
         }
-        errno = 0;
-        size_t writeRet = write(_childInFd, ((char const *)buf) + bytesWritten, bytes - bytesWritten);
-        if(writeRet <= 0)
+        if(ready & CAN_WRITE)
         {
-            LOG4CXX_WARN(logger, "STREAM: child terminated early: write returned "<<writeRet <<" errno "<<errno);
-            terminate();
-            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "error writing to child";
+            bytesWritten += writeSome(((char const *)buf) + bytesWritten, bytes - bytesWritten);
+            LOG4CXX_TRACE(logger, "Write iteration");
         }
-        bytesWritten += writeRet;
-        LOG4CXX_TRACE(logger, "Write iteration");
     }
     LOG4CXX_TRACE(logger, "Wrote "<<bytes<<" bytes to child");
 }
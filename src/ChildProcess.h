@@ -27,13 +27,28 @@
 #define CHILDPROCESS_H_
 
 #include <query/PhysicalOperator.h>
+#include <atomic>
+#include <sched.h>
+#include <memory>
 #include <unistd.h>
 
 namespace scidb { namespace stream
 {
 
+class Zygote;
+class ChildSlot;
+
+/**
+ * Where a long-running server that speaks the stream protocol listens, for use instead of starting a child.
+ */
+struct ServerAddress
+{
+    std::string path;   // of a Unix domain socket
+};
+
 /**
- * An abstraction over the child process forked by SciDB.
+ * An abstraction over the child process forked by SciDB. The child may also be a connection to a server that is
+ * shared by many queries and instances; the framing of the conversation is the same either way.
  */
 class ChildProcess
 {
@@ -42,16 +57,58 @@ public:
      * Fork a new process.
      * @param commandLine the bash command to execute
      * @param query the query context
+     * @param shmSize the size of the memory region shared with the child; 0 to send all data through the pipes
      * @param readBufSize the size of the buffer used for reading
      */
-    ChildProcess(std::string const& commandLine, std::shared_ptr<Query>& query, size_t const readBufSize = 1024*1024);
-    ~ChildProcess()
-    {
-        terminate();
-    }
+    ChildProcess(std::string const& commandLine, std::shared_ptr<Query>& query, size_t const shmSize = 0,
+                 size_t const readBufSize = 1024*1024);
 
     /**
-     * Tear down the connection and kill the child process. Idempotent.
+     * Fork a copy of a pre-initialized zygote process.
+     * @param zygote the fork server to ask for the child
+     * @param program what the copy should run, as understood by the zygote
+     * @param query the query context
+     * @param shmSize the size of the memory region shared with the child; 0 to send all data through the pipes
+     * @param readBufSize the size of the buffer used for reading
+     */
+    ChildProcess(Zygote& zygote, std::string const& program, std::shared_ptr<Query>& query, size_t const shmSize = 0,
+                 size_t const readBufSize = 1024*1024);
+
+    /**
+     * Connect to a server that answers each connection as a child would.
+     * @param server where the server listens
+     * @param query the query context
+     * @param readBufSize the size of the buffer used for reading
+     */
+    ChildProcess(ServerAddress const& server, std::shared_ptr<Query>& query, size_t const readBufSize = 1024*1024);
+
+    ~ChildProcess();
+
+    /**
+     * Start "/bin/bash -c commandLine" with the given descriptors as its stdin and stdout, and every other
+     * descriptor closed.
+     * @param shmFd a shared memory descriptor to pass on as descriptor 3, or -1
+     * @return the pid of the new process
+     */
+    static pid_t spawn(std::string const& commandLine, int stdinFd, int stdoutFd, int shmFd = -1);
+
+    /**
+     * @return a descriptor that becomes readable when the process exits, or -1 if the kernel has none (before 5.3)
+     */
+    static int openPidFd(pid_t pid);
+
+    /**
+     * End a process: one that has already exited is reaped right away, any other is sent SIGTERM, and then
+     * SIGKILL if it is still running after the kill timeout.
+     * @param pidFd the descriptor from openPidFd, or -1
+     * @param own true if the process is a child of this one, so it can be reaped
+     * @param killTimeoutMillis how long to wait after SIGTERM
+     */
+    static void endProcess(pid_t pid, int pidFd, bool own, int killTimeoutMillis);
+
+    /**
+     * Tear down the connection and end the child process: a child that has already exited is reaped right away,
+     * any other is sent SIGTERM, and then SIGKILL if it is still running after the kill timeout. Idempotent.
      */
     void terminate();
 
@@ -64,6 +121,84 @@ public:
         return _alive;
     }
 
+    /**
+     * Check, without blocking, whether the child is sitting between interactions: alive, with no unread output
+     * buffered and none waiting in the pipe. A child that fails this check has exited or broken the protocol.
+     * @return true if the child can start a new interaction
+     */
+    bool isIdle();
+
+    /**
+     * @return a number that identifies this object among all the children this instance has ever had; unlike its
+     *         address, it is never reused
+     */
+    uint64_t getId() const
+    {
+        return _id;
+    }
+
+    /**
+     * Hand the child over to another query. Used when a child is kept alive and reused across queries.
+     * @param query the new query context
+     */
+    void attach(std::shared_ptr<Query> const& query)
+    {
+        _query = query;
+        _interrupted = false;
+    }
+
+    /**
+     * Drop the reference to the current query, so an idle child does not keep it alive.
+     */
+    void detach()
+    {
+        _query.reset();
+    }
+
+    /**
+     * Write large buffers to the child with vmsplice, which passes the pages to the pipe instead of copying
+     * them. The caller must then leave a written buffer untouched until the child has read all of it, which the
+     * protocol guarantees once the child has responded - if the child reads its whole input before responding.
+     * @param splice true to splice, false to copy with write
+     */
+    void setSpliceWrites(bool splice)
+    {
+        _spliceWrites = splice;
+    }
+
+    /**
+     * @param millis how long terminate waits for the child to exit after SIGTERM before sending SIGKILL
+     */
+    void setKillTimeout(int millis)
+    {
+        _killTimeoutMillis = millis;
+    }
+
+    /**
+     * Keep a host-wide slot for as long as the process runs; it is given up as soon as the process is gone.
+     */
+    void holdSlot(std::unique_ptr<ChildSlot> slot);
+
+    /**
+     * Cap the address space of a process that was started without the cap, such as a zygote child.
+     * @param bytes the limit, as for ulimit -v
+     */
+    void limitMemory(size_t bytes);
+
+    /**
+     * Move a process that was started elsewhere, such as a zygote child, onto the given CPUs.
+     */
+    void setAffinity(cpu_set_t const& cpus);
+
+    /**
+     * Ask a read or write that is blocked on the child in another thread to give up. The pending call throws at
+     * its next poll timeout. Safe to call from any thread; the child is unusable afterwards.
+     */
+    void interrupt()
+    {
+        _interrupted = true;
+    }
+
     /**
      * Read up to maxBytes of data from child. The function returns only when there was *some* nonzero
      * amount of data read successfully. The amount of data read may be less than maxBytes if the child
@@ -77,15 +212,11 @@ public:
      */
     size_t softRead(void* outputBuf, size_t const maxBytes, bool throwIfChildDead = true)
     {
-        if(_readBufIdx == _readBufEnd)
+        if(_shm != NULL)
         {
-            readIntoBuf(throwIfChildDead);
+            return shmRead((char*) outputBuf, maxBytes, throwIfChildDead);
         }
-        size_t bytesToReturn = _readBufEnd - _readBufIdx;
-        bytesToReturn = maxBytes < bytesToReturn ? maxBytes : bytesToReturn;
-        memcpy(outputBuf, &_readBuf[_readBufIdx], bytesToReturn);
-        _readBufIdx += bytesToReturn;
-        return bytesToReturn;
+        return pipeRead(outputBuf, maxBytes, throwIfChildDead);
     }
 
     /**
@@ -107,16 +238,68 @@ public:
     }
 
     /**
-     * Write exactly [bytes] of data from buf to child. Returns only after successful write. The writes
+     * Write one complete message to the child. Returns only after successful write. The writes
      * are *NOT* buffered - so the caller should coalesce data into large chunks before writing.
+     * With shared memory, the message is copied into the region and only its location goes down the pipe.
      * @param inputBuf the data to write
      * @param bytes the amount of data to write
      * @throw if the query was cancelled while writing, or child has exited or there was a write error
      */
     void hardWrite(void const* inputBuf, size_t const bytes);
 
+    /**
+     * Write one complete message made of two parts, as hardWrite would write the two parts joined together.
+     * @param head the first part
+     * @param headBytes the size of the first part
+     * @param inputBuf the second part
+     * @param bytes the size of the second part
+     */
+    void hardWrite(void const* head, size_t const headBytes, void const* inputBuf, size_t const bytes);
+
+    /**
+     * Reserve room for the next message in the memory region shared with the child, so that the message can be
+     * encoded in place. The room may be reused as soon as the child has responded to the message.
+     * @param bytes the size of the message
+     * @return where to put the message, or NULL if there is no shared memory or the message does not fit
+     */
+    char* lease(size_t bytes);
+
+    /**
+     * Send the message placed in the room returned by lease to the child.
+     * @param bytes the size of the message, no more than what was leased
+     */
+    void commit(size_t bytes);
+
 private:
+    size_t pipeRead(void* outputBuf, size_t const maxBytes, bool throwIfChildDead)
+    {
+        if(_readBufIdx == _readBufEnd)
+        {
+            if(maxBytes >= DIRECT_READ_MIN_BYTES)
+            {
+                return readDirect((char*) outputBuf, maxBytes, throwIfChildDead);
+            }
+            readIntoBuf(throwIfChildDead);
+        }
+        size_t bytesToReturn = _readBufEnd - _readBufIdx;
+        bytesToReturn = maxBytes < bytesToReturn ? maxBytes : bytesToReturn;
+        memcpy(outputBuf, &_readBuf[_readBufIdx], bytesToReturn);
+        _readBufIdx += bytesToReturn;
+        return bytesToReturn;
+    }
+
+    static int const    PIPE_SIZE = 1024*1024;
+    static size_t const DIRECT_READ_MIN_BYTES = 64*1024;   //larger reads skip the read buffer
+    static size_t const SPLICE_MIN_BYTES = 64*1024;        //smaller writes are cheaper to copy
+    enum
+    {
+        CAN_READ  = 1,
+        CAN_WRITE = 2
+    };
+
+    uint64_t const _id;
     bool  _alive;
+    std::atomic<bool> _interrupted;
     int const _pollTimeoutMillis;
     std::shared_ptr<Query> _query;
     std::vector <char> _readBuf;
@@ -125,8 +308,77 @@ private:
     pid_t _childPid;
     int   _childInFd;
     int   _childOutFd;
+    int   _pidFd;
+    enum Peer
+    {
+        OWN_CHILD,      // started by us, so we reap it
+        ZYGOTE_CHILD,   // forked and reaped by a zygote
+        SERVER          // a connection; there is no process of ours at the other end
+    };
+    Peer  _peer;
+    bool  _spliceWrites;
+    int   _killTimeoutMillis;
+    std::unique_ptr<ChildSlot> _slot;   // null unless the host limits its children
 
+    /**
+     * What goes down the pipe for each message when there is shared memory. Requests are placed at the start of
+     * the region and responses at the start of its second half; a message that does not fit follows its record
+     * on the pipe, with offset SHM_INLINE. A response carries the sequence number of the request it answers.
+     */
+    struct ShmRecord
+    {
+        uint64_t offset;
+        uint64_t length;
+        uint64_t seq;
+    };
+    static uint64_t const SHM_INLINE = ~((uint64_t) 0);
+
+    char*       _shm;
+    size_t      _shmSize;
+    uint64_t    _shmSeq;        // sequence number of the last request
+    char const* _shmMsgPtr;     // unread part of the current response
+    uint64_t    _shmMsgLeft;    // bytes of the current response not read yet
+    bool        _shmMsgInline;  // whether the current response comes down the pipe
+
+    static void openPipes(int parent_child[2], int child_parent[2]);
+    static void closePipes(int parent_child[2], int child_parent[2]);
+    void connect(int parent_child[2], int child_parent[2]);
+    void makeNonBlocking();
+    void closeFds();
+    bool hasExited(int& status);
+    static bool hasExited(pid_t pid, int pidFd, bool own, int& status);
+    static bool waitForExit(pid_t pid, int pidFd, bool own, int timeoutMillis);
+    static void signalProcess(pid_t pid, int pidFd, int sig);
+    [[noreturn]] void childDied(bool writing, int status);
+
+    int mapShm(size_t shmSize);
+    void unmapShm(int shmFd, bool unmap = true);
+    size_t shmRead(char* outputBuf, size_t const maxBytes, bool throwIfChildDead);
+    void writePipe(void const* buf, size_t const bytes);
+    size_t readSome(char* dest, size_t maxBytes);
+    size_t writeSome(char const* buf, size_t bytes);
+
+    /**
+     * Append whatever the child has written to the read buffer, growing the buffer if it is full.
+     */
+    void bufferIncoming();
+
+    /**
+     * Wait for the child to write something, or, when writing, to have room in its input pipe. Callers buffer
+     * the output that arrives while writing, so a child that answers while it is still being fed never blocks
+     * on a full pipe.
+     * @param writing whether the caller has data to write
+     * @param throwIfChildDead throw if the child exits with nothing left to read
+     * @return a combination of CAN_READ and CAN_WRITE
+     */
+    int pollChild(bool writing, bool throwIfChildDead);
     void readIntoBuf(bool throwIfChildDead);
+
+    /**
+     * Read straight into the caller's buffer, bypassing the read buffer, which must be empty.
+     * @return the number of bytes read, always > 0
+     */
+    size_t readDirect(char* outputBuf, size_t const maxBytes, bool throwIfChildDead);
 };
 
 } } //namespace
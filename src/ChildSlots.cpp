@@ -0,0 +1,252 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* Copyright (C) 2008-2020 Paradigm4 Inc.
+* All Rights Reserved.
+*
+* stream is a plugin for SciDB, an Open Source Array DBMS maintained
+* by Paradigm4. See http://www.paradigm4.com/
+*
+* stream is free software: you can redistribute it and/or modify
+* it under the terms of the AFFERO GNU General Public License as published by
+* the Free Software Foundation.
+*
+* stream is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND,
+* INCLUDING ANY IMPLIED WARRANTY OF MERCHANTABILITY,
+* NON-INFRINGEMENT, OR FITNESS FOR A PARTICULAR PURPOSE. See
+* the AFFERO GNU General Public License for the complete license terms.
+*
+* You should have received a copy of the AFFERO GNU General Public License
+* along with stream.  If not, see <http://www.gnu.org/licenses/agpl-3.0.html>
+*
+* END_COPYRIGHT
+*/
+
+#include "ChildSlots.h"
+
+#include <chrono>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using std::shared_ptr;
+using std::string;
+using std::unique_ptr;
+
+namespace scidb { namespace stream
+{
+
+ChildSlot::~ChildSlot()
+{
+    close(_fd);   //drops the lock
+    _owner.released();
+}
+
+ChildSlots::ChildSlots():
+    _dir("/tmp/scidb_stream_slots." + std::to_string(getuid()))
+{}
+
+static int openFile(string const& path)
+{
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC | O_NOFOLLOW, 0600);   //never inherited by a child
+    if(fd < 0)
+    {
+        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "cannot open " << path << "; errno " << errno;
+    }
+    return fd;
+}
+
+string ChildSlots::ticketPath(uint64_t ticket) const
+{
+    return _dir + "/ticket." + std::to_string(ticket);
+}
+
+int ChildSlots::lockQueue()
+{
+    int fd = openFile(_dir + "/queue");
+    while(flock(fd, LOCK_EX) != 0)
+    {
+        if(errno != EINTR)
+        {
+            close(fd);
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "cannot lock the child slot queue; errno " << errno;
+        }
+    }
+    return fd;
+}
+
+uint64_t ChildSlots::enqueue(int& ticketFd)
+{
+    int queueFd = lockQueue();
+    try
+    {
+        char buf[32] = { 0 };
+        ssize_t const n = pread(queueFd, buf, sizeof(buf) - 1, 0);
+        uint64_t const ticket = n > 0 ? strtoull(buf, NULL, 10) : 0;
+        //locked before anyone can look at it, since the queue is locked too
+        ticketFd = openFile(ticketPath(ticket));
+        flock(ticketFd, LOCK_EX);
+        string const next = std::to_string(ticket + 1);
+        if(pwrite(queueFd, next.c_str(), next.size(), 0) != (ssize_t) next.size() || ftruncate(queueFd, next.size()) != 0)
+        {
+            int const err = errno;
+            unlink(ticketPath(ticket).c_str());
+            close(ticketFd);
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "cannot update the child slot queue; errno " << err;
+        }
+        close(queueFd);
+        return ticket;
+    }
+    catch(...)
+    {
+        close(queueFd);
+        throw;
+    }
+}
+
+void ChildSlots::dequeue(uint64_t ticket, int ticketFd)
+{
+    int queueFd = lockQueue();
+    unlink(ticketPath(ticket).c_str());
+    close(ticketFd);
+    close(queueFd);
+}
+
+bool ChildSlots::isFirst(uint64_t ticket)
+{
+    DIR* dir = opendir(_dir.c_str());
+    if(dir == NULL)
+    {
+        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "cannot list " << _dir << "; errno " << errno;
+    }
+    std::vector<uint64_t> older;
+    while(struct dirent* entry = readdir(dir))
+    {
+        char const* const prefix = "ticket.";
+        if(strncmp(entry->d_name, prefix, strlen(prefix)) == 0)
+        {
+            uint64_t const other = strtoull(entry->d_name + strlen(prefix), NULL, 10);
+            if(other < ticket)
+            {
+                older.push_back(other);
+            }
+        }
+    }
+    closedir(dir);
+    if(older.empty())
+    {
+        return true;
+    }
+    //the queue lock keeps a new ticket from being seen before its owner locks it
+    int queueFd = lockQueue();
+    bool first = true;
+    for(size_t i = 0; i < older.size(); ++i)
+    {
+        string const path = ticketPath(older[i]);
+        int fd = open(path.c_str(), O_RDWR | O_CLOEXEC | O_NOFOLLOW);
+        if(fd < 0)
+        {
+            continue;   //served in the meantime
+        }
+        if(flock(fd, LOCK_EX | LOCK_NB) == 0)
+        {
+            unlink(path.c_str());   //its owner died while waiting
+        }
+        else
+        {
+            first = false;
+        }
+        close(fd);
+    }
+    close(queueFd);
+    return first;
+}
+
+bool ChildSlots::tryLock(size_t maxChildren, size_t count, std::vector<int>& fds)
+{
+    for(size_t i = 0; i < maxChildren && fds.size() < count; ++i)
+    {
+        int fd = openFile(_dir + "/slot." + std::to_string(i));
+        if(flock(fd, LOCK_EX | LOCK_NB) == 0)
+        {
+            fds.push_back(fd);
+        }
+        else
+        {
+            close(fd);
+        }
+    }
+    if(fds.size() < count)
+    {
+        for(size_t i = 0; i < fds.size(); ++i)
+        {
+            close(fds[i]);   //all or nothing: holding some while waiting for the rest could deadlock instances
+        }
+        fds.clear();
+        return false;
+    }
+    return true;
+}
+
+std::vector<unique_ptr<ChildSlot> > ChildSlots::acquire(size_t maxChildren, size_t count, shared_ptr<Query> const& query,
+                                                        int64_t& waitedMillis)
+{
+    std::vector<unique_ptr<ChildSlot> > res;
+    if(count > maxChildren)
+    {
+        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "internal error: more children than max_children";
+    }
+    if(mkdir(_dir.c_str(), 0700) != 0 && errno != EEXIST)
+    {
+        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "cannot create " << _dir << "; errno " << errno;
+    }
+    std::chrono::steady_clock::time_point const start = std::chrono::steady_clock::now();
+    int ticketFd = -1;
+    uint64_t const ticket = enqueue(ticketFd);
+    std::unique_lock<std::mutex> lock(_mutex);
+    try
+    {
+        while(true)
+        {
+            Query::validateQueryPtr(query);
+            std::vector<int> fds;
+            if(isFirst(ticket) && tryLock(maxChildren, count, fds))
+            {
+                int const fd = ticketFd;
+                ticketFd = -1;
+                dequeue(ticket, fd);
+                _cv.notify_all();
+                for(size_t i = 0; i < fds.size(); ++i)
+                {
+                    res.push_back(unique_ptr<ChildSlot>(new ChildSlot(*this, fds[i])));
+                }
+                waitedMillis = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+                return res;
+            }
+            _cv.wait_for(lock, std::chrono::milliseconds(10));   //other instances free slots and leave the queue without a notify
+        }
+    }
+    catch(...)
+    {
+        if(ticketFd >= 0)
+        {
+            dequeue(ticket, ticketFd);
+            _cv.notify_all();
+        }
+        throw;
+    }
+}
+
+void ChildSlots::released()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _cv.notify_all();
+}
+
+} } //namespace
@@ -0,0 +1,139 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* Copyright (C) 2008-2020 Paradigm4 Inc.
+* All Rights Reserved.
+*
+* stream is a plugin for SciDB, an Open Source Array DBMS maintained
+* by Paradigm4. See http://www.paradigm4.com/
+*
+* stream is free software: you can redistribute it and/or modify
+* it under the terms of the AFFERO GNU General Public License as published by
+* the Free Software Foundation.
+*
+* stream is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND,
+* INCLUDING ANY IMPLIED WARRANTY OF MERCHANTABILITY,
+* NON-INFRINGEMENT, OR FITNESS FOR A PARTICULAR PURPOSE. See
+* the AFFERO GNU General Public License for the complete license terms.
+*
+* You should have received a copy of the AFFERO GNU General Public License
+* along with stream.  If not, see <http://www.gnu.org/licenses/agpl-3.0.html>
+*
+* END_COPYRIGHT
+*/
+
+#ifndef SRC_CHILDSLOTS_H_
+#define SRC_CHILDSLOTS_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <query/Query.h>
+
+namespace scidb { namespace stream
+{
+
+class ChildSlots;
+
+/**
+ * The right to run one child, held for as long as the child lives. Giving it up lets a waiting query start its
+ * child.
+ */
+class ChildSlot
+{
+public:
+    ~ChildSlot();
+
+private:
+    friend class ChildSlots;
+
+    ChildSlots& _owner;
+    int         _fd;      // open and locked slot file
+
+    ChildSlot(ChildSlots& owner, int fd):
+        _owner(owner),
+        _fd(fd)
+    {}
+};
+
+/**
+ * A limit on the number of children running at once on the whole host, shared by all the instances on it. Slot k
+ * is a file in a per-user directory under /tmp, and whoever holds an exclusive flock on it owns the slot. The kernel
+ * drops the lock when its holder closes the file or dies, so an instance that crashes never leaks slots. A query
+ * asking for at most N children takes its slots among 0..N-1, so queries with different limits still share them.
+ * The slots for all the children of a query are taken together or not at all, so queries on different instances
+ * never hold part of what they need while waiting for the rest. Waiting queries are served in arrival order across
+ * the host: each takes a ticket from a counter file in the same directory and holds a lock on a file named after
+ * it while it waits, and only the oldest live ticket may take slots. A waiter that dies drops its lock, and the
+ * next waiter to look removes its ticket, so it does not hold up the queue.
+ */
+class ChildSlots
+{
+public:
+    /**
+     * @return the slots as seen from this instance
+     */
+    static ChildSlots& getInstance();
+
+    ChildSlots();
+
+    /**
+     * Take count of the first maxChildren slots, waiting behind earlier requests on the host until that many are
+     * free at once.
+     * @param maxChildren the host-wide limit the query asked for; at least count
+     * @param count the number of slots needed
+     * @param query the query context; checked for cancellation while waiting
+     * @param[out] waitedMillis how long the call waited
+     * @return the slots, each to be held for the lifetime of one child
+     */
+    std::vector<std::unique_ptr<ChildSlot> > acquire(size_t maxChildren, size_t count, std::shared_ptr<Query> const& query,
+                                                     int64_t& waitedMillis);
+
+private:
+    friend class ChildSlot;
+
+    std::string             _dir;
+    std::mutex              _mutex;
+    std::condition_variable _cv;         // notified when this instance gives up a slot or leaves the queue
+
+    /**
+     * Lock count of the first maxChildren slot files, or none.
+     * @param[out] fds the descriptors holding the locks
+     * @return true if count slots were free
+     */
+    bool tryLock(size_t maxChildren, size_t count, std::vector<int>& fds);
+
+    /**
+     * @return the descriptor of the ticket counter file, locked exclusively; close it to unlock
+     */
+    int lockQueue();
+
+    /**
+     * Take the next ticket and lock its file.
+     * @param[out] ticketFd the descriptor holding the lock on the ticket file
+     * @return the ticket
+     */
+    uint64_t enqueue(int& ticketFd);
+
+    /**
+     * Remove a ticket from the queue.
+     */
+    void dequeue(uint64_t ticket, int ticketFd);
+
+    /**
+     * @return true if no live ticket is older than ticket; the files of dead older tickets are removed
+     */
+    bool isFirst(uint64_t ticket);
+
+    std::string ticketPath(uint64_t ticket) const;
+
+    void released();
+};
+
+} } //namespace
+
+#endif /* SRC_CHILDSLOTS_H_ */
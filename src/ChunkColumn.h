@@ -0,0 +1,585 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* Copyright (C) 2008-2020 Paradigm4 Inc.
+* All Rights Reserved.
+*
+* stream is a plugin for SciDB, an Open Source Array DBMS maintained
+* by Paradigm4. See http://www.paradigm4.com/
+*
+* stream is free software: you can redistribute it and/or modify
+* it under the terms of the AFFERO GNU General Public License as published by
+* the Free Software Foundation.
+*
+* stream is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND,
+* INCLUDING ANY IMPLIED WARRANTY OF MERCHANTABILITY,
+* NON-INFRINGEMENT, OR FITNESS FOR A PARTICULAR PURPOSE. See
+* the AFFERO GNU General Public License for the complete license terms.
+*
+* You should have received a copy of the AFFERO GNU General Public License
+* along with stream.  If not, see <http://www.gnu.org/licenses/agpl-3.0.html>
+*
+* END_COPYRIGHT
+*/
+
+
+#ifndef SRC_CHUNKCOLUMN_H_
+#define SRC_CHUNKCOLUMN_H_
+
+#include <array/RLE.h>
+#include <query/PhysicalOperator.h>
+#include <query/TypeSystem.h>
+#include <string.h>
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace scidb { namespace stream
+{
+
+/**
+ * One attribute of an input chunk laid out as a column, the way Arrow and the native format want it: fixed-width
+ * values back to back, or for strings and binaries all the bytes back to back with length+1 offsets into them,
+ * plus a validity bitmap with bit j (least significant first) set if row j is not null. The codecs encode from
+ * here, so the chunk is walked once per attribute in one tight loop per type, and a non-nullable attribute skips
+ * the null checks altogether. Where the chunk allows it - materialized, without overlaps, and holding exactly the
+ * cells the iterator would visit - the values are copied a run at a time straight from its RLE payload, with no
+ * per-cell iterator calls at all. A chunk can also be laid out a slice of rows at a time with begin and next, which
+ * bounds the memory held to the slice. The buffers only ever grow, so a ChunkColumn is meant to be reused.
+ * @tparam OFFSET the type of the string offsets: int32_t for Arrow, int64_t for the native format
+ */
+template <typename OFFSET = int64_t>
+class ChunkColumn
+{
+private:
+    std::vector<char>    _values;
+    std::vector<OFFSET>  _offsets;
+    std::vector<uint8_t> _validity;
+    std::vector<uint8_t> _bits;
+    size_t               _width;       // 0 for strings and binaries
+    size_t               _dataSize;    // bytes of string and binary data
+    int64_t              _length;
+    int64_t              _nullCount;
+    Value                _converted;
+    std::shared_ptr<ConstChunkIterator> _citer;
+    TypeEnum             _type;
+    FunctionPointer      _converter;
+    bool                 _nullable;
+    int64_t              _remaining;   // rows of the chunk not laid out yet
+    size_t               _bytesPerRow; // of the chunk payload, to size the string data of a slice
+    ConstChunk const*    _runs;        // the chunk whose payload runs are copied, or NULL to use the iterator
+    size_t               _segIdx;      // the payload run the next slice starts in
+    int64_t              _segDone;     // rows of that run already laid out
+
+public:
+    ChunkColumn():
+        _width(0),
+        _dataSize(0),
+        _length(0),
+        _nullCount(0),
+        _type(TE_INVALID),
+        _converter(NULL),
+        _nullable(false),
+        _remaining(0),
+        _bytesPerRow(0),
+        _runs(NULL),
+        _segIdx(0),
+        _segDone(0)
+    {}
+
+    /**
+     * @return the size of one value of a fixed-width type, or 0 for strings, binaries and types without a fixed
+     *         C representation
+     */
+    static size_t width(TypeEnum type)
+    {
+        switch(type)
+        {
+        case TE_BOOL:
+        case TE_CHAR:
+        case TE_INT8:
+        case TE_UINT8:    return 1;
+        case TE_INT16:
+        case TE_UINT16:   return 2;
+        case TE_INT32:
+        case TE_UINT32:
+        case TE_FLOAT:    return 4;
+        case TE_INT64:
+        case TE_UINT64:
+        case TE_DOUBLE:
+        case TE_DATETIME: return 8;
+        default:          return 0;
+        }
+    }
+
+    /**
+     * @param chunks a set of input chunks, one per attribute
+     * @param window about how many bytes a slice of all of them may take
+     * @return how many rows to lay out per call to next so that the slices stay within the window, at least 1
+     */
+    static int64_t sliceRows(std::vector<ConstChunk const*> const& chunks, size_t window)
+    {
+        int64_t const numRows = chunks[0]->count();
+        size_t bytes = 0;
+        for(ConstChunk const* chunk : chunks)
+        {
+            bytes += chunk->getSize();
+        }
+        if(bytes <= window)
+        {
+            return numRows;
+        }
+        return std::max<int64_t>(1, (int64_t) (numRows * (double) window / bytes));
+    }
+
+    /**
+     * Lay out one attribute of a chunk.
+     * @param chunk the chunk to read
+     * @param type the type of the attribute; fixed-width types are laid out as values, TE_STRING as strings
+     *             without the terminating 0, and anything else as binary
+     * @param converter if not NULL, a conversion to string applied to every value, which makes this a string
+     *                  column; for types the codec has no better representation of
+     * @param nullable false if the attribute cannot hold nulls, which skips the null checks
+     * @param numRows the number of cells in the chunk
+     * @throw if the chunk does not have numRows cells
+     */
+    void extract(ConstChunk const& chunk, TypeEnum type, FunctionPointer converter, bool nullable, int64_t numRows)
+    {
+        begin(chunk, type, converter, nullable, numRows);
+        next(numRows);
+    }
+
+    /**
+     * Start laying out one attribute of a chunk in slices; the parameters are as for extract. Nothing is laid out
+     * until the first call to next.
+     */
+    void begin(ConstChunk const& chunk, TypeEnum type, FunctionPointer converter, bool nullable, int64_t numRows)
+    {
+        _type        = type;
+        _converter   = converter;
+        _nullable    = nullable;
+        _remaining   = numRows;
+        _bytesPerRow = numRows > 0 ? chunk.getSize() / numRows + 1 : 0;
+        _width       = converter == NULL ? width(type) : 0;
+        _segIdx      = 0;
+        _segDone     = 0;
+        _runs        = canCopyRuns(chunk, numRows) ? &chunk : NULL;
+        _citer.reset();
+        if(_runs == NULL)
+        {
+            _citer = chunk.getConstIterator(ConstChunkIterator::IGNORE_OVERLAPS);
+        }
+    }
+
+    /**
+     * Lay out the next rows of the chunk given to begin, in place of the previous slice: row 0 of the column is
+     * then the first row that was not laid out yet.
+     * @param maxRows the most rows to lay out
+     * @return the number of rows laid out; 0 once the whole chunk has been
+     * @throw if the chunk has fewer cells than begin was told
+     */
+    int64_t next(int64_t maxRows)
+    {
+        int64_t const numRows = std::min(maxRows, _remaining);
+        _dataSize  = 0;
+        _length    = numRows;
+        _nullCount = 0;
+        if(_nullable)
+        {
+            _validity.assign((numRows + 7) / 8, 0);
+        }
+        if(_width == 0)
+        {
+            _offsets.resize(numRows + 1);
+            _offsets[0] = 0;
+            if(_converter == NULL && _values.size() < numRows * _bytesPerRow)
+            {
+                _values.resize(numRows * _bytesPerRow);   // the size of the payload is a fair first guess
+            }
+        }
+        else if(_values.size() < numRows * _width)
+        {
+            _values.resize(numRows * _width);
+        }
+        if(numRows == 0)
+        {
+            _citer.reset();
+            _runs = NULL;
+            return 0;
+        }
+        int64_t rows;
+        if(_runs != NULL)
+        {
+            rows = copyRuns();
+        }
+        else if(_converter != NULL)
+        {
+            rows = _nullable ? extractConverted<true>(*_citer, _converter) : extractConverted<false>(*_citer, _converter);
+        }
+        else if(_width == 0)
+        {
+            bool const string = _type == TE_STRING;
+            rows = _nullable ? extractVarying<true>(*_citer, string) : extractVarying<false>(*_citer, string);
+        }
+        else
+        {
+            ConstChunkIterator& citer = *_citer;
+            switch(_width)
+            {
+            case 1: rows = _nullable ? extractFixed<1, true>(citer) : extractFixed<1, false>(citer); break;
+            case 2: rows = _nullable ? extractFixed<2, true>(citer) : extractFixed<2, false>(citer); break;
+            case 4: rows = _nullable ? extractFixed<4, true>(citer) : extractFixed<4, false>(citer); break;
+            case 8: rows = _nullable ? extractFixed<8, true>(citer) : extractFixed<8, false>(citer); break;
+            default:
+                throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "internal error: unsupported type";
+            }
+        }
+        if(rows != numRows)
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "inconsistent input chunks given";
+        }
+        _remaining -= numRows;
+        if(_remaining == 0)
+        {
+            _citer.reset();
+            _runs = NULL;
+        }
+        return numRows;
+    }
+
+    int64_t length() const
+    {
+        return _length;
+    }
+
+    int64_t nullCount() const
+    {
+        return _nullCount;
+    }
+
+    /**
+     * @return the values, or for strings and binaries the bytes of all the values back to back
+     */
+    char const* values() const
+    {
+        return _values.data();
+    }
+
+    /**
+     * @return the size of the values in bytes
+     */
+    size_t valuesSize() const
+    {
+        return _width == 0 ? _dataSize : _length * _width;
+    }
+
+    /**
+     * @return length+1 offsets into values for strings and binaries; NULL for fixed-width values
+     */
+    OFFSET const* offsets() const
+    {
+        return _width == 0 ? _offsets.data() : NULL;
+    }
+
+    /**
+     * @return the validity bitmap, or NULL if there are no nulls. Null rows of fixed-width columns hold zeros.
+     */
+    uint8_t const* validity() const
+    {
+        return _nullCount != 0 ? _validity.data() : NULL;
+    }
+
+    /**
+     * @return the bytes held by the buffers, which stay allocated for the next extract
+     */
+    size_t capacity() const
+    {
+        return _values.capacity() + _offsets.capacity() * sizeof(OFFSET) + _validity.capacity() + _bits.capacity();
+    }
+
+    /**
+     * Pack the values of a bool column one bit per row, least significant first, the way Arrow stores them.
+     * @return (length+7)/8 bytes, valid until the next extract
+     */
+    uint8_t const* packBits()
+    {
+        _bits.assign((_length + 7) / 8, 0);
+        for(int64_t j = 0; j < _length; ++j)
+        {
+            if(_values[j] != 0)
+            {
+                _bits[j / 8] |= (uint8_t) (1 << (j % 8));
+            }
+        }
+        return _bits.data();
+    }
+
+    /**
+     * @return true if row j is null
+     */
+    bool isNull(int64_t j) const
+    {
+        return _nullCount != 0 && (_validity[j / 8] & (1 << (j % 8))) == 0;
+    }
+
+private:
+    /**
+     * @return true if the values can be copied from the payload of the chunk rather than read through an
+     *         iterator: the chunk is materialized and has no overlaps, so its payload holds the cells the iterator
+     *         would visit in the same order, one per row; the values are stored the way the column lays them
+     *         out; and there are no nulls unless the attribute is nullable
+     */
+    bool canCopyRuns(ConstChunk const& chunk, int64_t numRows) const
+    {
+        if(_converter != NULL || _type == TE_BOOL || numRows == 0 || !chunk.isMaterialized())
+        {
+            return false;   // bools are packed one bit per value in the payload
+        }
+        for(DimensionDesc const& dim : chunk.getArrayDesc().getDimensions())
+        {
+            if(dim.getChunkOverlap() != 0)
+            {
+                return false;
+            }
+        }
+        bool const pinned = chunk.pin();
+        ConstRLEPayload const payload(static_cast<char const*>(chunk.getConstData()));
+        bool res = payload.count() == numRows && payload.elementSize() == _width && !payload.isBool();
+        for(size_t i = 0; res && !_nullable && i < payload.nSegments(); ++i)
+        {
+            res = !payload.getSegment(i)._null;
+        }
+        if(pinned)
+        {
+            chunk.unPin();
+        }
+        return res;
+    }
+
+    /**
+     * Lay out the next _length rows from the payload runs, resuming where the previous slice stopped.
+     * @return the number of rows laid out
+     */
+    int64_t copyRuns()
+    {
+        ConstChunk const& chunk = *_runs;
+        bool const pinned = chunk.pin();
+        int64_t rows = 0;
+        try
+        {
+            ConstRLEPayload const payload(static_cast<char const*>(chunk.getConstData()));
+            switch(_width)
+            {
+            case 0:  rows = copyVaryingRuns(payload, _type == TE_STRING); break;
+            case 1:  rows = copyFixedRuns<1>(payload); break;
+            case 2:  rows = copyFixedRuns<2>(payload); break;
+            case 4:  rows = copyFixedRuns<4>(payload); break;
+            case 8:  rows = copyFixedRuns<8>(payload); break;
+            default:
+                throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "internal error: unsupported type";
+            }
+        }
+        catch(...)
+        {
+            if(pinned)
+            {
+                chunk.unPin();
+            }
+            throw;
+        }
+        if(pinned)
+        {
+            chunk.unPin();
+        }
+        return rows;
+    }
+
+    /**
+     * Walk the payload runs for the next _length rows. A run of n null rows starting at row j is passed to
+     * nullRun(j, n) and counted; any other run to valueRun(j, n, index, same), where index is the payload index of
+     * the value of row j and same is true if every row of the run has that value rather than the ones following
+     * it. The rows of the latter are marked valid.
+     */
+    template <class VALUE_RUN, class NULL_RUN>
+    int64_t walkRuns(ConstRLEPayload const& payload, VALUE_RUN valueRun, NULL_RUN nullRun)
+    {
+        int64_t j = 0;
+        while(j < _length && _segIdx < payload.nSegments())
+        {
+            position_t segLength = 0;
+            ConstRLEPayload::Segment const& seg = payload.getSegment(_segIdx, segLength);
+            int64_t const n = std::min<int64_t>(segLength - _segDone, _length - j);
+            if(seg._null)
+            {
+                nullRun(j, n);
+                _nullCount += n;
+            }
+            else
+            {
+                bool const same = seg._same;
+                valueRun(j, n, seg._valueIndex + (same ? 0 : _segDone), same);
+                for(int64_t k = j; _nullable && k < j + n; ++k)
+                {
+                    _validity[k / 8] |= (uint8_t) (1 << (k % 8));
+                }
+            }
+            j += n;
+            _segDone += n;
+            if(_segDone == segLength)
+            {
+                ++_segIdx;
+                _segDone = 0;
+            }
+        }
+        return j;
+    }
+
+    template <size_t WIDTH>
+    int64_t copyFixedRuns(ConstRLEPayload const& payload)
+    {
+        char* dst = _values.data();
+        return walkRuns(payload, [&payload, dst] (int64_t j, int64_t n, size_t index, bool same)
+        {
+            if(same)
+            {
+                char const* v = payload.getRawValue(index);
+                for(int64_t k = j; k < j + n; ++k)
+                {
+                    memcpy(dst + k * WIDTH, v, WIDTH);
+                }
+            }
+            else
+            {
+                memcpy(dst + j * WIDTH, payload.getRawValue(index), n * WIDTH);   // a run's values are contiguous
+            }
+        },
+        [dst] (int64_t j, int64_t n)
+        {
+            memset(dst + j * WIDTH, 0, n * WIDTH);
+        });
+    }
+
+    int64_t copyVaryingRuns(ConstRLEPayload const& payload, bool string)
+    {
+        return walkRuns(payload, [this, &payload, string] (int64_t j, int64_t n, size_t index, bool same)
+        {
+            for(int64_t k = 0; k < n; ++k)
+            {
+                size_t size = 0;
+                char const* v = payload.getRawVarValue(index + (same ? 0 : k), size);
+                if(string && size > 0)
+                {
+                    --size;   //strings come with a terminating 0
+                }
+                append(v, size);
+                _offsets[j + k + 1] = (OFFSET) _dataSize;
+            }
+        },
+        [this] (int64_t j, int64_t n)
+        {
+            for(int64_t k = 0; k < n; ++k)
+            {
+                _offsets[j + k + 1] = (OFFSET) _dataSize;
+            }
+        });
+    }
+
+    template <size_t WIDTH, bool NULLABLE>
+    int64_t extractFixed(ConstChunkIterator& citer)
+    {
+        char* dst = _values.data();
+        int64_t j = 0;
+        for(; !citer.end() && j < _length; ++j, ++citer)
+        {
+            Value const& v = citer.getItem();
+            if(NULLABLE && v.isNull())
+            {
+                memset(dst + j * WIDTH, 0, WIDTH);
+                ++_nullCount;
+                continue;
+            }
+            if(NULLABLE)
+            {
+                _validity[j / 8] |= (uint8_t) (1 << (j % 8));
+            }
+            memcpy(dst + j * WIDTH, v.data(), WIDTH);
+        }
+        return j;
+    }
+
+    template <bool NULLABLE>
+    int64_t extractVarying(ConstChunkIterator& citer, bool string)
+    {
+        int64_t j = 0;
+        for(; !citer.end() && j < _length; ++j, ++citer)
+        {
+            Value const& v = citer.getItem();
+            if(NULLABLE && v.isNull())
+            {
+                ++_nullCount;
+            }
+            else
+            {
+                if(NULLABLE)
+                {
+                    _validity[j / 8] |= (uint8_t) (1 << (j % 8));
+                }
+                size_t size = v.size();
+                if(string && size > 0)
+                {
+                    --size;   //strings come with a terminating 0
+                }
+                append(static_cast<char const*>(v.data()), size);
+            }
+            _offsets[j + 1] = (OFFSET) _dataSize;
+        }
+        return j;
+    }
+
+    template <bool NULLABLE>
+    int64_t extractConverted(ConstChunkIterator& citer, FunctionPointer converter)
+    {
+        int64_t j = 0;
+        for(; !citer.end() && j < _length; ++j, ++citer)
+        {
+            Value const& v = citer.getItem();
+            if(NULLABLE && v.isNull())
+            {
+                ++_nullCount;
+            }
+            else
+            {
+                if(NULLABLE)
+                {
+                    _validity[j / 8] |= (uint8_t) (1 << (j % 8));
+                }
+                Value const* vv = &v;
+                (*converter)(&vv, &_converted, NULL);
+                char const* s = _converted.getString();
+                append(s, strlen(s));
+            }
+            _offsets[j + 1] = (OFFSET) _dataSize;
+        }
+        return j;
+    }
+
+    void append(char const* data, size_t size)
+    {
+        if(_dataSize + size > (size_t) std::numeric_limits<OFFSET>::max())
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "received chunk with strings exceeding the column size limit";
+        }
+        if(_dataSize + size > _values.size())
+        {
+            _values.resize(std::max(_dataSize + size, _values.size() * 2));
+        }
+        memcpy(_values.data() + _dataSize, data, size);
+        _dataSize += size;
+    }
+};
+
+} }
+
+#endif /* SRC_CHUNKCOLUMN_H_ */
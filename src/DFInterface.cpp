@@ -62,6 +62,13 @@ ArrayDesc DFInterface::getOutputSchema(std::vector<ArrayDesc> const& inputSchema
     {
         throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "received inconsistent names and types";
     }
+    for(size_t i = 0; i<outputTypes.size(); ++i)
+    {
+        if(outputTypes[i] != TE_INT32 && outputTypes[i] != TE_DOUBLE && outputTypes[i] != TE_STRING)
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "DF interface only returns double, int32 and string types";
+        }
+    }
     for(size_t i = 0; i<inputSchemas.size(); ++i)
     {
         ArrayDesc const& schema = inputSchemas[i];
@@ -97,11 +104,12 @@ DFInterface::DFInterface(Settings const& settings, ArrayDesc const& outputSchema
     _result(new MemArray(outputSchema, query)),
     _outPos{ ((Coordinate) query->getInstanceID()), 0, 0 },
     _outputChunkSize(settings.getChunkSize()),
+    _responseWindow(settings.getResponseWindow()),
+    _requestWindow(settings.getRequestWindow()),
+    _streamRequests(settings.getTransport() == PIPE),
     _nOutputAttrs( (int32_t) outputSchema.getAttributes(true).size()),
     _oaiters(_nOutputAttrs+1),
-    _outputTypes(_nOutputAttrs),
-    _readBuf(1024*1024),
-    _writeBuf(1024*1024)
+    _outputTypes(_nOutputAttrs)
 {
 //    for(int32_t i =0; i<_nOutputAttrs; ++i)
     int32_t i =0;
@@ -124,17 +132,55 @@ void DFInterface::setInputSchema(ArrayDesc const& inputSchema)
     size_t const nInputAttrs = attrs.size();
     _inputTypes.resize(nInputAttrs);
     _inputNames.resize(nInputAttrs);
+    _inputNullable.resize(nInputAttrs);
 //    for(size_t i =0; i<nInputAttrs; ++i)
     size_t i =0;
     for (const auto& attr : attrs)
     {
         _inputTypes[i]= typeId2TypeEnum(attr.getType());
         _inputNames[i]= attr.getName();
+        _inputNullable[i] = attr.isNullable();
         i++;
     }
 }
 
 void DFInterface::streamData(std::vector<ConstChunk const*> const& inputChunks, ChildProcess& child)
+{
+    if(!encodeData(inputChunks, _writeMsg, _streamRequests ? &child : NULL))
+    {
+        return;
+    }
+    if(!_streamRequests)
+    {
+        if(!child.isAlive())
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "child exited early";
+        }
+        writeRequest(child, _writeMsg);
+    }
+    streamResponse(child, false);
+}
+
+shared_ptr<Array> DFInterface::finalize(ChildProcess& child)
+{
+    encodeFinal(_writeMsg);
+    writeRequest(child, _writeMsg);
+    streamResponse(child, true);
+    return getResult();
+}
+
+shared_ptr<Array> DFInterface::getResult()
+{
+    _oaiters.clear();
+    return _result;
+}
+
+bool DFInterface::encodeData(std::vector<ConstChunk const*> const& inputChunks, Message& message)
+{
+    return encodeData(inputChunks, message, NULL);
+}
+
+bool DFInterface::encodeData(std::vector<ConstChunk const*> const& inputChunks, Message& message, ChildProcess* child)
 {
     if(inputChunks.size() != _inputTypes.size())
     {
@@ -143,26 +189,14 @@ void DFInterface::streamData(std::vector<ConstChunk const*> const& inputChunks,
     size_t nRows = inputChunks[0]->count();
     if(nRows == 0)
     {
-        return;
+        return false;
     }
     if(nRows > (size_t) std::numeric_limits<int32_t>::max())
     {
         throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "received chunk with count exceeding the R vector limit";
     }
-    if(!child.isAlive())
-    {
-        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "child exited early";
-    }
-    writeDF(inputChunks, nRows, child);
-    readDF(child);
-}
-
-shared_ptr<Array> DFInterface::finalize(ChildProcess& child)
-{
-    writeFinalDF(child);
-    readDF(child, true);
-    _oaiters.clear();
-    return _result;
+    writeDF(inputChunks, nRows, message, child);
+    return true;
 }
 
 static const unsigned char R_HEADER[14]    = { 0x42, 0x0a, 0x02, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x00, 0x00, 0x03, 0x02, 0x00 };
@@ -176,251 +210,407 @@ static const unsigned char R_LISTSXP[4]    = { 0x02, 0x04, 0x00, 0x00 };    // i
 static const unsigned char R_TAIL_HDR[21]  = { 0x02, 0x04, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x09, 0x00, 0x04, 0x00, 0x05, 0x00, 0x00, 0x00, 0x6e, 0x61, 0x6d, 0x65, 0x73 };
 static const unsigned char R_TAIL[4]       = { 0xfe, 0x00, 0x00, 0x00 };
 
-void DFInterface::writeDF(vector<ConstChunk const*> const& chunks, int32_t const numRows, ChildProcess& child)
+void DFInterface::writeDF(vector<ConstChunk const*> const& chunks, int32_t const numRows, Message& message, ChildProcess* child)
 {
-    child.hardWrite(R_HEADER, sizeof(R_HEADER));
-    child.hardWrite(R_VECSXP, sizeof(R_VECSXP));
+    if(child != NULL && !child->isAlive())
+    {
+        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "child exited early";
+    }
+    message.reset();
+    message.pushData(R_HEADER, sizeof(R_HEADER));
+    message.pushData(R_VECSXP, sizeof(R_VECSXP));
     int32_t numColumns = chunks.size();
-    child.hardWrite(&numColumns, sizeof(int32_t));
+    message.pushData(&numColumns, sizeof(int32_t));
     for(size_t i =0; i<_inputTypes.size(); ++i)
     {
         switch(_inputTypes[i])
         {
-        case TE_STRING:     child.hardWrite (R_STRSXP,  sizeof (R_STRSXP));  break;
-        case TE_DOUBLE:     child.hardWrite (R_REALSXP, sizeof (R_REALSXP)); break;
+        case TE_STRING:     message.pushData (R_STRSXP,  sizeof (R_STRSXP));  break;
+        case TE_DOUBLE:     message.pushData (R_REALSXP, sizeof (R_REALSXP)); break;
         case TE_UINT16:
-        case TE_INT32:      child.hardWrite (R_INTSXP,  sizeof (R_INTSXP));  break;
+        case TE_INT32:      message.pushData (R_INTSXP,  sizeof (R_INTSXP));  break;
         default:         throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "internal error: unknown type";
         }
-        child.hardWrite(&numRows, sizeof(int32_t));
-        shared_ptr<ConstChunkIterator> citer = chunks[i]->getConstIterator(ConstChunkIterator::IGNORE_OVERLAPS);
-        _writeBuf.reset();
-        while((!citer->end()))
+        message.pushData(&numRows, sizeof(int32_t));
+        _column.begin(*chunks[i], _inputTypes[i], NULL, _inputNullable[i], numRows);
+        int64_t const sliceRows = ChunkColumn<>::sliceRows(vector<ConstChunk const*>(1, chunks[i]), _requestWindow);
+        for(int32_t rows = _column.next(sliceRows); rows > 0; rows = _column.next(sliceRows))
         {
-            Value const& v = citer->getItem();
-            switch(_inputTypes[i])
-            {
-            case TE_STRING:
+            writeSlice(i, rows, message);
+            if(child != NULL)
             {
-                _writeBuf.pushData(&R_CHARSXP, sizeof(R_CHARSXP));
-                if(v.isNull())
-                {
-                    int32_t size = -1;
-                    _writeBuf.pushData(&size, sizeof(int32_t));
-                }
-                else
-                {
-                    int32_t size = v.size() - 1;
-                    _writeBuf.pushData(&size, sizeof(int32_t));
-                    _writeBuf.pushData(v.getString(), size);
-                }
-                break;
+                writeRequest(*child, message);
+                message.reset();
             }
-            case TE_DOUBLE:
-            {
-                if(v.isNull())
-                {
-                    _writeBuf.pushData(&_rNanDouble, sizeof(double));
-                }
-                else
-                {
-                    double  datum = v.getDouble();
-                    _writeBuf.pushData(&datum, sizeof(double));
-                }
-                break;
-            }
-            case TE_UINT16:
+        }
+    }
+    message.pushData(R_TAIL_HDR, sizeof(R_TAIL_HDR));
+    message.pushData(R_STRSXP, sizeof(R_STRSXP));
+    message.pushData(&numColumns, sizeof(int32_t));
+    for(size_t i =0; i<_inputTypes.size(); ++i)
+    {
+        message.pushData(R_CHARSXP, sizeof(R_CHARSXP));
+        int32_t nameSize = _inputNames[i].size();
+        message.pushData(&nameSize, sizeof(int32_t));
+        message.pushData(_inputNames[i].c_str(), nameSize);
+    }
+    message.pushData(R_TAIL, sizeof(R_TAIL));
+    if(child != NULL)
+    {
+        writeRequest(*child, message);
+        message.reset();
+    }
+}
+
+void DFInterface::writeSlice(size_t const i, int32_t const numRows, Message& message)
+{
+    switch(_inputTypes[i])
+    {
+    case TE_STRING:
+    {
+        int64_t const* offsets = _column.offsets();
+        for(int32_t j = 0; j < numRows; ++j)
+        {
+            int32_t size = _column.isNull(j) ? -1 : (int32_t) (offsets[j + 1] - offsets[j]);
+            message.pushData(&R_CHARSXP, sizeof(R_CHARSXP));
+            message.pushData(&size, sizeof(int32_t));
+            if(size > 0)
             {
-                if(v.isNull())
-                {
-                    _writeBuf.pushData(&_rNanInt32, sizeof(int32_t));
-                }
-                else
-                {
-                    int32_t datum = (int32_t) (v.getUint16());
-                    _writeBuf.pushData(&datum, sizeof(int32_t));
-                }
-                break;
+                message.pushData(_column.values() + offsets[j], size);
             }
-            case TE_INT32:
+        }
+        break;
+    }
+    case TE_DOUBLE:
+    case TE_INT32:
+    {
+        // Same layout as R: copy the column whole, then put R's NA where the nulls are
+        size_t const width = _inputTypes[i] == TE_DOUBLE ? sizeof(double) : sizeof(int32_t);
+        char* dst = message.reserve(numRows * width);
+        memcpy(dst, _column.values(), numRows * width);
+        void const* na = _inputTypes[i] == TE_DOUBLE ? (void const*) &_rNanDouble : (void const*) &_rNanInt32;
+        for(int32_t j = 0; j < numRows && _column.nullCount() != 0; ++j)
+        {
+            if(_column.isNull(j))
             {
-                if(v.isNull())
-                {
-                    _writeBuf.pushData(&_rNanInt32, sizeof(int32_t));
-                }
-                else
-                {
-                    int32_t datum = v.getInt32();
-                    _writeBuf.pushData(&datum, sizeof(int32_t));
-                }
-                break;
-            }
-            default: throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "internal error: unsupported type";
+                memcpy(dst + j * width, na, width);
             }
-            ++(*citer);
         }
-        child.hardWrite(_writeBuf.data(), _writeBuf.size());
+        break;
     }
-    child.hardWrite(R_TAIL_HDR, sizeof(R_TAIL_HDR));
-    child.hardWrite(R_STRSXP, sizeof(R_STRSXP));
-    child.hardWrite(&numColumns, sizeof(int32_t));
-    for(size_t i =0; i<_inputTypes.size(); ++i)
+    case TE_UINT16:
     {
-        child.hardWrite(R_CHARSXP, sizeof(R_CHARSXP));
-        int32_t nameSize = _inputNames[i].size();
-        child.hardWrite(&nameSize, sizeof(int32_t));
-        child.hardWrite(_inputNames[i].c_str(), nameSize);
+        int32_t* dst = reinterpret_cast<int32_t*>(message.reserve(numRows * sizeof(int32_t)));
+        uint16_t const* src = reinterpret_cast<uint16_t const*>(_column.values());
+        for(int32_t j = 0; j < numRows; ++j)
+        {
+            dst[j] = _column.isNull(j) ? _rNanInt32 : (int32_t) src[j];
+        }
+        break;
+    }
+    default: throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "internal error: unsupported type";
     }
-    child.hardWrite(R_TAIL, sizeof(R_TAIL));
 }
 
-void DFInterface::writeFinalDF(ChildProcess& child)
+void DFInterface::encodeFinal(Message& message)
 {
-    child.hardWrite(R_HEADER,  sizeof(R_HEADER));
-    child.hardWrite(R_EVECSXP, sizeof(R_VECSXP));
+    message.reset();
+    message.pushData(R_HEADER,  sizeof(R_HEADER));
+    message.pushData(R_EVECSXP, sizeof(R_VECSXP));
     int32_t numColumns = 0;
-    child.hardWrite(&numColumns, sizeof(int32_t));
+    message.pushData(&numColumns, sizeof(int32_t));
 }
 
-void DFInterface::readDF(ChildProcess& child, bool lastMessage)
+void DFInterface::writeRequest(ChildProcess& child, Message const& message)
 {
-    child.hardRead(&(_readBuf[0]), sizeof(R_HEADER) + sizeof(R_VECSXP), !lastMessage);
-    int32_t intBuf;
+    child.hardWrite(message.data(), message.size());
+}
+
+void DFInterface::readResponse(ChildProcess& child, Message& response, bool last)
+{
+    response.reset();
+    child.hardRead(response.reserve(sizeof(R_HEADER) + sizeof(R_VECSXP)), sizeof(R_HEADER) + sizeof(R_VECSXP), !last);
     int32_t numColumns = -1;
-    child.hardRead(&numColumns, sizeof(int32_t), !lastMessage);
+    child.hardRead(&numColumns, sizeof(int32_t), !last);
+    response.pushData(&numColumns, sizeof(int32_t));
     if (numColumns > 0 && numColumns != _nOutputAttrs)
     {
         LOG4CXX_TRACE(logger, "[readDF numColumns, _nOutputAttrs] :" << numColumns << ", " << _nOutputAttrs);
         throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "received incorrect number of columns ";// << numColumns << " attrs " << _nOutputAttrs;
     }
-    if (numColumns == 0)
+    if (numColumns <= 0)
     {
         return;
     }
-    int32_t numRows;
+    int32_t intBuf;
+    int32_t numRows = 0;
     for(int32_t i =0; i<numColumns; ++i)
     {
         switch(_outputTypes[i])
         {
-        case TE_STRING:     child.hardRead (&(_readBuf[0]),  sizeof (R_STRSXP),  !lastMessage);  break;
-        case TE_DOUBLE:     child.hardRead (&(_readBuf[0]),  sizeof (R_REALSXP), !lastMessage);  break;
-        case TE_INT32:      child.hardRead (&(_readBuf[0]),  sizeof (R_INTSXP),  !lastMessage);  break;
+        case TE_STRING:     child.hardRead (response.reserve(sizeof (R_STRSXP)),  sizeof (R_STRSXP),  !last);  break;
+        case TE_DOUBLE:     child.hardRead (response.reserve(sizeof (R_REALSXP)), sizeof (R_REALSXP), !last);  break;
+        case TE_INT32:      child.hardRead (response.reserve(sizeof (R_INTSXP)),  sizeof (R_INTSXP),  !last);  break;
         default:         throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "internal error: unknown type";
         }
+        child.hardRead(&intBuf, sizeof(int32_t), !last);
+        response.pushData(&intBuf, sizeof(int32_t));
         if( i == 0)
         {
-            child.hardRead(&numRows, sizeof(int32_t));
+            numRows = intBuf;
             if(numRows < 0)
             {
                 throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "received negative number of rows";
             }
         }
-        else
+        else if(intBuf != numRows)
         {
-            child.hardRead(&intBuf, sizeof(int32_t));
-            if(intBuf != numRows)
-            {
-                throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "received lists of different sizes";
-            }
-        }
-        if(numRows == 0)
-        {
-            continue;
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "received lists of different sizes";
         }
         switch(_outputTypes[i])
         {
         case TE_DOUBLE:
         {
             size_t readSize = sizeof(double) * numRows;
-            if(readSize > _readBuf.size())
-            {
-                _readBuf.resize(readSize);
-            }
-            child.hardRead (&(_readBuf[0]), readSize, !lastMessage);
+            child.hardRead (response.reserve(readSize), readSize, !last);
             break;
         }
         case TE_INT32:
         {
             size_t readSize = sizeof(int32_t) * numRows;
-            if(readSize > _readBuf.size())
-            {
-                _readBuf.resize(readSize);
-            }
-            child.hardRead (&(_readBuf[0]), readSize, !lastMessage);
+            child.hardRead (response.reserve(readSize), readSize, !last);
             break;
         }
         case TE_STRING:
         {
-            break; // all below
+            for(int32_t j = 0; j<numRows; ++j)
+            {
+                child.hardRead(response.reserve(sizeof(R_CHARSXP)), sizeof(R_CHARSXP), !last);
+                int32_t size;
+                child.hardRead(&size, sizeof(int32_t), !last);
+                response.pushData(&size, sizeof(int32_t));
+                if(size<-1)
+                {
+                    throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "error reading string size";
+                }
+                if(size > 0)
+                {
+                    child.hardRead(response.reserve(size), size, !last);
+                }
+            }
+            break;
         }
         default:         throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "internal error: unknown type";
         }
+    }
+    skipNames(child, last, numColumns);
+}
+
+void DFInterface::skipNames(ChildProcess& child, bool last, int32_t numColumns)
+{
+    char tailBuf[sizeof(R_TAIL_HDR) + sizeof(R_STRSXP) + sizeof(int32_t)];
+    child.hardRead(tailBuf, sizeof(tailBuf), !last);
+    vector<char> nameBuf;
+    int32_t intBuf;
+    for(int32_t i =0; i<numColumns; ++i)
+    {
+        child.hardRead(tailBuf, sizeof(R_CHARSXP), !last);
+        child.hardRead(&intBuf, sizeof(int32_t), !last);
+        if(intBuf < 0)
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "error reading name size";
+        }
+        nameBuf.resize(intBuf + 1);
+        child.hardRead(&(nameBuf[0]), intBuf, !last);
+    }
+    child.hardRead(tailBuf, sizeof(R_TAIL), !last);
+}
+
+void DFInterface::streamResponse(ChildProcess& child, bool last)
+{
+    char hdrBuf[sizeof(R_HEADER) + sizeof(R_VECSXP)];
+    child.hardRead(hdrBuf, sizeof(hdrBuf), !last);
+    int32_t numColumns = -1;
+    child.hardRead(&numColumns, sizeof(int32_t), !last);
+    if (numColumns > 0 && numColumns != _nOutputAttrs)
+    {
+        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "received incorrect number of columns ";
+    }
+    if (numColumns <= 0)
+    {
+        return;
+    }
+    int32_t intBuf;
+    int32_t numRows = 0;
+    for(int32_t i =0; i<numColumns; ++i)
+    {
+        child.hardRead(hdrBuf, sizeof(R_STRSXP), !last);
+        child.hardRead(&intBuf, sizeof(int32_t), !last);
+        if( i == 0)
+        {
+            numRows = intBuf;
+            if(numRows < 0)
+            {
+                throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "received negative number of rows";
+            }
+        }
+        else if(intBuf != numRows)
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "received lists of different sizes";
+        }
+        if(numRows == 0)
+        {
+            continue;
+        }
+        // Each column goes into its own chunk, so it can be written before the next one arrives
         shared_ptr<ChunkIterator> ociter = _oaiters[i]->newChunk(_outPos).getIterator(_query, ChunkIterator::SEQUENTIAL_WRITE  | ChunkIterator::NO_EMPTY_CHECK );
         Coordinates valPos = _outPos;
-        for(int32_t j = 0; j<numRows; ++j)
+        switch(_outputTypes[i])
         {
-            ociter->setPosition(valPos);
-            switch(_outputTypes[i])
+        case TE_DOUBLE:
+        case TE_INT32:
+        {
+            size_t const width = _outputTypes[i] == TE_DOUBLE ? sizeof(double) : sizeof(int32_t);
+            int32_t const sliceRows = _responseWindow == 0 ? numRows : std::max<size_t>(1, std::min<size_t>(_responseWindow / width, numRows));
+            for(int32_t j = 0; j<numRows; j += sliceRows)
             {
-            case TE_STRING:
+                int32_t const n = std::min(sliceRows, numRows - j);
+                _readMsg.reset();
+                child.hardRead(_readMsg.reserve(n * width), n * width, !last);
+                writeNumbers(*ociter, _outputTypes[i], _readMsg.data(), n, valPos);
+            }
+            break;
+        }
+        case TE_STRING:
+        {
+            for(int32_t j = 0; j<numRows; ++j)
             {
-                child.hardRead(&(_readBuf[0]), sizeof(R_CHARSXP) + sizeof(int32_t), !lastMessage);
-                int32_t size = *((int32_t*) (&(_readBuf[0]) + sizeof(R_CHARSXP)));
+                child.hardRead(hdrBuf, sizeof(R_CHARSXP), !last);
+                int32_t size;
+                child.hardRead(&size, sizeof(int32_t), !last);
                 if(size<-1)
                 {
                     throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "error reading string size";
                 }
+                ociter->setPosition(valPos);
                 if(size == -1)
                 {
                     ociter->writeItem(_nullVal);
                 }
                 else
                 {
-                    if( (size_t) size+1 > _readBuf.size())
-                    {
-                        _readBuf.resize(size+1);
-                    }
-                    child.hardRead(&(_readBuf[0]), size, !lastMessage);
-                    _readBuf[size] = 0;
-                    _val.setData( &(_readBuf[0]), size+1);
+                    _val.setSize(size+1);
+                    char* dst = static_cast<char*>(_val.data());
+                    child.hardRead(dst, size, !last);
+                    dst[size] = 0;
                     ociter->writeItem(_val);
                 }
-                break;
+                ++valPos[2];
             }
-            case TE_DOUBLE:
+            break;
+        }
+        default:         throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "internal error: unknown type";
+        }
+        ociter->flush();
+    }
+    skipNames(child, last, numColumns);
+    writeEmptyTag(numRows);
+}
+
+void DFInterface::decodeResponse(Message& response)
+{
+    response.consume(sizeof(R_HEADER) + sizeof(R_VECSXP));
+    int32_t numColumns;
+    response.hardRead(&numColumns, sizeof(int32_t));
+    if (numColumns <= 0)
+    {
+        return;
+    }
+    int32_t numRows = 0;
+    for(int32_t i =0; i<numColumns; ++i)
+    {
+        response.consume(sizeof(R_STRSXP));
+        response.hardRead(&numRows, sizeof(int32_t));
+        if(numRows == 0)
+        {
+            continue;
+        }
+        shared_ptr<ChunkIterator> ociter = _oaiters[i]->newChunk(_outPos).getIterator(_query, ChunkIterator::SEQUENTIAL_WRITE  | ChunkIterator::NO_EMPTY_CHECK );
+        Coordinates valPos = _outPos;
+        switch(_outputTypes[i])
+        {
+        case TE_DOUBLE:     writeNumbers(*ociter, TE_DOUBLE, response.consume(sizeof(double) * numRows),  numRows, valPos); break;
+        case TE_INT32:      writeNumbers(*ociter, TE_INT32,  response.consume(sizeof(int32_t) * numRows), numRows, valPos); break;
+        case TE_STRING:
+        {
+            for(int32_t j = 0; j<numRows; ++j)
             {
-                double v = ((double*)(&(_readBuf[0])))[j];
-                if( memcmp(&v, &_rNanDouble, sizeof(double))==0)
+                ociter->setPosition(valPos);
+                response.consume(sizeof(R_CHARSXP));
+                int32_t size;
+                response.hardRead(&size, sizeof(int32_t));
+                if(size == -1)
                 {
                     ociter->writeItem(_nullVal);
                 }
                 else
                 {
-                    _val.setDouble(v);
+                    _val.setSize(size+1);
+                    char* dst = static_cast<char*>(_val.data());
+                    response.hardRead(dst, size);
+                    dst[size] = 0;
                     ociter->writeItem(_val);
                 }
-                break;
+                ++valPos[2];
             }
-            case TE_INT32:
+            break;
+        }
+        default:         throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "internal error: unknown type";
+        }
+        ociter->flush();
+    }
+    writeEmptyTag(numRows);
+}
+
+void DFInterface::writeNumbers(ChunkIterator& ociter, TypeEnum type, char const* data, int32_t n, Coordinates& valPos)
+{
+    for(int32_t j = 0; j<n; ++j)
+    {
+        ociter.setPosition(valPos);
+        if(type == TE_DOUBLE)
+        {
+            double v;
+            memcpy(&v, data + j * sizeof(double), sizeof(double));
+            if( memcmp(&v, &_rNanDouble, sizeof(double))==0)
             {
-                int32_t v = ((int32_t*)(&(_readBuf[0])))[j];
-                if (v == _rNanInt32)
-                {
-                    ociter->writeItem(_nullVal);
-                }
-                else
-                {
-                    _val.setInt32(v);
-                    ociter->writeItem(_val);
-                }
-                break;
+                ociter.writeItem(_nullVal);
             }
-            default:         throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "internal error: unknown type";
+            else
+            {
+                _val.setDouble(v);
+                ociter.writeItem(_val);
             }
-            ++valPos[2];
         }
-        ociter->flush();
+        else
+        {
+            int32_t v;
+            memcpy(&v, data + j * sizeof(int32_t), sizeof(int32_t));
+            if (v == _rNanInt32)
+            {
+                ociter.writeItem(_nullVal);
+            }
+            else
+            {
+                _val.setInt32(v);
+                ociter.writeItem(_val);
+            }
+        }
+        ++valPos[2];
     }
+}
+
+void DFInterface::writeEmptyTag(int32_t numRows)
+{
     if(numRows != 0)
     {
         Value bmVal;
@@ -436,14 +626,6 @@ void DFInterface::readDF(ChildProcess& child, bool lastMessage)
         bmCiter->flush();
         _outPos[1]++;
     }
-    child.hardRead(&(_readBuf[0]), sizeof(R_TAIL_HDR) + sizeof(R_STRSXP) + sizeof(int32_t), !lastMessage);
-    for(int32_t i =0; i<numColumns; ++i)
-    {
-        child.hardRead(&(_readBuf[0]), sizeof(R_CHARSXP), !lastMessage);
-        child.hardRead(&intBuf, sizeof(int32_t), !lastMessage);
-        child.hardRead(&(_readBuf[0]), intBuf, !lastMessage);
-    }
-    child.hardRead(&(_readBuf[0]), sizeof(R_TAIL), !lastMessage);
 }
 
 }}
@@ -28,6 +28,8 @@
 
 #include <query/PhysicalOperator.h>
 #include <query/TypeSystem.h>
+#include "ChunkColumn.h"
+#include "Message.h"
 
 namespace scidb { namespace stream
 {
@@ -79,7 +81,9 @@ public:
     void setInputSchema(ArrayDesc const& inputSchema);
 
     /**
-     * Write data to the child and record the response into an internal array.
+     * Write data to the child and record the response into an internal array. With the pipe transport the data is
+     * written as it is encoded, a column at a time, in slices of about the request window each. The response is
+     * added as it arrives, a column at a time, in slices of about the response window each.
      * @param inputChunks the data must match the attributes from the most recent setInputSchema call,
      *                    excluding the empty tag.
      * @param child the process to stream to
@@ -94,67 +98,108 @@ public:
      */
     std::shared_ptr<Array> finalize(ChildProcess& child);
 
-private:
-    class EasyBuffer
-    {
-    private:
-        std::vector<char> _data;
-        size_t       _end;
-
-    public:
-        EasyBuffer(size_t initialCapacity = 1024*1024):
-            _data(initialCapacity),
-            _end(0)
-        {}
-
-        void pushData(void const* data, size_t size)
-        {
-            if(_end + size > _data.size())
-            {
-                _data.resize(_end + size);
-            }
-            memcpy((&(_data[_end])), data, size);
-            _end += size;
-        }
-
-        void reset()
-        {
-            _end   = 0;
-        }
-
-        /**
-         * Result of this call is invalidated after next pushData call
-         */
-        void* data()
-        {
-            return (&_data[0]);
-        }
-
-        size_t size()
-        {
-            return _end;
-        }
-    };
+    // Split streaming interface methods, for callers that move the bytes themselves //
+
+    /**
+     * Encode a set of input chunks into a message for the child.
+     * @param inputChunks the data must match the attributes from the most recent setInputSchema call,
+     *                    excluding the empty tag.
+     * @param message overwritten with the encoded data
+     * @return false if the chunks were empty and there is nothing to send; true otherwise
+     */
+    bool encodeData(std::vector<ConstChunk const*> const& inputChunks, Message& message);
+
+    /**
+     * Encode the terminating message that tells the child there is no more data.
+     * @param message overwritten with the encoded data
+     */
+    void encodeFinal(Message& message);
+
+    /**
+     * Write a message produced by encodeData or encodeFinal to the child. Safe to call from several threads at
+     * once, for different children.
+     * @param child the process to write to
+     * @param message the encoded data
+     */
+    void writeRequest(ChildProcess& child, Message const& message);
+
+    /**
+     * Read one complete response from the child without interpreting it. Touches no SciDB arrays, so it may be
+     * called from a thread other than the query thread.
+     * @param child the process to read from
+     * @param response overwritten with the raw response
+     * @param last true if this is the response to the terminating message
+     */
+    void readResponse(ChildProcess& child, Message& response, bool last = false);
+
+    /**
+     * Record a response previously obtained from readResponse into the internal array.
+     * @param response the raw response
+     */
+    void decodeResponse(Message& response);
+
+    /**
+     * Return a pointer to the array containing all the accumulated result data. This object is invalidated after
+     * this call.
+     */
+    std::shared_ptr<Array> getResult();
 
+private:
     std::shared_ptr<Query>                         _query;
     std::shared_ptr<Array>                         _result;
     Coordinates                                    _outPos;
     size_t                                         _outputChunkSize;
+    size_t const                                   _responseWindow;
+    size_t const                                   _requestWindow;
+    bool const                                     _streamRequests;
     int32_t                                        _nOutputAttrs;
     std::vector< std::shared_ptr<ArrayIterator> >  _oaiters;
     std::vector <TypeEnum>                         _outputTypes;
-    std::vector<char>                              _readBuf;
-    EasyBuffer                                     _writeBuf;
+    Message                                        _writeMsg;
+    Message                                        _readMsg;
     Value                                          _val;
     Value                                          _nullVal;
     std::vector <TypeEnum>                         _inputTypes;
     std::vector <std::string>                      _inputNames;
+    std::vector <bool>                             _inputNullable;
+    ChunkColumn<>                                  _column;
     int32_t                                        _rNanInt32;
     double                                         _rNanDouble;
 
-    void writeDF(std::vector<ConstChunk const*> const& chunks, int32_t const numRows, ChildProcess& child);
-    void writeFinalDF(ChildProcess& child);
-    void readDF(ChildProcess& child, bool lastMessage = false);
+    /**
+     * Like the public encodeData, but if child is not NULL, write the message to it as it is encoded.
+     */
+    bool encodeData(std::vector<ConstChunk const*> const& inputChunks, Message& message, ChildProcess* child);
+
+    /**
+     * Encode a set of input chunks one column at a time, in slices of about _requestWindow bytes.
+     * @param child if not NULL, each slice is written to it as soon as it is encoded and the message is reset
+     */
+    void writeDF(std::vector<ConstChunk const*> const& chunks, int32_t const numRows, Message& message, ChildProcess* child);
+
+    /**
+     * Append the values of input column i, the slice of it currently laid out in _column, to message.
+     */
+    void writeSlice(size_t const i, int32_t const numRows, Message& message);
+
+    /**
+     * Read one response from the child and add it to the array as it arrives, so that no more than about
+     * _responseWindow bytes of it (a column, if 0) are held at a time.
+     * @param last true if this is the response to the terminating message
+     */
+    void streamResponse(ChildProcess& child, bool last);
+
+    /**
+     * Read the trailing names attribute of an R list off the pipe, without keeping it.
+     */
+    void skipNames(ChildProcess& child, bool last, int32_t numColumns);
+
+    /**
+     * Write n values of a double or int32 column, converting R NA to null.
+     */
+    void writeNumbers(ChunkIterator& ociter, TypeEnum type, char const* data, int32_t n, Coordinates& valPos);
+
+    void writeEmptyTag(int32_t numRows);
 };
 
 
@@ -28,7 +28,10 @@
 #include <memory>
 #include <arrow/api.h>
 #include <arrow/io/memory.h>
+#include <arrow/ipc/dictionary.h>
 #include <arrow/ipc/feather.h>
+#include <arrow/ipc/reader.h>
+#include <arrow/ipc/writer.h>
 #include <array/MemArray.h>
 #include <query/Query.h>
 
@@ -53,12 +56,140 @@ using std::string;
 
 namespace scidb { namespace stream {
 
+// An Arrow IPC end-of-stream marker: the continuation token and a zero metadata length
+static uint32_t const ARROW_EOS[2] = { 0xFFFFFFFF, 0 };
+
+// Message header types from the Arrow flatbuffer schema
+enum ArrowMessageHeader
+{
+    ARROW_SCHEMA           = 1,
+    ARROW_DICTIONARY_BATCH = 2,
+    ARROW_RECORD_BATCH     = 3
+};
+
+/**
+ * An Arrow output stream appending to a Message, so that the Feather and IPC writers encode straight into the
+ * message that goes to the child, reusing its memory from one chunk to the next. Given a child, the stream instead
+ * writes the message to it whenever it holds about a window of bytes, and passes large writes straight through.
+ */
+class MessageOutputStream: public arrow::io::OutputStream
+{
+private:
+    Message*      _message;
+    ChildProcess* _child;
+    size_t        _window;
+    int64_t       _position;
+
+public:
+    MessageOutputStream():
+        _message(NULL),
+        _child(NULL),
+        _window(0),
+        _position(0)
+    {}
+
+    /**
+     * Start appending to message, after what it already holds.
+     * @param child if not NULL, where to write the message as it fills up; what it already holds goes first
+     * @param window how many bytes the message may hold before it is written to the child
+     */
+    void open(Message& message, ChildProcess* child = NULL, size_t window = 0)
+    {
+        _message  = &message;
+        _child    = child;
+        _window   = window;
+        _position = 0;
+    }
+
+    arrow::Status Close() override
+    {
+        if(_child != NULL)
+        {
+            flush();
+        }
+        _message = NULL;
+        _child   = NULL;
+        return arrow::Status::OK();
+    }
+
+    bool closed() const override
+    {
+        return _message == NULL;
+    }
+
+    arrow::Result<int64_t> Tell() const override
+    {
+        if(_message == NULL)
+        {
+            return arrow::Status::IOError("stream is closed");
+        }
+        return _position;
+    }
+
+    arrow::Status Write(const void* data, int64_t nbytes) override
+    {
+        if(_message == NULL)
+        {
+            return arrow::Status::IOError("stream is closed");
+        }
+        _position += nbytes;
+        if(_child != NULL && _message->size() + nbytes > _window)
+        {
+            flush();
+            if((size_t) nbytes >= _window)
+            {
+                _child->hardWrite(data, nbytes);
+                return arrow::Status::OK();
+            }
+        }
+        _message->pushData(data, nbytes);
+        return arrow::Status::OK();
+    }
+
+private:
+    void flush()
+    {
+        if(_message->size() != 0)
+        {
+            _child->hardWrite(_message->data(), _message->size());
+            _message->reset();
+        }
+    }
+};
+
+/**
+ * @return the Arrow type a SciDB type is sent and received as. Types Arrow has no equivalent of travel as strings
+ * (char, datetimetz) or as their raw bytes (user-defined types).
+ */
+static shared_ptr<arrow::DataType> arrowType(TypeEnum te)
+{
+    switch(te)
+    {
+    case TE_BOOL:       return arrow::boolean();
+    case TE_INT8:       return arrow::int8();
+    case TE_INT16:      return arrow::int16();
+    case TE_INT32:      return arrow::int32();
+    case TE_INT64:      return arrow::int64();
+    case TE_UINT8:      return arrow::uint8();
+    case TE_UINT16:     return arrow::uint16();
+    case TE_UINT32:     return arrow::uint32();
+    case TE_UINT64:     return arrow::uint64();
+    case TE_FLOAT:      return arrow::float32();
+    case TE_DOUBLE:     return arrow::float64();
+    case TE_DATETIME:   return arrow::timestamp(arrow::TimeUnit::SECOND);
+    case TE_CHAR:
+    case TE_DATETIMETZ:
+    case TE_STRING:     return arrow::utf8();
+    default:            return arrow::binary();
+    }
+}
+
 ArrayDesc FeatherInterface::getOutputSchema(
     std::vector<ArrayDesc> const& inputSchemas,
     Settings const& settings,
     std::shared_ptr<Query> const& query)
 {
-    if(settings.getFormat() != FEATHER)
+    if(settings.getFormat() != FEATHER && settings.getFormat() != ARROW)
     {
         throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION)
             << "FEATHER interface invoked on improper format";
@@ -130,9 +261,14 @@ FeatherInterface::FeatherInterface(Settings const& settings,
     _outPos{((Coordinate) _query->getInstanceID()), 0, 0},
     _outputChunkSize(settings.getChunkSize()),
     _nOutputAttrs((int32_t)outputSchema.getAttributes(true).size()),
-    _oaiters(_nOutputAttrs + 1),
+    _oaiters(_nOutputAttrs),
     _outputTypes(_nOutputAttrs),
-    _readBuf(1024*1024)
+    _pool(arrow::default_memory_pool()),
+    _writeStream(std::make_shared<MessageOutputStream>()),
+    _arrow(settings.getFormat() == ARROW),
+    _requestWindow(settings.getRequestWindow()),
+    _streamRequests(settings.getTransport() == PIPE),
+    _streamId(0)
 {
     //for(int32_t i = 0; i < _nOutputAttrs; ++i)
     int32_t i = 0;
@@ -142,7 +278,6 @@ FeatherInterface::FeatherInterface(Settings const& settings,
         _outputTypes[i] = settings.getTypes()[i];
         i++;
     }
-    _oaiters[_nOutputAttrs] = _result->getIterator(*outputSchema.getEmptyBitmapAttribute());
     _nullVal.setNull();
 }
 
@@ -153,6 +288,8 @@ void FeatherInterface::setInputSchema(ArrayDesc const& inputSchema)
     _inputTypes.resize(nInputAttrs);
     _inputNames.resize(nInputAttrs);
     _inputConverters.resize(nInputAttrs);
+    _inputNullable.resize(nInputAttrs);
+    _inputColumns.resize(nInputAttrs);
     size_t i = 0;
 //    for(size_t i=0; i < nInputAttrs; ++i)
     for (const auto& attr : attrs)
@@ -161,28 +298,109 @@ void FeatherInterface::setInputSchema(ArrayDesc const& inputSchema)
         _inputTypes[i] = typeId2TypeEnum(inputType, true);
         switch(_inputTypes[i])
         {
-        case TE_BOOL:
-        case TE_DOUBLE:
-        case TE_FLOAT:
-        case TE_UINT8:
-        case TE_INT8:
-        case TE_BINARY:
-            _inputConverters[i] = NULL;
-            break;
-        default:
+        case TE_CHAR:
+        case TE_DATETIMETZ:
             _inputConverters[i] = FunctionLibrary::getInstance()->findConverter(
                 inputType,
                 TID_STRING,
                 false);
+            break;
+        default:
+            _inputConverters[i] = NULL;
         }
         _inputNames[i]= attr.getName();
+        _inputNullable[i] = attr.isNullable();
         i++;
     }
+    if(!_arrow)
+    {
+        return;
+    }
+    vector<shared_ptr<arrow::Field>> fields;
+    for(size_t i = 0; i < nInputAttrs; ++i)
+    {
+        fields.push_back(arrow::field(_inputNames[i], arrowType(_inputTypes[i])));
+    }
+    _inputSchema = arrow::schema(fields);
+
+    // The schema message goes ahead of the first batch each child gets from this array
+    std::shared_ptr<arrow::Buffer> buffer;
+    arrow::ipc::DictionaryMemo dictionaryMemo;
+    THROW_NOT_OK(arrow::ipc::SerializeSchema(*_inputSchema,
+                                             &dictionaryMemo,
+                                             &_pool,
+                                             &buffer));
+    std::lock_guard<std::mutex> lock(_streamMutex);
+    _streamSchemas.push_back(string((char const*) buffer->data(), buffer->size()));
+    _streamId = _streamSchemas.size();
 }
 
 void FeatherInterface::streamData(
     std::vector<ConstChunk const*> const& inputChunks,
     ChildProcess& child)
+{
+    bool const stream = _arrow && _streamRequests;
+    if(!encodeData(inputChunks, _writeMsg, stream ? &child : NULL))
+    {
+        return;
+    }
+    if(!stream)
+    {
+        if(!child.isAlive())
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION)
+              << "child exited early";
+        }
+        writeRequest(child, _writeMsg);
+    }
+    if(_arrow)
+    {
+        readStreamResponse(child, _readMsg, false, true);
+        return;
+    }
+    readResponse(child, _readMsg);
+    decodeResponse(_readMsg);
+}
+
+shared_ptr<Array> FeatherInterface::finalize(ChildProcess& child)
+{
+    encodeFinal(_writeMsg);
+    writeRequest(child, _writeMsg);
+    if(_arrow)
+    {
+        readStreamResponse(child, _readMsg, true, true);
+        return getResult();
+    }
+    readResponse(child, _readMsg, true);
+    decodeResponse(_readMsg);
+    return getResult();
+}
+
+shared_ptr<Array> FeatherInterface::getResult()
+{
+    size_t columnBytes = 0;
+    for(ChunkColumn<int32_t> const& column : _inputColumns)
+    {
+        columnBytes += column.capacity();
+    }
+    LOG4CXX_DEBUG(logger, "FeatherInterface::memory:arrow allocated:" << _pool.bytes_allocated()
+                  << ":arrow peak:" << _pool.max_memory()
+                  << ":columns:" << columnBytes);
+    _oaiters.clear();
+    return _result;
+}
+
+bool FeatherInterface::encodeData(
+    std::vector<ConstChunk const*> const& inputChunks,
+    Message& message)
+{
+    return encodeData(inputChunks, message, NULL);
+}
+
+bool FeatherInterface::encodeData(
+    std::vector<ConstChunk const*> const& inputChunks,
+    Message& message,
+    ChildProcess* child)
 {
     if(inputChunks.size() != _inputTypes.size())
     {
@@ -192,194 +410,404 @@ void FeatherInterface::streamData(
     size_t numRows = inputChunks[0]->count();
     if(numRows == 0)
     {
-        return;
+        return false;
     }
     if(numRows > (size_t) std::numeric_limits<int32_t>::max())
     {
         throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION)
           << "received chunk with count exceeding the Arrow array limit";
     }
-    if(!child.isAlive())
+    if(_arrow)
     {
-        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION)
-          << "child exited early";
+        THROW_NOT_OK(writeBatch(inputChunks, numRows, message, child));
     }
-    THROW_NOT_OK(writeFeather(inputChunks, numRows, child));
-    readFeather(child);
+    else
+    {
+        THROW_NOT_OK(writeFeather(inputChunks, numRows, message));
+    }
+    return true;
 }
 
-shared_ptr<Array> FeatherInterface::finalize(ChildProcess& child)
+arrow::Status FeatherInterface::makeColumn(ConstChunk const* chunk,
+                                           size_t const i,
+                                           std::shared_ptr<arrow::Array>& array)
 {
-    writeFinalFeather(child);
-    readFeather(child, true);
-    _oaiters.clear();
-    return _result;
+    shared_ptr<arrow::DataType> type = arrowType(_inputTypes[i]);
+    ChunkColumn<int32_t>& column = _inputColumns[i];
+    column.extract(*chunk, _inputTypes[i], _inputConverters[i], _inputNullable[i], chunk->count());
+
+    // Buffers: validity, then offsets for strings and binaries, then values
+    int64_t const numRows = column.length();
+    vector<shared_ptr<arrow::Buffer>> buffers;
+    buffers.push_back(column.validity() == NULL ? nullptr :
+                      std::make_shared<arrow::Buffer>(column.validity(), (numRows + 7) / 8));
+    if(column.offsets() != NULL)
+    {
+        buffers.push_back(std::make_shared<arrow::Buffer>(
+                              reinterpret_cast<uint8_t const*>(column.offsets()),
+                              (numRows + 1) * sizeof(int32_t)));
+    }
+    if(_inputTypes[i] == TE_BOOL)
+    {
+        buffers.push_back(std::make_shared<arrow::Buffer>(column.packBits(), (numRows + 7) / 8));
+    }
+    else
+    {
+        buffers.push_back(std::make_shared<arrow::Buffer>(
+                              reinterpret_cast<uint8_t const*>(column.values()),
+                              column.valuesSize()));
+    }
+    array = arrow::MakeArray(
+        arrow::ArrayData::Make(type, numRows, buffers, column.nullCount()));
+    return arrow::Status::OK();
 }
 
 arrow::Status FeatherInterface::writeFeather(vector<ConstChunk const*> const& chunks,
                                     int32_t const numRows,
-                                    ChildProcess& child)
+                                    Message& message)
 {
     int32_t numColumns = chunks.size();
     LOG4CXX_DEBUG(logger, "writeFeather::numColumns:" << numColumns
                   << ":numRows:" << numRows);
 
-    std::shared_ptr<arrow::io::BufferOutputStream> stream;
-    ARROW_ASSIGN_OR_RAISE(
-        stream,
-        arrow::io::BufferOutputStream::Create(4096, arrow::default_memory_pool()));
+    // The size goes ahead of the Feather data once it is known
+    uint64_t writeSize = 0;
+    message.reset();
+    message.pushData(&writeSize, sizeof(uint64_t));
+    _writeStream->open(message);
 
     std::unique_ptr<arrow::ipc::feather::TableWriter> writer;
-    arrow::ipc::feather::TableWriter::Open(stream, &writer);
+    ARROW_RETURN_NOT_OK(arrow::ipc::feather::TableWriter::Open(_writeStream, &writer));
 
     writer->SetNumRows(numRows);
 
     for(size_t i = 0; i < _inputTypes.size(); ++i)
     {
-        shared_ptr<ConstChunkIterator> citer =
-            chunks[i]->getConstIterator(ConstChunkIterator::IGNORE_OVERLAPS);
-
         std::shared_ptr<arrow::Array> array;
-        switch(_inputTypes[i])
-        {
-        case TE_INT64:
-        {
-            arrow::Int64Builder builder;
+        ARROW_RETURN_NOT_OK(makeColumn(chunks[i], i, array));
 
-            while((!citer->end()))
-            {
-                Value const& value = citer->getItem();
-                if(value.isNull())
-                {
-                    builder.AppendNull();
-                }
-                else
-                {
-                    builder.Append(value.getInt64());
-                }
-                ++(*citer);
-            }
+        // Print array for debugging
+        // std::stringstream prettyprint_stream;
+        // arrow::PrettyPrint(*array, 0, &prettyprint_stream);
+        // LOG4CXX_DEBUG(logger, "writeFeather::array:"
+        //               << prettyprint_stream.str().c_str());
 
-            builder.Finish(&array);
-            break;
-        }
-        case TE_DOUBLE:
-        {
-            arrow::DoubleBuilder builder;
+        ARROW_RETURN_NOT_OK(writer->Append(_inputNames[i].c_str(), *array));
+    }
+    ARROW_RETURN_NOT_OK(writer->Finalize());
+    ARROW_RETURN_NOT_OK(_writeStream->Close());
 
-            while((!citer->end()))
-            {
-                Value const& value = citer->getItem();
-                if(value.isNull())
-                {
-                    builder.AppendNull();
-                }
-                else
-                {
-                    builder.Append(value.getDouble());
-                }
-                ++(*citer);
-            }
+    writeSize = message.size() - sizeof(uint64_t);
+    LOG4CXX_DEBUG(logger, "writeFeather::writeSize:" << writeSize);
+    memcpy(message.data(), &writeSize, sizeof(uint64_t));
 
-            builder.Finish(&array);
-            break;
-        }
-        case TE_STRING:
-        {
-            arrow::StringBuilder builder;
+    return arrow::Status::OK();
+}
 
-            while((!citer->end()))
-            {
-                Value const& value = citer->getItem();
-                if(value.isNull())
-                {
-                    builder.AppendNull();
-                }
-                else
-                {
-                    builder.Append(value.getString());
-                }
-                ++(*citer);
-            }
+arrow::Status FeatherInterface::writeBatch(vector<ConstChunk const*> const& chunks,
+                                           int32_t const numRows,
+                                           Message& message,
+                                           ChildProcess* child)
+{
+    LOG4CXX_DEBUG(logger, "writeBatch::numColumns:" << chunks.size()
+                  << ":numRows:" << numRows);
 
-            builder.Finish(&array);
-            break;
-        }
-        case TE_BINARY:
+    vector<shared_ptr<arrow::Array>> columns(_inputTypes.size());
+    for(size_t i = 0; i < _inputTypes.size(); ++i)
+    {
+        ARROW_RETURN_NOT_OK(makeColumn(chunks[i], i, columns[i]));
+    }
+    shared_ptr<arrow::RecordBatch> batch =
+        arrow::RecordBatch::Make(_inputSchema, numRows, columns);
+
+    // The stream the batch belongs to picks the schema writeRequest sends ahead of it
+    message.reset();
+    message.pushData(&_streamId, sizeof(uint64_t));
+    if(child != NULL)
+    {
+        if(!child->isAlive())
         {
-            arrow::BinaryBuilder builder;
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION)
+              << "child exited early";
+        }
+        // Switch the child to the stream first, then send the batch as the writer produces it
+        writeRequest(*child, message);
+        message.reset();
+    }
+    _writeStream->open(message, child, _requestWindow);
+    ARROW_RETURN_NOT_OK(arrow::ipc::SerializeRecordBatch(
+                            *batch, &_pool, _writeStream.get()));
+    LOG4CXX_DEBUG(logger, "writeBatch::writeSize:" << _writeStream->Tell().ValueOrDie());
+    ARROW_RETURN_NOT_OK(_writeStream->Close());
 
-            while((!citer->end()))
-            {
-                Value const& value = citer->getItem();
-                if(value.isNull())
-                {
-                    builder.AppendNull();
-                }
-                else
-                {
-                    builder.Append((const uint8_t*)value.data(), value.size());
-                }
-                ++(*citer);
-            }
+    return arrow::Status::OK();
+}
 
-            builder.Finish(&array);
-            break;
-        }
-        default: throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL,
-                                        SCIDB_LE_ILLEGAL_OPERATION)
-            << "internal error: unsupported type";
-        }
+void FeatherInterface::encodeFinal(Message& message)
+{
+    LOG4CXX_DEBUG(logger, "writeFinalFeather::0");
 
-        // Print array for debugging
-        // std::stringstream prettyprint_stream;
-        // arrow::PrettyPrint(*array, 0, &prettyprint_stream);
-        // LOG4CXX_DEBUG(logger, "writeFeather::array:"
-        //               << prettyprint_stream.str().c_str());
+    message.reset();
+    if(_arrow)
+    {
+        uint64_t noStream = 0;
+        message.pushData(&noStream, sizeof(uint64_t));
+        message.pushData(ARROW_EOS, sizeof(ARROW_EOS));
+        return;
+    }
+    int64_t zero = 0;
+    message.pushData(&zero, sizeof(int64_t));
+}
+
+FeatherInterface::ChildStreams& FeatherInterface::getChildStreams(ChildProcess const& child)
+{
+    std::lock_guard<std::mutex> lock(_streamMutex);
+    return _childStreams[child.getId()];   // map elements stay put while others come and go
+}
 
-        writer->Append(_inputNames[i].c_str(), *array);
+void FeatherInterface::writeRequest(ChildProcess& child, Message const& message)
+{
+    if(!_arrow)
+    {
+        child.hardWrite(message.data(), message.size());
+        return;
     }
-    writer->Finalize();
+    uint64_t streamId;
+    memcpy(&streamId, message.data(), sizeof(uint64_t));
+    char const* payload = message.data() + sizeof(uint64_t);
+    size_t const payloadSize = message.size() - sizeof(uint64_t);
 
-    std::shared_ptr<arrow::Buffer> buffer;
-    ARROW_ASSIGN_OR_RAISE(buffer, stream->Finish());
+    ChildStreams& streams = getChildStreams(child);
+    if(streamId == streams.request)
+    {
+        child.hardWrite(payload, payloadSize);
+        return;
+    }
 
-    uint64_t writeSize = buffer->size();
-    LOG4CXX_DEBUG(logger, "writeFeather::writeSize:" << writeSize);
-    child.hardWrite(&writeSize, sizeof(uint64_t));
-    child.hardWrite(buffer->data(), writeSize);
+    // Moving to another stream: end the one the child is reading, if any, and start the new one
+    streams.prefix.clear();
+    if(streams.request != 0)
+    {
+        streams.prefix.append((char const*) ARROW_EOS, sizeof(ARROW_EOS));
+    }
+    if(streamId != 0)
+    {
+        std::lock_guard<std::mutex> lock(_streamMutex);
+        streams.prefix.append(_streamSchemas[streamId - 1]);
+    }
+    streams.request = streamId;
+    LOG4CXX_DEBUG(logger, "writeRequest::stream:" << streamId
+                  << ":prefix:" << streams.prefix.size());
+    child.hardWrite(streams.prefix.data(), streams.prefix.size(), payload, payloadSize);
+}
 
-    return arrow::Status::OK();
+/**
+ * Find the header type and the body length in the flatbuffer of an Arrow IPC Message table.
+ * @return false if the flatbuffer is malformed
+ */
+static bool parseMessageHeader(char const* meta, size_t const size, int& headerType, int64_t& bodyLength)
+{
+    uint32_t table;
+    int32_t vtableOffset;
+    uint16_t vtableSize;
+    if(size < sizeof(uint32_t))
+    {
+        return false;
+    }
+    memcpy(&table, meta, sizeof(uint32_t));
+    if(table > size - sizeof(int32_t))
+    {
+        return false;
+    }
+    memcpy(&vtableOffset, meta + table, sizeof(int32_t));
+    int64_t const vtable = (int64_t) table - vtableOffset;
+    if(vtable < 0 || vtable > (int64_t) (size - 2 * sizeof(uint16_t)))
+    {
+        return false;
+    }
+    memcpy(&vtableSize, meta + vtable, sizeof(uint16_t));
+    if(vtable + vtableSize > (int64_t) size)
+    {
+        return false;
+    }
+    // Message fields: version, header_type, header, bodyLength, custom_metadata
+    auto fieldOffset = [meta, vtable, vtableSize] (size_t field)
+    {
+        uint16_t res = 0;
+        size_t const entry = 2 * sizeof(uint16_t) + field * sizeof(uint16_t);
+        if(entry + sizeof(uint16_t) <= vtableSize)
+        {
+            memcpy(&res, meta + vtable + entry, sizeof(uint16_t));
+        }
+        return res;
+    };
+    headerType = 0;
+    bodyLength = 0;
+    if(uint16_t const off = fieldOffset(1))
+    {
+        if(table + off + sizeof(uint8_t) > size)
+        {
+            return false;
+        }
+        headerType = (uint8_t) meta[table + off];
+    }
+    if(uint16_t const off = fieldOffset(3))
+    {
+        if(table + off + sizeof(int64_t) > size)
+        {
+            return false;
+        }
+        memcpy(&bodyLength, meta + table + off, sizeof(int64_t));
+    }
+    return bodyLength >= 0;
 }
 
-void FeatherInterface::writeFinalFeather(ChildProcess& child)
+int FeatherInterface::readStreamMessage(ChildProcess& child, Message& response, bool last)
 {
-    LOG4CXX_DEBUG(logger, "writeFinalFeather::0");
+    int32_t metaSize;
+    child.hardRead(&metaSize, sizeof(int32_t), !last);
+    if(metaSize == -1)   // continuation token; older writers go straight to the length
+    {
+        child.hardRead(&metaSize, sizeof(int32_t), !last);
+    }
+    if(metaSize == 0)
+    {
+        return -1;
+    }
+    if(metaSize < 0 || response.size() + metaSize > MAX_RESPONSE_SIZE)
+    {
+        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION)
+            << "received malformed Arrow stream";
+    }
+    response.pushData(ARROW_EOS, sizeof(int32_t));
+    response.pushData(&metaSize, sizeof(int32_t));
+    size_t const metaPos = response.size();
+    child.hardRead(response.reserve(metaSize), metaSize, !last);
+    int headerType;
+    int64_t bodyLength;
+    if(!parseMessageHeader(response.data() + metaPos, metaSize, headerType, bodyLength) ||
+       response.size() + bodyLength > MAX_RESPONSE_SIZE)
+    {
+        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION)
+            << "received malformed Arrow stream";
+    }
+    child.hardRead(response.reserve(bodyLength), bodyLength, !last);
+    return headerType;
+}
 
-    int64_t zero = 0;
-    child.hardWrite(&zero, sizeof(int64_t));
+void FeatherInterface::readStreamResponse(ChildProcess& child,
+                                          Message& response,
+                                          bool last,
+                                          bool decode)
+{
+    // Decoding needs the schema, which the child only sent with the first batch of its stream
+    ChildStreams& streams = getChildStreams(child);
+    response.reset();
+    response.pushData(streams.response.data(), streams.response.size());
+    bool haveBatch = false;
+    while(true)
+    {
+        size_t const start = response.size();
+        int const headerType = readStreamMessage(child, response, last);
+        if(headerType == ARROW_SCHEMA && streams.response.empty())
+        {
+            streams.response.assign(response.data() + start, response.size() - start);
+        }
+        else if(headerType == ARROW_RECORD_BATCH && !streams.response.empty())
+        {
+            haveBatch = true;
+            if(decode)
+            {
+                response.pushData(ARROW_EOS, sizeof(ARROW_EOS));
+                decodeResponse(response);
+                response.reset();
+                response.pushData(streams.response.data(), streams.response.size());
+                haveBatch = false;
+            }
+            if(!last)
+            {
+                break;
+            }
+        }
+        else if(headerType == -1)
+        {
+            streams.response.clear();
+            break;
+        }
+        else
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION)
+                << "received unexpected Arrow message " << headerType;
+        }
+    }
+    LOG4CXX_DEBUG(logger, "readStreamResponse::readSize:" << response.size());
+    if(!haveBatch)
+    {
+        response.reset();
+    }
+    else
+    {
+        response.pushData(ARROW_EOS, sizeof(ARROW_EOS));
+    }
+    if(last)
+    {
+        std::lock_guard<std::mutex> lock(_streamMutex);
+        _childStreams.erase(child.getId());
+    }
 }
 
-void FeatherInterface::readFeather(ChildProcess& child,
-                                   bool lastMessage)
+void FeatherInterface::readResponse(ChildProcess& child,
+                                    Message& response,
+                                    bool last)
 {
+    if(_arrow)
+    {
+        readStreamResponse(child, response, last);
+        return;
+    }
     LOG4CXX_DEBUG(logger, "readFeather");
 
     uint64_t readSize;
-    child.hardRead(&readSize, sizeof(uint64_t), !lastMessage);
+    child.hardRead(&readSize, sizeof(uint64_t), !last);
     LOG4CXX_DEBUG(logger, "readFeather::readSize:" << readSize);
-    if (readSize == 0)
+    response.reset();
+    child.hardRead(response.reserve(readSize), readSize, !last);
+}
+
+void FeatherInterface::decodeResponse(Message& response)
+{
+    if (response.size() == 0)
     {
         return;
     }
+    std::shared_ptr<arrow::io::BufferReader> buffer(
+        new arrow::io::BufferReader(
+            reinterpret_cast<const uint8_t*>(response.data()),
+            response.size()));
 
-    if (readSize > _readBuf.size())
+    if(_arrow)
     {
-        _readBuf.resize(readSize);
+        std::shared_ptr<arrow::RecordBatchReader> reader;
+        THROW_NOT_OK(arrow::ipc::RecordBatchStreamReader::Open(buffer, &reader));
+        std::shared_ptr<arrow::RecordBatch> batch;
+        while(true)
+        {
+            THROW_NOT_OK(reader->ReadNext(&batch));
+            if(!batch)
+            {
+                break;
+            }
+            vector<shared_ptr<arrow::Array>> columns(batch->num_columns());
+            for(int i = 0; i < batch->num_columns(); ++i)
+            {
+                columns[i] = batch->column(i);
+            }
+            LOG4CXX_DEBUG(logger, "readBatch::numColumns:" << columns.size()
+                          << ":numRows:" << batch->num_rows());
+            writeColumns(columns, batch->num_rows());
+        }
+        return;
     }
-    child.hardRead(&(_readBuf[0]), readSize, !lastMessage);
-    std::shared_ptr<arrow::io::BufferReader> buffer(
-        new arrow::io::BufferReader(&(_readBuf[0]), readSize));
 
     std::unique_ptr<arrow::ipc::feather::TableReader> reader;
     arrow::ipc::feather::TableReader::Open(buffer, &reader);
@@ -389,6 +817,86 @@ void FeatherInterface::readFeather(ChildProcess& child,
     LOG4CXX_DEBUG(logger, "readFeather::numColumns:" << numColumns
                   << ":numRows:" << numRows);
 
+    vector<shared_ptr<arrow::Array>> columns(numColumns);
+    std::shared_ptr<arrow::ChunkedArray> col;
+    for(int64_t i = 0; i < numColumns; ++i)
+    {
+        reader->GetColumn(i, &col);
+        // Feather files have only one chunk
+        // http://mail-archives.apache.org/mod_mbox/arrow-dev/201709.mbox/%3CCAJPUwMApjFdQFaiTXHYZJJCGcndrPn95UESS1ptDeWZ1zURubQ%40mail.gmail.com%3E
+        columns[i] = col->chunk(0);
+    }
+    writeColumns(columns, numRows);
+}
+
+/**
+ * Write the cells of one column in order, from the current position of ociter on. The validity bitmap is read 64
+ * rows at a time, so runs without nulls, or of nulls only, take no per-row check.
+ * @param value called with the number of each row that is not null; returns the value to write
+ */
+template <typename VALUE>
+static void writeCells(ChunkIterator& ociter,
+                       arrow::Array const& array,
+                       int64_t const numRows,
+                       Value const& nullVal,
+                       VALUE value)
+{
+    const uint8_t* validity =
+        array.null_count() != 0 ? array.null_bitmap_data() : nullptr;
+    if (validity != nullptr && array.offset() % 8 != 0)
+    {
+        // Sliced arrays do not come out of the readers; take the slow path
+        for(int64_t j = 0; j < numRows; ++j, ++ociter)
+        {
+            ociter.writeItem(array.IsNull(j) ? nullVal : value(j));
+        }
+        return;
+    }
+    if (validity != nullptr)
+    {
+        validity += array.offset() / 8;
+    }
+    for(int64_t start = 0; start < numRows; start += 64)
+    {
+        int64_t const rows = std::min<int64_t>(64, numRows - start);
+        uint64_t const all = rows == 64 ? ~(uint64_t) 0 : ((uint64_t) 1 << rows) - 1;
+        uint64_t word = all;
+        if (validity != nullptr)
+        {
+            // Arrow bitmaps are least significant bit first, like a little-endian word
+            word = 0;
+            memcpy(&word, validity + start / 8, (rows + 7) / 8);
+            word &= all;
+        }
+        int64_t const end = start + rows;
+        if (word == all)
+        {
+            for(int64_t j = start; j < end; ++j, ++ociter)
+            {
+                ociter.writeItem(value(j));
+            }
+        }
+        else if (word == 0)
+        {
+            for(int64_t j = start; j < end; ++j, ++ociter)
+            {
+                ociter.writeItem(nullVal);
+            }
+        }
+        else
+        {
+            for(int64_t j = start; j < end; ++j, ++ociter)
+            {
+                ociter.writeItem(word >> (j - start) & 1 ? value(j) : nullVal);
+            }
+        }
+    }
+}
+
+void FeatherInterface::writeColumns(vector<shared_ptr<arrow::Array>> const& columns,
+                                    int64_t const numRows)
+{
+    int64_t numColumns = columns.size();
     if (numColumns > 0 && numColumns != _nOutputAttrs)
     {
         throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION)
@@ -398,143 +906,129 @@ void FeatherInterface::readFeather(ChildProcess& child,
     {
         return;
     }
+    if ((size_t) numRows > _outputChunkSize)
+    {
+        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION)
+            << "received more rows than chunk_size in one response";
+    }
 
-    std::shared_ptr<arrow::ChunkedArray> col;
     for(int64_t i = 0; i < numColumns; ++i)
     {
-        LOG4CXX_DEBUG(logger, "readFeather::column:" << i);
-
-        reader->GetColumn(i, &col);
-        // Feather files have only one chunk
-        // http://mail-archives.apache.org/mod_mbox/arrow-dev/201709.mbox/%3CCAJPUwMApjFdQFaiTXHYZJJCGcndrPn95UESS1ptDeWZ1zURubQ%40mail.gmail.com%3E
-        std::shared_ptr<arrow::Array> array(col->chunk(0));
-        int64_t nullCount = array->null_count();
-        const uint8_t* nullBitmap = array->null_bitmap_data();
+        arrow::Type::type expectedType = arrowType(_outputTypes[i])->id();
+        if (columns[i]->type_id() != expectedType || columns[i]->length() != numRows)
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION)
+                << "received column " << i << " of incorrect type or length";
+        }
+    }
 
-        // LOG4CXX_DEBUG(logger, "readFeather::array:" << *array);
-        LOG4CXX_DEBUG(logger, "readFeather::array.null:" << nullCount);
+    for(int64_t i = 0; i < numColumns; ++i)
+    {
+        std::shared_ptr<arrow::Array> const& array = columns[i];
+        LOG4CXX_DEBUG(logger, "readFeather::column:" << i
+                      << ":null:" << array->null_count());
 
+        // The iterator of the first column fills in the empty tag as it goes
         shared_ptr<ChunkIterator> ociter = _oaiters[i]->newChunk(
             _outPos).getIterator(_query,
+                                 i == 0 ? ChunkIterator::SEQUENTIAL_WRITE :
                                  ChunkIterator::SEQUENTIAL_WRITE
                                  | ChunkIterator::NO_EMPTY_CHECK);
-        Coordinates valPos = _outPos;
+        ociter->setPosition(_outPos);
 
         switch(_outputTypes[i])
         {
-        case TE_INT64:
+        case TE_BOOL:
         {
-            const int64_t* arrayData =
-                std::static_pointer_cast<arrow::Int64Array>(
-                    array)->raw_values();
-
-            for(int64_t j = 0; j < numRows; ++j)
-            {
-                ociter->setPosition(valPos);
-                if (nullCount != 0 && ! (nullBitmap[j / 8] & 1 << j % 8))
-                {
-                    ociter->writeItem(_nullVal);
-                }
-                else
-                {
-                    _val.setInt64(arrayData[j]);
-                    ociter->writeItem(_val);
-                }
-                ++valPos[2];
-            }
+            arrow::BooleanArray const& arrayBool =
+                static_cast<arrow::BooleanArray const&>(*array);
+            writeCells(*ociter, *array, numRows, _nullVal,
+                       [this, &arrayBool] (int64_t j) -> Value const&
+                       {
+                           _val.setBool(arrayBool.Value(j));
+                           return _val;
+                       });
             break;
         }
-        case TE_DOUBLE:
+        case TE_DATETIME:
         {
-            const double* arrayData =
-                std::static_pointer_cast<arrow::DoubleArray>(
-                    array)->raw_values();
-
-            for(int64_t j = 0; j < numRows; ++j)
+            // Any unit is accepted, pandas for one sends nanoseconds
+            int64_t perSecond;
+            switch(static_cast<arrow::TimestampType const&>(
+                       *array->type()).unit())
             {
-                ociter->setPosition(valPos);
-                if (nullCount != 0 && ! (nullBitmap[j / 8] & 1 << j % 8))
-                {
-                    ociter->writeItem(_nullVal);
-                }
-                else
-                {
-                    _val.setDouble(arrayData[j]);
-                    ociter->writeItem(_val);
-                }
-                ++valPos[2];
+            case arrow::TimeUnit::MILLI: perSecond = 1000;       break;
+            case arrow::TimeUnit::MICRO: perSecond = 1000000;    break;
+            case arrow::TimeUnit::NANO:  perSecond = 1000000000; break;
+            default:                     perSecond = 1;
             }
+            const int64_t* arrayData =
+                static_cast<arrow::TimestampArray const&>(*array).raw_values();
+            writeCells(*ociter, *array, numRows, _nullVal,
+                       [this, arrayData, perSecond] (int64_t j) -> Value const&
+                       {
+                           // Round down, also before 1970
+                           int64_t seconds = arrayData[j] / perSecond;
+                           if (arrayData[j] % perSecond < 0)
+                           {
+                               --seconds;
+                           }
+                           _val.setInt64(seconds);
+                           return _val;
+                       });
             break;
         }
+        case TE_CHAR:
         case TE_STRING:
+        case TE_BINARY:
         {
-            std::shared_ptr<arrow::StringArray> arrayString =
-                std::static_pointer_cast<arrow::StringArray>(array);
-
-            for(int64_t j = 0; j < numRows; ++j)
-            {
-                ociter->setPosition(valPos);
-                if (nullCount != 0 && ! (nullBitmap[j / 8] & 1 << j % 8))
-                {
-                    ociter->writeItem(_nullVal);
-                }
-                else
-                {
-                    // Strings in Arrow arrays are not null-terminated
-                    _val.setString(arrayString->GetString(j));
-                    ociter->writeItem(_val);
-                }
-                ++valPos[2];
-            }
+            arrow::BinaryArray const& arrayBinary =
+                static_cast<arrow::BinaryArray const&>(*array);
+            TypeEnum const type = _outputTypes[i];
+            writeCells(*ociter, *array, numRows, _nullVal,
+                       [this, &arrayBinary, type] (int64_t j) -> Value const&
+                       {
+                           int32_t size;
+                           const uint8_t* data = arrayBinary.GetValue(j, &size);
+                           if (type == TE_BINARY)
+                           {
+                               _val.setData(data, size);
+                           }
+                           else if (type == TE_CHAR)
+                           {
+                               // The first character, '\0' for an empty string
+                               _val.setChar(size > 0 ? (char) data[0] : '\0');
+                           }
+                           else
+                           {
+                               // Strings in Arrow arrays are not null-terminated
+                               _val.setSize(size + 1);
+                               char* dst = static_cast<char*>(_val.data());
+                               memcpy(dst, data, size);
+                               dst[size] = 0;
+                           }
+                           return _val;
+                       });
             break;
         }
-        case TE_BINARY:
+        default:
         {
-            std::shared_ptr<arrow::BinaryArray> arrayBinary =
-                std::static_pointer_cast<arrow::BinaryArray>(array);
-
-            for(int64_t j = 0; j < numRows; ++j)
-            {
-                ociter->setPosition(valPos);
-                if (nullCount != 0 && ! (nullBitmap[j / 8] & 1 << j % 8))
-                {
-                    ociter->writeItem(_nullVal);
-                }
-                else
-                {
-                    const uint8_t* ptr_val;
-                    int32_t sz_val;
-                    ptr_val = arrayBinary->GetValue(j, &sz_val);
-                    _val.setData(ptr_val, sz_val);
-                    ociter->writeItem(_val);
-                }
-                ++valPos[2];
-            }
+            // Fixed-width values are stored as in SciDB
+            size_t const width = ChunkColumn<>::width(_outputTypes[i]);
+            const uint8_t* arrayData =
+                static_cast<arrow::PrimitiveArray const&>(*array).values()->data()
+                + array->offset() * width;
+            writeCells(*ociter, *array, numRows, _nullVal,
+                       [this, arrayData, width] (int64_t j) -> Value const&
+                       {
+                           _val.setData(arrayData + j * width, width);
+                           return _val;
+                       });
             break;
         }
-        default: throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL,
-                                        SCIDB_LE_ILLEGAL_OPERATION)
-            << "internal error: unknown type";
         }
         ociter->flush();
     }
-
-    // populate the empty tag
-    LOG4CXX_DEBUG(logger, "readFeather::empty tags...");
-    Value bmVal;
-    bmVal.setBool(true);
-    shared_ptr<ChunkIterator> bmCiter = _oaiters[_nOutputAttrs]->newChunk(
-        _outPos).getIterator(_query,
-                             ChunkIterator::SEQUENTIAL_WRITE
-                             | ChunkIterator::NO_EMPTY_CHECK);
-    Coordinates valPos = _outPos;
-    for(int64_t j =0; j<numRows; ++j)
-    {
-        bmCiter->setPosition(valPos);
-        bmCiter->writeItem(bmVal);
-        ++valPos[2];
-    }
-    bmCiter->flush();
     _outPos[1]++;
 }
 
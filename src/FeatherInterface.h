@@ -29,19 +29,35 @@
 #include <query/PhysicalOperator.h>
 #include <query/TypeSystem.h>
 #include <arrow/api.h>
+#include <deque>
+#include <map>
+#include <mutex>
+#include "ChunkColumn.h"
+#include "Message.h"
 
 namespace scidb { namespace stream
 {
 
 class Settings;
 class ChildProcess;
+class MessageOutputStream;
 
 /**
  * Interface for streaming data in Feather format. Converts SciDB data to Feather and then communicates with the child process.
  *
  * An empty message contains an empty Feather structure.
  *
- * For UDTs we do attempt to locate a UDT->string conversion function.
+ * Built-in types travel as their native Arrow types, and UDTs as binary.
+ *
+ * The column buffers, the messages and the Arrow pool all belong to the interface and are reused from one chunk to
+ * the next, so once they have grown to the largest chunk, encoding does not allocate.
+ *
+ * With format:'arrow' the same columns travel as an Arrow IPC stream instead: each input array becomes one stream
+ * whose schema goes to the child once, ahead of the first chunk, and each chunk becomes one record batch. The
+ * child's end-of-stream marker ends the previous array's stream, and an end-of-stream marker where a new stream
+ * would start ends the interaction. The child answers each chunk with one record batch, or with end-of-stream
+ * for no data, and answers the end of the interaction with whatever batches it has left followed by
+ * end-of-stream. Its schema is likewise sent once per stream.
  */
 class FeatherInterface
 {
@@ -74,7 +90,8 @@ public:
     void setInputSchema(ArrayDesc const& inputSchema);
 
     /**
-     * Write data to the child and record the response into an internal array.
+     * Write data to the child and record the response into an internal array. With the Arrow format and the pipe
+     * transport, the record batch is written as it is serialized, in blocks of about the request window each.
      * @param inputChunks the data must match the attributes from the most recent setInputSchema call,
      *                    excluding the empty tag.
      * @param child the process to stream to
@@ -89,9 +106,65 @@ public:
      */
     std::shared_ptr<Array> finalize(ChildProcess& child);
 
+    // Split streaming interface methods, for callers that move the bytes themselves //
+
+    /**
+     * Encode a set of input chunks into a message for the child.
+     * @param inputChunks the data must match the attributes from the most recent setInputSchema call,
+     *                    excluding the empty tag.
+     * @param message overwritten with the encoded data
+     * @return false if the chunks were empty and there is nothing to send; true otherwise
+     */
+    bool encodeData(std::vector<ConstChunk const*> const& inputChunks, Message& message);
+
+    /**
+     * Encode the terminating message that tells the child there is no more data.
+     * @param message overwritten with the encoded data
+     */
+    void encodeFinal(Message& message);
+
+    /**
+     * Write a message produced by encodeData or encodeFinal to the child. Safe to call from several threads at
+     * once, for different children.
+     * @param child the process to write to
+     * @param message the encoded data
+     */
+    void writeRequest(ChildProcess& child, Message const& message);
+
+    /**
+     * Read one complete response from the child without interpreting it. Touches no SciDB arrays, so it may be
+     * called from a thread other than the query thread.
+     * @param child the process to read from
+     * @param response overwritten with the raw response
+     * @param last true if this is the response to the terminating message
+     */
+    void readResponse(ChildProcess& child, Message& response, bool last = false);
+
+    /**
+     * Record a response previously obtained from readResponse into the internal array.
+     * @param response the raw response
+     */
+    void decodeResponse(Message& response);
+
+    /**
+     * Return a pointer to the array containing all the accumulated result data. This object is invalidated after
+     * this call.
+     */
+    std::shared_ptr<Array> getResult();
+
     static size_t const MAX_RESPONSE_SIZE = 1024*1024*1024;
 
 private:
+    /**
+     * Where the Arrow streams to and from one child stand.
+     */
+    struct ChildStreams
+    {
+        uint64_t    request;    // stream the child is reading, 0 before the first and after the last
+        std::string response;   // schema message of the stream the child is writing, empty if none
+        std::string prefix;     // what went ahead of the last request; kept as long as a splice may read it
+    };
+
     std::shared_ptr<Query>                      _query;
     std::shared_ptr<Array>                      _result;
     Coordinates                                 _outPos;
@@ -99,18 +172,71 @@ private:
     int32_t                                     _nOutputAttrs;
     std::vector<std::shared_ptr<ArrayIterator>> _oaiters;
     std::vector <TypeEnum>                      _outputTypes;
-    std::vector<uint8_t>                        _readBuf;
+    Message                                     _writeMsg;
+    Message                                     _readMsg;
     Value                                       _val;
     Value                                       _nullVal;
     std::vector<TypeEnum>                       _inputTypes;
     std::vector<std::string>                    _inputNames;
     std::vector<FunctionPointer>                _inputConverters;
+    std::vector<bool>                           _inputNullable;
+    std::vector<ChunkColumn<int32_t>>           _inputColumns;    // what the arrays made by makeColumn point into
+    arrow::ProxyMemoryPool                      _pool;            // whatever Arrow allocates for this query
+    std::shared_ptr<MessageOutputStream>        _writeStream;
+    bool                                        _arrow;
+    size_t const                                _requestWindow;
+    bool const                                  _streamRequests;  // write arrow requests as they are encoded
+    std::shared_ptr<arrow::Schema>              _inputSchema;
+    uint64_t                                    _streamId;        // counts setInputSchema calls
+    std::mutex                                  _streamMutex;     // guards the two members below
+    std::deque<std::string>                     _streamSchemas;   // schema message of each stream, by id - 1
+    std::map<uint64_t, ChildStreams>            _childStreams;    // by ChildProcess::getId
+
+    /**
+     * Lay out one input attribute of a chunk and wrap it in an Arrow array without copying. The array is valid
+     * until the next call for the same attribute.
+     */
+    arrow::Status makeColumn(ConstChunk const* chunk,
+                             size_t const i,
+                             std::shared_ptr<arrow::Array>& array);
 
     arrow::Status writeFeather(std::vector<ConstChunk const*> const& chunks,
                                int32_t const numRows,
-                               ChildProcess& child);
-    void writeFinalFeather(ChildProcess& child);
-    void readFeather(ChildProcess& child, bool lastMessage = false);
+                               Message& message);
+
+    /**
+     * Like the public encodeData, but if child is not NULL, write an Arrow request to it as it is encoded.
+     */
+    bool encodeData(std::vector<ConstChunk const*> const& inputChunks, Message& message, ChildProcess* child);
+
+    /**
+     * Encode one record batch. Given a child, switch it to the current stream and write the batch to it in
+     * blocks of about _requestWindow bytes as it is serialized, leaving the message empty.
+     */
+    arrow::Status writeBatch(std::vector<ConstChunk const*> const& chunks,
+                             int32_t const numRows,
+                             Message& message,
+                             ChildProcess* child);
+
+    /**
+     * Read one encapsulated IPC message from the child and append it to response.
+     * @return the type of the message from the Arrow flatbuffer schema, or -1 for end-of-stream
+     */
+    int readStreamMessage(ChildProcess& child, Message& response, bool last);
+
+    /**
+     * Read one response in the Arrow stream format from the child.
+     * @param decode if true, decode each record batch as soon as it is complete, rather than collect them all in
+     *               response, so only one batch is held at a time
+     */
+    void readStreamResponse(ChildProcess& child, Message& response, bool last, bool decode = false);
+
+    ChildStreams& getChildStreams(ChildProcess const& child);
+
+    /**
+     * Append a batch of result columns to the output array as one chunk.
+     */
+    void writeColumns(std::vector<std::shared_ptr<arrow::Array>> const& columns, int64_t const numRows);
 };
 
 }}
@@ -32,6 +32,7 @@
 #include "TSVInterface.h"
 #include "DFInterface.h"
 #include "FeatherInterface.h"
+#include "NativeInterface.h"
 #include <rbac/Rbac.h>
 #include <rbac/Rights.h>
 #include <rbac/Session.h>
@@ -70,6 +71,23 @@ public:
             },
             { KW_FORMAT, RE(PP(PLACEHOLDER_CONSTANT, TID_STRING)) },
             { KW_CHUNK_SIZE, RE(PP(PLACEHOLDER_CONSTANT, TID_INT64)) },
+            { KW_PIPELINE, RE(PP(PLACEHOLDER_CONSTANT, TID_INT64)) },
+            { KW_PARALLELISM, RE(PP(PLACEHOLDER_CONSTANT, TID_INT64)) },
+            { KW_REUSE, RE(PP(PLACEHOLDER_CONSTANT, TID_INT64)) },
+            { KW_ZYGOTE, RE(PP(PLACEHOLDER_CONSTANT, TID_STRING)) },
+            { KW_TRANSPORT, RE(PP(PLACEHOLDER_CONSTANT, TID_STRING)) },
+            { KW_SHM_SIZE, RE(PP(PLACEHOLDER_CONSTANT, TID_INT64)) },
+            { KW_KILL_TIMEOUT, RE(PP(PLACEHOLDER_CONSTANT, TID_INT64)) },
+            { KW_CONNECT, RE(PP(PLACEHOLDER_CONSTANT, TID_STRING)) },
+            { KW_LIBRARY, RE(PP(PLACEHOLDER_CONSTANT, TID_STRING)) },
+            { KW_SPECULATE, RE(PP(PLACEHOLDER_CONSTANT, TID_INT64)) },
+            { KW_RETRIES, RE(PP(PLACEHOLDER_CONSTANT, TID_INT64)) },
+            { KW_MAX_CHILDREN, RE(PP(PLACEHOLDER_CONSTANT, TID_INT64)) },
+            { KW_MEMORY_LIMIT, RE(PP(PLACEHOLDER_CONSTANT, TID_INT64)) },
+            { KW_AFFINITY, RE(PP(PLACEHOLDER_CONSTANT, TID_STRING)) },
+            { KW_RESPONSE_WINDOW, RE(PP(PLACEHOLDER_CONSTANT, TID_INT64)) },
+            { KW_REQUEST_WINDOW, RE(PP(PLACEHOLDER_CONSTANT, TID_INT64)) },
+            { KW_NULL_TOKEN, RE(PP(PLACEHOLDER_CONSTANT, TID_STRING)) },
             { KW_TYPES, RE(RE::OR, {
                            RE(PP(PLACEHOLDER_EXPRESSION, TID_STRING)),
                            RE(RE::GROUP, {
@@ -97,19 +115,27 @@ public:
     void inferAccess(std::shared_ptr<Query>& query)
     {
         //Read the file at /opt/scidb/VV.VV/etc/stream_allowed, one command per line
-        //If our command is in that file, it is "blessed" and we let it run by anyone.
+        //If our command (and zygote command, if any) is in that file, it is "blessed" and we let it run by anyone.
+        //With connect, the command is not run; the server address must be in the file instead. Likewise for
+        //the library loaded with format:'native', which runs inside SciDB itself.
         //Otherwise, the user needs to be in the 'operator' role.
         uint32_t major = SCIDB_VERSION_MAJOR();
         uint32_t minor = SCIDB_VERSION_MINOR();
         std::ostringstream commandsFile;
         commandsFile<<"/opt/scidb/"<<major<<"."<<minor<<"/etc/stream_allowed";
         Settings settings(_parameters, _kwParameters, true, query);
-        std::string const& command = settings.getCommand();
+        std::string const& command = !settings.getConnect().empty() ? settings.getConnect() :
+                                     !settings.getLibrary().empty() ? settings.getLibrary() : settings.getCommand();
+        std::string const& zygote = settings.getZygote();
+        bool commandAllowed = false;
+        bool zygoteAllowed = zygote.empty();
     	std::ifstream infile(commandsFile.str());
         std::string line;
         while (std::getline(infile, line))
         {
-            if(line == command)
+            commandAllowed = commandAllowed || line == command;
+            zygoteAllowed  = zygoteAllowed  || line == zygote;
+            if(commandAllowed && zygoteAllowed)
             {
                 return;
             }
@@ -132,6 +158,10 @@ public:
         {
             return DFInterface::getOutputSchema(schemas, settings, query);
         }
+        else if(settings.getFormat() == NATIVE)
+        {
+            return NativeInterface::getOutputSchema(schemas, settings, query);
+        }
         else
         {
             return FeatherInterface::getOutputSchema(schemas, settings, query);
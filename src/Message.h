@@ -0,0 +1,152 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* Copyright (C) 2008-2020 Paradigm4 Inc.
+* All Rights Reserved.
+*
+* stream is a plugin for SciDB, an Open Source Array DBMS maintained
+* by Paradigm4. See http://www.paradigm4.com/
+*
+* stream is free software: you can redistribute it and/or modify
+* it under the terms of the AFFERO GNU General Public License as published by
+* the Free Software Foundation.
+*
+* stream is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND,
+* INCLUDING ANY IMPLIED WARRANTY OF MERCHANTABILITY,
+* NON-INFRINGEMENT, OR FITNESS FOR A PARTICULAR PURPOSE. See
+* the AFFERO GNU General Public License for the complete license terms.
+*
+* You should have received a copy of the AFFERO GNU General Public License
+* along with stream.  If not, see <http://www.gnu.org/licenses/agpl-3.0.html>
+*
+* END_COPYRIGHT
+*/
+
+#ifndef SRC_MESSAGE_H_
+#define SRC_MESSAGE_H_
+
+#include <query/PhysicalOperator.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+namespace scidb { namespace stream
+{
+
+/**
+ * A complete protocol message held in memory: either an encoded input chunk on its way to the child, or a raw
+ * response read back from the child. Keeping the bytes apart from the ChildProcess lets the operator encode ahead
+ * of the child and decode behind it. The buffer only ever grows, so a Message is meant to be reused.
+ */
+class Message
+{
+private:
+    std::vector<char> _data;
+    size_t            _end;
+    size_t            _readIdx;
+
+public:
+    Message(size_t initialCapacity = 1024*1024):
+        _data(initialCapacity),
+        _end(0),
+        _readIdx(0)
+    {}
+
+    void pushData(void const* data, size_t size)
+    {
+        memcpy(reserve(size), data, size);
+    }
+
+    /**
+     * Append size bytes of uninitialized space to the message and return a pointer to it. The pointer is
+     * invalidated by the next pushData or reserve call.
+     */
+    char* reserve(size_t size)
+    {
+        if(_end + size > _data.size())
+        {
+            _data.resize(std::max(_end + size, _data.size() * 2));
+        }
+        char* res = _data.data() + _end;
+        _end += size;
+        return res;
+    }
+
+    /**
+     * Give back the trailing bytes of the most recent reserve call that were not filled.
+     */
+    void shrink(size_t bytes)
+    {
+        _end -= bytes;
+    }
+
+    /**
+     * Drop the first bytes of the message and move the rest to the front.
+     */
+    void dropFront(size_t bytes)
+    {
+        memmove(_data.data(), _data.data() + bytes, _end - bytes);
+        _end    -= bytes;
+        _readIdx = 0;
+    }
+
+    void reset()
+    {
+        _end     = 0;
+        _readIdx = 0;
+    }
+
+    /**
+     * Result of this call is invalidated after next pushData call
+     */
+    char* data()
+    {
+        return _data.data();
+    }
+
+    char const* data() const
+    {
+        return _data.data();
+    }
+
+    size_t size() const
+    {
+        return _end;
+    }
+
+    /**
+     * Return a pointer to the next bytes of the message and advance the read position past them.
+     * @throw if the message does not contain that many unread bytes
+     */
+    char const* consume(size_t bytes)
+    {
+        if(bytes > _end - _readIdx)
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "internal error: read past the end of a message";
+        }
+        char const* res = _data.data() + _readIdx;
+        _readIdx += bytes;
+        return res;
+    }
+
+    /**
+     * Copy the next bytes of the message into outputBuf and advance the read position past them.
+     */
+    void hardRead(void* outputBuf, size_t bytes)
+    {
+        memcpy(outputBuf, consume(bytes), bytes);
+    }
+
+    /**
+     * @return true if every byte of the message has been consumed
+     */
+    bool consumed() const
+    {
+        return _readIdx == _end;
+    }
+};
+
+} }
+
+#endif /* SRC_MESSAGE_H_ */
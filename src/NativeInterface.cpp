@@ -0,0 +1,371 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* Copyright (C) 2008-2020 Paradigm4 Inc.
+* All Rights Reserved.
+*
+* stream is a plugin for SciDB, an Open Source Array DBMS maintained
+* by Paradigm4. See http://www.paradigm4.com/
+*
+* stream is free software: you can redistribute it and/or modify
+* it under the terms of the AFFERO GNU General Public License as published by
+* the Free Software Foundation.
+*
+* stream is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND,
+* INCLUDING ANY IMPLIED WARRANTY OF MERCHANTABILITY,
+* NON-INFRINGEMENT, OR FITNESS FOR A PARTICULAR PURPOSE. See
+* the AFFERO GNU General Public License for the complete license terms.
+*
+* You should have received a copy of the AFFERO GNU General Public License
+* along with stream.  If not, see <http://www.gnu.org/licenses/agpl-3.0.html>
+*
+* END_COPYRIGHT
+*/
+
+
+#include "NativeInterface.h"
+#include "StreamSettings.h"
+#include <vector>
+#include <string>
+#include <dlfcn.h>
+#include <query/Query.h>
+#include <array/MemArray.h>
+
+using std::vector;
+using std::shared_ptr;
+using std::string;
+
+namespace scidb { namespace stream {
+
+/**
+ * @return the stream_native_type for a SciDB type, or 0 if there is none
+ */
+static int32_t nativeType(TypeEnum te)
+{
+    switch(te)
+    {
+    case TE_BOOL:     return STREAM_NATIVE_BOOL;
+    case TE_CHAR:     return STREAM_NATIVE_CHAR;
+    case TE_INT8:     return STREAM_NATIVE_INT8;
+    case TE_INT16:    return STREAM_NATIVE_INT16;
+    case TE_INT32:    return STREAM_NATIVE_INT32;
+    case TE_INT64:    return STREAM_NATIVE_INT64;
+    case TE_UINT8:    return STREAM_NATIVE_UINT8;
+    case TE_UINT16:   return STREAM_NATIVE_UINT16;
+    case TE_UINT32:   return STREAM_NATIVE_UINT32;
+    case TE_UINT64:   return STREAM_NATIVE_UINT64;
+    case TE_FLOAT:    return STREAM_NATIVE_FLOAT;
+    case TE_DOUBLE:   return STREAM_NATIVE_DOUBLE;
+    case TE_DATETIME: return STREAM_NATIVE_DATETIME;
+    case TE_STRING:   return STREAM_NATIVE_STRING;
+    case TE_BINARY:   return STREAM_NATIVE_BINARY;
+    default:          return 0;
+    }
+}
+
+ArrayDesc NativeInterface::getOutputSchema(std::vector<ArrayDesc> const& inputSchemas, Settings const& settings, std::shared_ptr<Query> const& query)
+{
+    if(settings.getFormat() != NATIVE)
+    {
+        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "native interface invoked on improper format";
+    }
+    vector<TypeEnum> outputTypes = settings.getTypes();
+    vector<string>   outputNames = settings.getNames();
+    if(outputTypes.size() == 0)
+    {
+        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "native interface requires that output types are specified";
+    }
+    if(outputNames.size() == 0)
+    {
+        for(size_t i =0; i<outputTypes.size(); ++i)
+        {
+            ostringstream name;
+            name<<"a"<<i;
+            outputNames.push_back(name.str());
+        }
+    }
+    else if (outputNames.size() != outputTypes.size())
+    {
+        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "received inconsistent names and types";
+    }
+    for(size_t i = 0; i<inputSchemas.size(); ++i)
+    {
+        for (const auto& attr : inputSchemas[i].getAttributes(true))
+        {
+            if(nativeType(typeId2TypeEnum(attr.getType(), true)) == 0)
+            {
+                ostringstream error;
+                error<<"Attribute "<<attr.getName()<<" has unsupported type "<<attr.getType()<<"; only built-in types are supported by the native format";
+                throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << error.str();
+            }
+        }
+    }
+    Dimensions outputDimensions;
+    outputDimensions.push_back(DimensionDesc("instance_id", 0,   query->getInstancesCount()-1, 1, 0));
+    outputDimensions.push_back(DimensionDesc("chunk_no",    0,   CoordinateBounds::getMax(),   1, 0));
+    outputDimensions.push_back(DimensionDesc("value_no",    0,   CoordinateBounds::getMax(),   settings.getChunkSize(), 0));
+    Attributes outputAttributes;
+    for(AttributeID i =0; i<outputTypes.size(); ++i)
+    {
+        outputAttributes.push_back( AttributeDesc(outputNames[i], typeEnum2TypeId(outputTypes[i]), AttributeDesc::IS_NULLABLE, CompressorType::NONE));
+    }
+    outputAttributes.addEmptyTagAttribute();
+    return ArrayDesc(inputSchemas[0].getName(), outputAttributes, outputDimensions, createDistribution(defaultDistType()), query->getDefaultArrayResidency());
+}
+
+NativeInterface::NativeInterface(Settings const& settings, ArrayDesc const& outputSchema, std::shared_ptr<Query> const& query):
+    _library(settings.getLibrary()),
+    _handle(NULL),
+    _init(NULL),
+    _processBatch(NULL),
+    _finalize(NULL),
+    _error(NULL),
+    _state(NULL),
+    _initialized(false),
+    _query(query),
+    _result(new MemArray(outputSchema, query)),
+    _outPos{ ((Coordinate) query->getInstanceID()), 0, 0 },
+    _nOutputAttrs( (int32_t) outputSchema.getAttributes(true).size()),
+    _oaiters(_nOutputAttrs+1),
+    _outputNames(_nOutputAttrs),
+    _outputTypes(_nOutputAttrs),
+    _outputWidths(_nOutputAttrs),
+    _outputs(_nOutputAttrs),
+    _array(0)
+{
+    int32_t i =0;
+    for (const auto& attr : outputSchema.getAttributes(true))
+    {
+        _oaiters[i] = _result->getIterator(attr);
+        _outputNames[i] = attr.getName();
+        _outputTypes[i] = nativeType(settings.getTypes()[i]);
+        _outputWidths[i] = ChunkColumn<>::width(settings.getTypes()[i]);
+        i++;
+    }
+    _oaiters[_nOutputAttrs] = _result->getIterator(*outputSchema.getEmptyBitmapAttribute());
+    _nullVal.setNull();
+    resetOutputs();
+    LOG4CXX_DEBUG(logger, "Loading native library "<<_library);
+    //RTLD_LOCAL: each library keeps its own symbols, so two libraries may both export the stream_native_ functions
+    _handle = dlopen(_library.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if(_handle == NULL)
+    {
+        char const* err = dlerror();
+        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "could not load library: " << (err ? err : _library.c_str());
+    }
+    try
+    {
+        AbiVersionFunc abiVersion = (AbiVersionFunc) findSymbol("stream_native_abi_version", true);
+        if(abiVersion() != STREAM_NATIVE_ABI_VERSION)
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "library was built for another version of stream_native.h";
+        }
+        _init         = (InitFunc)         findSymbol("stream_native_init", true);
+        _processBatch = (ProcessBatchFunc) findSymbol("stream_native_process_batch", true);
+        _finalize     = (FinalizeFunc)     findSymbol("stream_native_finalize", true);
+        _error        = (ErrorFunc)        findSymbol("stream_native_error", false);
+        check(_init(&_state, settings.getCommand().c_str(), _nOutputAttrs, _outputs.data()), "stream_native_init");
+        _initialized = true;
+    }
+    catch(...)
+    {
+        dlclose(_handle);
+        throw;
+    }
+}
+
+NativeInterface::~NativeInterface()
+{
+    if(_initialized)
+    {
+        resetOutputs();
+        _finalize(_state, _outputs.data());   //the query failed; the output no longer matters
+    }
+    dlclose(_handle);
+}
+
+void* NativeInterface::findSymbol(char const* name, bool required)
+{
+    void* res = dlsym(_handle, name);
+    if(res == NULL && required)
+    {
+        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "library does not export " << name;
+    }
+    return res;
+}
+
+void NativeInterface::check(int32_t ret, char const* call)
+{
+    if(ret != 0)
+    {
+        //called even with a NULL _state, as left by a failed stream_native_init, so init failures can be described
+        char const* err = _error != NULL ? _error(_state) : NULL;
+        ostringstream error;
+        error<<call<<" failed with "<<ret;
+        if(err != NULL)
+        {
+            error<<": "<<err;
+        }
+        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << error.str();
+    }
+}
+
+void NativeInterface::resetOutputs()
+{
+    for(int32_t i = 0; i < _nOutputAttrs; ++i)
+    {
+        memset(&_outputs[i], 0, sizeof(stream_native_column));
+        _outputs[i].type = _outputTypes[i];
+        _outputs[i].name = _outputNames[i].c_str();
+    }
+}
+
+void NativeInterface::setInputSchema(ArrayDesc const& inputSchema)
+{
+    Attributes const& attrs = inputSchema.getAttributes(true);
+    size_t const nInputAttrs = attrs.size();
+    _inputTypes.resize(nInputAttrs);
+    _inputNames.resize(nInputAttrs);
+    _inputNullable.resize(nInputAttrs);
+    _inputStorage.resize(nInputAttrs);
+    _inputs.resize(nInputAttrs);
+    size_t i =0;
+    for (const auto& attr : attrs)
+    {
+        _inputTypes[i]= typeId2TypeEnum(attr.getType());
+        _inputNames[i]= attr.getName();
+        _inputNullable[i] = attr.isNullable();
+        i++;
+    }
+}
+
+void NativeInterface::extractColumn(ConstChunk const& chunk, size_t const i, int64_t const numRows)
+{
+    ChunkColumn<int64_t>& storage = _inputStorage[i];
+    storage.extract(chunk, _inputTypes[i], NULL, _inputNullable[i], numRows);
+    stream_native_column& column = _inputs[i];
+    column.type     = nativeType(_inputTypes[i]);
+    column.name     = _inputNames[i].c_str();
+    column.length   = numRows;
+    column.values   = storage.values();
+    column.offsets  = storage.offsets();
+    column.validity = storage.validity();
+}
+
+void NativeInterface::streamData(std::vector<ConstChunk const*> const& inputChunks)
+{
+    if(inputChunks.size() != _inputTypes.size())
+    {
+        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "inconsistent input chunks given";
+    }
+    int64_t const numRows = inputChunks[0]->count();
+    if(numRows == 0)
+    {
+        return;
+    }
+    for(size_t i = 0; i < inputChunks.size(); ++i)
+    {
+        extractColumn(*inputChunks[i], i, numRows);
+    }
+    resetOutputs();
+    check(_processBatch(_state, _array, (int32_t) _inputs.size(), _inputs.data(), _outputs.data()), "stream_native_process_batch");
+    writeOutputs();
+}
+
+shared_ptr<Array> NativeInterface::finalize()
+{
+    resetOutputs();
+    _initialized = false;   //finalize releases the state whether or not it succeeds
+    check(_finalize(_state, _outputs.data()), "stream_native_finalize");
+    writeOutputs();
+    _oaiters.clear();
+    return _result;
+}
+
+void NativeInterface::writeOutputs()
+{
+    int64_t const numRows = _outputs[0].length;
+    for(int32_t i = 0; i < _nOutputAttrs; ++i)
+    {
+        stream_native_column const& column = _outputs[i];
+        if(column.length != numRows || column.length < 0)
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "library returned columns of different sizes";
+        }
+        if(column.type != _outputTypes[i])
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "library changed the type of an output column";
+        }
+        bool const varying = column.type == STREAM_NATIVE_STRING || column.type == STREAM_NATIVE_BINARY;
+        if(numRows > 0 && (column.values == NULL || (varying && column.offsets == NULL)))
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "library returned a column without data";
+        }
+    }
+    if(numRows == 0)
+    {
+        return;
+    }
+    for(int32_t i = 0; i < _nOutputAttrs; ++i)
+    {
+        stream_native_column const& column = _outputs[i];
+        char const* values = static_cast<char const*>(column.values);
+        shared_ptr<ChunkIterator> ociter = _oaiters[i]->newChunk(_outPos).getIterator(_query, ChunkIterator::SEQUENTIAL_WRITE  | ChunkIterator::NO_EMPTY_CHECK );
+        Coordinates valPos = _outPos;
+        for(int64_t j = 0; j<numRows; ++j)
+        {
+            ociter->setPosition(valPos);
+            if(column.validity != NULL && (column.validity[j / 8] & (1 << (j % 8))) == 0)
+            {
+                ociter->writeItem(_nullVal);
+            }
+            else
+            {
+                switch(column.type)
+                {
+                case STREAM_NATIVE_STRING:
+                case STREAM_NATIVE_BINARY:
+                {
+                    int64_t const start = column.offsets[j];
+                    int64_t const size  = column.offsets[j + 1] - start;
+                    if(start < 0 || size < 0)
+                    {
+                        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "library returned invalid offsets";
+                    }
+                    if(column.type == STREAM_NATIVE_BINARY)
+                    {
+                        _val.setData(values + start, size);
+                        break;
+                    }
+                    _val.setSize(size + 1);
+                    char* dst = static_cast<char*>(_val.data());
+                    memcpy(dst, values + start, size);
+                    dst[size] = 0;
+                    break;
+                }
+                default:        // fixed-width, in its C representation
+                    _val.setData(values + j * _outputWidths[i], _outputWidths[i]);
+                    break;
+                }
+                ociter->writeItem(_val);
+            }
+            ++valPos[2];
+        }
+        ociter->flush();
+    }
+    Value bmVal;
+    bmVal.setBool(true);                //populate the empty tag
+    shared_ptr<ChunkIterator> bmCiter = _oaiters[_nOutputAttrs]->newChunk(_outPos).getIterator(_query, ChunkIterator::SEQUENTIAL_WRITE  | ChunkIterator::NO_EMPTY_CHECK );
+    Coordinates valPos = _outPos;
+    for(int64_t j =0; j<numRows; ++j)
+    {
+        bmCiter->setPosition(valPos);
+        bmCiter->writeItem(bmVal);
+        ++valPos[2];
+    }
+    bmCiter->flush();
+    _outPos[1]++;
+}
+
+}}
@@ -0,0 +1,143 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* Copyright (C) 2008-2020 Paradigm4 Inc.
+* All Rights Reserved.
+*
+* stream is a plugin for SciDB, an Open Source Array DBMS maintained
+* by Paradigm4. See http://www.paradigm4.com/
+*
+* stream is free software: you can redistribute it and/or modify
+* it under the terms of the AFFERO GNU General Public License as published by
+* the Free Software Foundation.
+*
+* stream is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND,
+* INCLUDING ANY IMPLIED WARRANTY OF MERCHANTABILITY,
+* NON-INFRINGEMENT, OR FITNESS FOR A PARTICULAR PURPOSE. See
+* the AFFERO GNU General Public License for the complete license terms.
+*
+* You should have received a copy of the AFFERO GNU General Public License
+* along with stream.  If not, see <http://www.gnu.org/licenses/agpl-3.0.html>
+*
+* END_COPYRIGHT
+*/
+
+
+#ifndef SRC_NATIVEINTERFACE_H_
+#define SRC_NATIVEINTERFACE_H_
+
+#include <query/PhysicalOperator.h>
+#include <query/TypeSystem.h>
+#include "ChunkColumn.h"
+#include "stream_native.h"
+
+namespace scidb { namespace stream
+{
+
+class Settings;
+
+/**
+ * Interface for streaming data to a shared library loaded into the instance. Each input chunk is laid out as one
+ * column per attribute - values, string offsets and a null bitmap - and handed to the library, which returns its
+ * output the same way. The output array has the same shape as for the DF and Feather formats. See stream_native.h
+ * for what the library must provide.
+ */
+class NativeInterface
+{
+public:
+    /**
+     * Determine the output array schema returned by this interface.
+     * @param inputSchemas the schenas of the input arrays that will be supplied
+     * @param settings the settings of the operator
+     * @param query the query context
+     * @return a schema of the array that a subsequent finalize call will produce with these parameters
+     */
+    static ArrayDesc getOutputSchema(std::vector<ArrayDesc> const& inputSchemas, Settings const& settings, std::shared_ptr<Query> const& query);
+
+    /**
+     * Load the library and initialize it for the query.
+     * @param settings the settings of the operator
+     * @param outputSchema must be the result of a previous getOutputSchema call for these settings
+     * @param query the query context
+     */
+    NativeInterface(Settings const& settings, ArrayDesc const& outputSchema, std::shared_ptr<Query> const& query);
+
+    /**
+     * Release the library state, if finalize was not reached, and unload the library.
+     */
+    ~NativeInterface();
+
+    /**
+     * Set the interface to stream chunks from a given array. Must be called before streamData, when first
+     * starting to stream and whenever the array that chunks are streamed from changes
+     * @param inputSchema the schema of the array whose chunks will be streamed
+     */
+    void setInputSchema(ArrayDesc const& inputSchema);
+
+    /**
+     * Tell the library which input the next chunks come from.
+     * @param array 1 for ARRAY2, 0 for ARRAY
+     */
+    void setInputArray(int32_t array)
+    {
+        _array = array;
+    }
+
+    /**
+     * Hand a set of chunks to the library and record its output into an internal array.
+     * @param inputChunks the data must match the attributes from the most recent setInputSchema call,
+     *                    excluding the empty tag.
+     */
+    void streamData(std::vector<ConstChunk const*> const& inputChunks);
+
+    /**
+     * Finish the interaction and return a pointer to the array containing all the accumulated result data. This
+     * object is invalidated after this call.
+     * @return the array containing the result of the entire streaming session
+     */
+    std::shared_ptr<Array> finalize();
+
+private:
+    typedef int32_t (*AbiVersionFunc)(void);
+    typedef int32_t (*InitFunc)(void**, char const*, int32_t, stream_native_column const*);
+    typedef int32_t (*ProcessBatchFunc)(void*, int32_t, int32_t, stream_native_column const*, stream_native_column*);
+    typedef int32_t (*FinalizeFunc)(void*, stream_native_column*);
+    typedef char const* (*ErrorFunc)(void*);
+
+    std::string                                 _library;
+    void*                                       _handle;
+    InitFunc                                    _init;
+    ProcessBatchFunc                            _processBatch;
+    FinalizeFunc                                _finalize;
+    ErrorFunc                                   _error;
+    void*                                       _state;
+    bool                                        _initialized;
+    std::shared_ptr<Query>                      _query;
+    std::shared_ptr<Array>                      _result;
+    Coordinates                                 _outPos;
+    int32_t                                     _nOutputAttrs;
+    std::vector<std::shared_ptr<ArrayIterator>> _oaiters;
+    std::vector<std::string>                    _outputNames;
+    std::vector<int32_t>                        _outputTypes;
+    std::vector<size_t>                         _outputWidths;
+    std::vector<stream_native_column>           _outputs;
+    Value                                       _val;
+    Value                                       _nullVal;
+    int32_t                                     _array;
+    std::vector<TypeEnum>                       _inputTypes;
+    std::vector<std::string>                    _inputNames;
+    std::vector<bool>                           _inputNullable;
+    std::vector<ChunkColumn<int64_t>>           _inputStorage;
+    std::vector<stream_native_column>           _inputs;
+
+    void* findSymbol(char const* name, bool required);
+    void check(int32_t ret, char const* call);
+    void resetOutputs();
+    void extractColumn(ConstChunk const& chunk, size_t const i, int64_t const numRows);
+    void writeOutputs();
+};
+
+}}
+
+#endif /* SRC_NATIVEINTERFACE_H_ */
@@ -28,8 +28,10 @@
 #include <memory>
 #include <string>
 #include <vector>
+#include <algorithm>
 #include <ctype.h>
 #include <poll.h>
+#include <sched.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <query/TypeSystem.h>
@@ -38,9 +40,15 @@
 
 #include "StreamSettings.h"
 #include "ChildProcess.h"
+#include "ChildPlacement.h"
+#include "ChildPool.h"
+#include "ChildSlots.h"
+#include "Zygote.h"
+#include "Pipeline.h"
 #include "TSVInterface.h"
 #include "DFInterface.h"
 #include "FeatherInterface.h"
+#include "NativeInterface.h"
 
 using std::shared_ptr;
 using std::make_shared;
@@ -66,64 +74,355 @@ public:
             PhysicalOperator(logicalName, physicalName, parameters, schema)
     {}
 
-    template <typename INTERFACE>
-    shared_ptr<Array> runStream(vector <shared_ptr<Array> > &inputArrays, Settings const& settings, shared_ptr<Query>& query)
+    /**
+     * Walk the chunks of an array, handing each set of attribute chunks to streamChunks.
+     */
+    template <typename INTERFACE, typename STREAMER>
+    void streamArray(shared_ptr<Array> const& array, INTERFACE& interface, STREAMER streamChunks)
     {
-        ChildProcess child(settings.getCommand(), query);
-        INTERFACE interface(settings, _schema, query);
-        if(inputArrays.size() == 2)
+        ArrayDesc const& schema = array->getArrayDesc();
+        interface.setInputSchema(schema);
+        size_t const nAttrs = schema.getAttributes(true).size();
+        vector <shared_ptr<ConstArrayIterator> > aiters (nAttrs);
+        vector<ConstChunk const*> chunks(nAttrs, NULL);
+        size_t i = 0;
+        for (const auto& attr : schema.getAttributes(true))
+        {
+            aiters[i++] = array->getConstIterator(attr);
+        }
+        while(!aiters[0]->end())
+        {
+            for(i = 0; i<nAttrs; ++i)
+            {
+               chunks[i]= &(aiters[i]->getChunk());
+            }
+            streamChunks(chunks);
+            for(i = 0; i<nAttrs; ++i)
+            {
+                ++(*aiters[i]);
+            }
+        }
+    }
+
+    /**
+     * Resolve the parallelism setting: an explicit value is taken as is; 0 spreads the cores this instance may run
+     * on evenly across the instances, assuming they share the host.
+     */
+    static size_t numChildren(Settings const& settings, shared_ptr<Query> const& query)
+    {
+        size_t res = settings.getParallelism();
+        if(res == 0)
+        {
+            cpu_set_t cpus;
+            size_t nCpus = sched_getaffinity(0, sizeof(cpus), &cpus) == 0 ? CPU_COUNT(&cpus) : 1;
+            res = std::max<size_t>(1, nCpus / query->getInstancesCount());
+            LOG4CXX_DEBUG(logger, "stream automatic parallelism is "<<res);
+        }
+        if(settings.getMaxChildren() > 0 && res > settings.getMaxChildren())
+        {
+            res = settings.getMaxChildren();   //more could never run at once
+            LOG4CXX_DEBUG(logger, "stream parallelism capped at max_children "<<res);
+        }
+        return res;
+    }
+
+    /**
+     * @param childIdx the index of the child among those of the instance
+     * @return what identifies a pooled child: a child forked from a zygote runs PROGRAM inside the zygote, not
+     *         in bash, so it only matches children forked from the same zygote; a child that shares memory
+     *         only matches requests for the same amount, and a connection only matches the same server; a
+     *         child started under a slot limit or a memory limit only matches requests with the same limits;
+     *         a placed child only matches requests for the same policy, index and number of children, which
+     *         is what decides its cores, so it never ends up sharing a core with a fresh sibling
+     */
+    static string poolKey(Settings const& settings, shared_ptr<Query> const& query, size_t const childIdx)
+    {
+        string res = settings.getCommand();
+        if(!settings.getZygote().empty())
+        {
+            res.push_back('\0');
+            res.append(settings.getZygote());
+        }
+        if(!settings.getConnect().empty())
+        {
+            res.push_back('\0');
+            res.append(settings.getConnect());
+        }
+        if(settings.getTransport() == SHM)
+        {
+            res.push_back('\0');
+            res.append("shm:");
+            res.append(std::to_string(settings.getShmSize()));
+        }
+        if(settings.getAffinity() != AFFINITY_NONE)
+        {
+            res.push_back('\0');
+            res.append("affinity:");
+            res.append(std::to_string(settings.getAffinity()));
+            res.push_back(':');
+            res.append(std::to_string(childIdx));
+            res.push_back('/');
+            res.append(std::to_string(numChildren(settings, query)));
+        }
+        if(settings.getMaxChildren() > 0 || settings.getMemoryLimit() > 0)
+        {
+            res.push_back('\0');
+            res.append("limits:");
+            res.append(std::to_string(settings.getMaxChildren()));
+            res.push_back(':');
+            res.append(std::to_string(settings.getMemoryLimit()));
+        }
+        return res;
+    }
+
+    /**
+     * Start n children for the query, taking over idle ones from the pool first if reuse is enabled. If the query
+     * limits the children on the host, wait until there are slots for all the new ones.
+     * @param firstIdx the index of the first child among those of the instance, for placing it
+     */
+    static vector<std::unique_ptr<ChildProcess> > startChildren(Settings const& settings, shared_ptr<Query>& query, size_t const n,
+                                                                size_t const firstIdx = 0)
+    {
+        vector<std::unique_ptr<ChildProcess> > res;
+        while(settings.getReuseTimeout() > 0 && res.size() < n)
         {
-            shared_ptr<Array> preArray = inputArrays[1];
-            ArrayDesc const& preSchema = preArray->getArrayDesc();
-            interface.setInputSchema(preSchema);
-            size_t const nAttrs = preSchema.getAttributes(true).size();
-            vector <shared_ptr<ConstArrayIterator> > aiters (nAttrs);
-            vector<ConstChunk const*> chunks(nAttrs, NULL);
-            //            for(size_t i =0; i<nAttrs; ++i)
-            size_t i = 0;
-            for (const auto& attr : preSchema.getAttributes(true))
+            std::unique_ptr<ChildProcess> child = ChildPool::getInstance().acquire(poolKey(settings, query, firstIdx + res.size()), query);
+            if(!child)
             {
-                aiters[i++] = preArray->getConstIterator(attr);
+                break;
             }
-            while(!aiters[0]->end())
+            res.push_back(std::move(child));
+        }
+        size_t const nReused = res.size();
+        vector<std::unique_ptr<ChildSlot> > slots;   //pooled children gave theirs up, so they need one again too
+        if(settings.getMaxChildren() > 0)
+        {
+            int64_t waitedMillis = 0;
+            slots = ChildSlots::getInstance().acquire(settings.getMaxChildren(), n, query, waitedMillis);
+            if(waitedMillis > 0)
             {
-                for(i =0; i<nAttrs; ++i)
+                LOG4CXX_INFO(logger, "stream waited "<<waitedMillis<<" ms for "<<slots.size()<<" of the "<<settings.getMaxChildren()
+                             <<" child slots on this host");
+            }
+        }
+        size_t const shmSize = settings.getTransport() == SHM ? settings.getShmSize() : 0;
+        size_t const memoryLimit = settings.getMemoryLimit();
+        for(size_t i = 0; i < slots.size() && i < nReused; ++i)
+        {
+            res[i]->holdSlot(std::move(slots[i]));
+        }
+        ChildPlacement const placement(settings.getAffinity(), query->getInstanceID(), numChildren(settings, query));
+        for(size_t i = nReused; res.size() < n; ++i)
+        {
+            std::unique_ptr<ChildProcess> child;
+            cpu_set_t cpus;
+            bool const pin = placement.getCpus(firstIdx + res.size(), cpus);
+            if(!settings.getConnect().empty())
+            {
+                ServerAddress server;
+                server.path = settings.getConnect().substr(strlen("unix:"));
+                child.reset(new ChildProcess(server, query));
+            }
+            else if(!settings.getZygote().empty())
+            {
+                shared_ptr<Zygote> zygote = ZygoteRegistry::getInstance().get(settings.getZygote());
+                zygote->setKillTimeout(settings.getKillTimeout());
+                child.reset(new ChildProcess(*zygote, settings.getCommand(), query, shmSize));
+                if(memoryLimit > 0)
                 {
-                   chunks[i]= &(aiters[i]->getChunk());
+                    child->limitMemory(memoryLimit);   //forked by the zygote, so it can only be capped from outside
                 }
-                interface.streamData(chunks, child);
-                for(size_t i =0; i<nAttrs; ++i)
+                if(pin)
                 {
-                    ++(*aiters[i]);
+                    child->setAffinity(cpus);
                 }
             }
+            else
+            {
+                string command = settings.getCommand();
+                if(memoryLimit > 0)
+                {
+                    command = "ulimit -v " + std::to_string(memoryLimit / 1024) + "; " + command;
+                }
+                ScopedAffinity const inherited(pin ? &cpus : NULL);
+                child.reset(new ChildProcess(command, query, shmSize));
+            }
+            if(i < slots.size())
+            {
+                child->holdSlot(std::move(slots[i]));
+            }
+            res.push_back(std::move(child));
         }
-        shared_ptr<Array> inputArray = inputArrays[0];
-        ArrayDesc const& inputSchema = inputArray ->getArrayDesc();
-        interface.setInputSchema(inputSchema);
-        size_t const nAttrs = inputSchema.getAttributes(true).size();
-        vector <shared_ptr<ConstArrayIterator> > aiters (nAttrs);
-        vector<ConstChunk const*> chunks(nAttrs, NULL);
-        //        for(size_t i =0; i<nAttrs; ++i)
-        size_t i = 0;
-        for (const auto& attr : inputSchema.getAttributes(true))
+        for(size_t i = 0; i < n; ++i)
+        {
+            res[i]->setSpliceWrites(settings.getTransport() == SPLICE);
+            res[i]->setKillTimeout(settings.getKillTimeout());
+        }
+        return res;
+    }
+
+    /**
+     * Start one child for the query, or take over an idle one from the pool if reuse is enabled.
+     */
+    static std::unique_ptr<ChildProcess> startChild(Settings const& settings, shared_ptr<Query>& query, size_t const childIdx = 0)
+    {
+        return std::move(startChildren(settings, query, 1, childIdx)[0]);
+    }
 
+    /**
+     * Let go of a child that has answered its terminating message: back to the pool if reuse is enabled, killed
+     * otherwise. Children abandoned on error are simply destroyed, so a child is never reused mid-conversation.
+     * @param childIdx the index the child was started or taken from the pool for
+     */
+    static void releaseChild(std::unique_ptr<ChildProcess>& child, Settings const& settings, shared_ptr<Query> const& query,
+                             size_t const childIdx = 0)
+    {
+        if(settings.getReuseTimeout() > 0)
         {
-            aiters[i++] = inputArray->getConstIterator(attr);
+            ChildPool::getInstance().release(std::move(child), poolKey(settings, query, childIdx), query, settings.getReuseTimeout());
         }
-        while(!aiters[0]->end())
+        child.reset();
+    }
+
+    template <typename INTERFACE>
+    shared_ptr<Array> runStream(vector <shared_ptr<Array> > &inputArrays, Settings const& settings, shared_ptr<Query>& query)
+    {
+        size_t const nChildren = numChildren(settings, query);
+        if(nChildren > 1 || settings.getPipelineDepth() > 0 || settings.getRetries() > 0)
         {
-            for(i = 0; i<nAttrs; ++i)
+            return runPipelined<INTERFACE>(inputArrays, settings, query, nChildren);
+        }
+        std::unique_ptr<ChildProcess> child = startChild(settings, query);
+        INTERFACE interface(settings, _schema, query);
+        auto streamChunks = [&interface, &child] (vector<ConstChunk const*> const& chunks)
+        {
+            interface.streamData(chunks, *child);
+        };
+        if(inputArrays.size() == 2)
+        {
+            streamArray(inputArrays[1], interface, streamChunks);
+        }
+        streamArray(inputArrays[0], interface, streamChunks);
+        shared_ptr<Array> result = interface.finalize(*child);
+        releaseChild(child, settings, query);
+        return result;
+    }
+
+    /**
+     * @return a name for the chunk in log messages, such as "chunk at {1, 1001}"
+     */
+    static string chunkLabel(ConstChunk const& chunk)
+    {
+        Coordinates const& pos = chunk.getFirstPosition(false);
+        ostringstream out;
+        out<<"chunk at {";
+        for(size_t i = 0; i < pos.size(); ++i)
+        {
+            out<<(i == 0 ? "" : ", ")<<pos[i];
+        }
+        out<<"}";
+        return out.str();
+    }
+
+    /**
+     * Like runStream, but fan the chunks out to nChildren children and encode up to getPipelineDepth() chunks
+     * ahead while they work. Also used for a single lockstep child when it may have to be restarted.
+     */
+    template <typename INTERFACE>
+    shared_ptr<Array> runPipelined(vector <shared_ptr<Array> > &inputArrays, Settings const& settings, shared_ptr<Query>& query,
+                                   size_t const nChildren)
+    {
+        vector<std::unique_ptr<ChildProcess> > children = startChildren(settings, query, nChildren);
+        vector<ChildProcess*> childPtrs;
+        for(size_t i = 0; i < nChildren; ++i)
+        {
+            childPtrs.push_back(children[i].get());
+        }
+        vector<std::unique_ptr<ChildProcess> > replaced(nChildren); // gone, but the pipeline may still point at them
+        auto respawn = [&settings, &query, &children, &replaced] (size_t i)
+        {
+            LOG4CXX_WARN(logger, "stream child "<<i<<" went away, starting another");
+            replaced[i] = std::move(children[i]);
+            children[i] = startChild(settings, query, i);
+            return children[i].get();
+        };
+        INTERFACE interface(settings, _schema, query);
+        vector<bool> abandoned(nChildren, false);
+        {
+            Pipeline<INTERFACE> pipeline(interface, childPtrs, query, settings.getPipelineDepth(), settings.getSpeculate(),
+                                         settings.getRetries(), respawn);
+            if(inputArrays.size() == 2)
             {
-               chunks[i]= &(aiters[i]->getChunk());
+                // every child gets the whole of ARRAY2
+                streamArray(inputArrays[1], interface, [&interface, &pipeline] (vector<ConstChunk const*> const& chunks)
+                {
+                    if(interface.encodeData(chunks, pipeline.nextMessage()))
+                    {
+                        pipeline.broadcast();
+                    }
+                });
             }
-            interface.streamData(chunks, child);
-            for(size_t i =0; i<nAttrs; ++i)
+            streamArray(inputArrays[0], interface, [&interface, &pipeline] (vector<ConstChunk const*> const& chunks)
             {
-                ++(*aiters[i]);
+                if(interface.encodeData(chunks, pipeline.nextMessage()))
+                {
+                    pipeline.submit(chunkLabel(*chunks[0]));
+                }
+            });
+            pipeline.finish();
+            if(settings.getSpeculate() > 0)
+            {
+                std::pair<size_t, size_t> const stats = pipeline.getSpeculationStats();
+                LOG4CXX_DEBUG(logger, "stream speculated on "<<stats.first<<" chunks; the copy answered first "<<stats.second<<" times");
+            }
+            if(settings.getRetries() > 0)
+            {
+                LOG4CXX_DEBUG(logger, "stream restarted "<<pipeline.getRestarts()<<" children");
+                vector<string> const dropped = pipeline.getDropped();
+                for(size_t i = 0; i < dropped.size(); ++i)
+                {
+                    LOG4CXX_WARN(logger, "stream dropped the "<<dropped[i]<<" after "<<settings.getRetries() + 1
+                                 <<" failed attempts; its output is missing");
+                }
+            }
+            for(size_t i = 0; i < nChildren; ++i)
+            {
+                abandoned[i] = pipeline.isAbandoned(i);
+            }
+        } // the I/O threads must be gone before the children can go back to the pool
+        for(size_t i = 0; i < nChildren; ++i)
+        {
+            if(abandoned[i])
+            {
+                children[i].reset();   // a straggler let go mid-message may still look idle; never pool it
+            }
+            else
+            {
+                releaseChild(children[i], settings, query, i);
             }
         }
-        return interface.finalize(child);
+        return interface.getResult();
+    }
+
+    /**
+     * Like runStream, but hand the chunks to a library loaded into this process; there is no child, so
+     * parallelism, pipeline and the child keywords do not apply.
+     */
+    shared_ptr<Array> runNative(vector <shared_ptr<Array> > &inputArrays, Settings const& settings, shared_ptr<Query>& query)
+    {
+        NativeInterface interface(settings, _schema, query);
+        auto streamChunks = [&interface] (vector<ConstChunk const*> const& chunks)
+        {
+            interface.streamData(chunks);
+        };
+        if(inputArrays.size() == 2)
+        {
+            interface.setInputArray(1);
+            streamArray(inputArrays[1], interface, streamChunks);
+        }
+        interface.setInputArray(0);
+        streamArray(inputArrays[0], interface, streamChunks);
+        return interface.finalize();
     }
 
     /// @see OperatorDist
@@ -174,7 +473,11 @@ public:
         {
             return runStream<DFInterface> (inputArrays, settings, query);
         }
-        else                    // Feather
+        else if(settings.getFormat() == NATIVE)
+        {
+            return runNative(inputArrays, settings, query);
+        }
+        else                    // Feather or Arrow
         {
             return runStream<FeatherInterface> (inputArrays, settings, query);
         }
@@ -0,0 +1,693 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* Copyright (C) 2008-2020 Paradigm4 Inc.
+* All Rights Reserved.
+*
+* stream is a plugin for SciDB, an Open Source Array DBMS maintained
+* by Paradigm4. See http://www.paradigm4.com/
+*
+* stream is free software: you can redistribute it and/or modify
+* it under the terms of the AFFERO GNU General Public License as published by
+* the Free Software Foundation.
+*
+* stream is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND,
+* INCLUDING ANY IMPLIED WARRANTY OF MERCHANTABILITY,
+* NON-INFRINGEMENT, OR FITNESS FOR A PARTICULAR PURPOSE. See
+* the AFFERO GNU General Public License for the complete license terms.
+*
+* You should have received a copy of the AFFERO GNU General Public License
+* along with stream.  If not, see <http://www.gnu.org/licenses/agpl-3.0.html>
+*
+* END_COPYRIGHT
+*/
+
+#ifndef SRC_PIPELINE_H_
+#define SRC_PIPELINE_H_
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <query/Query.h>
+
+#include "ChildProcess.h"
+#include "Message.h"
+
+namespace scidb { namespace stream
+{
+
+/**
+ * Overlaps the work done inside SciDB with the work done by one or more children. The query thread encodes chunks
+ * into a bounded queue of messages; one I/O thread per child takes the next message off the queue whenever its
+ * child is free, writes it and reads the raw response back; the query thread decodes the responses whenever it
+ * would otherwise wait. Responses are decoded in the order the messages were submitted, no matter which child
+ * answered first, so the output is deterministic. At the end every child receives its own terminating message,
+ * and the final responses are decoded in child order. All access to SciDB arrays stays on the query thread - the
+ * I/O threads only move bytes.
+ *
+ * Optionally, a child that has run out of work takes a copy of a data message that another child has been working
+ * on for much longer than usual, and whichever answer arrives first is used. This is only correct for children
+ * whose answer depends on nothing but the message, so the caller must ask for it. At the end, a child that is
+ * still working on a message the copy has answered is interrupted and let go without its terminating message, so
+ * it must not be reused.
+ *
+ * Optionally, a child that goes away mid-message is replaced: the caller starts a new one, the I/O thread replays
+ * the broadcast messages the old child had answered, discarding the responses, and resends the message. The
+ * broadcast messages are then kept in memory for the whole stream. A data message that still fails after the last
+ * retry is dropped: the child is replaced once more, the message gets no response, and its label is recorded so the
+ * caller can report it.
+ *
+ * Typical use:
+ *
+ *   Pipeline<TSVInterface> pipeline(interface, children, query, depth);
+ *   for each chunk of the side array:
+ *       if(interface.encodeData(chunks, pipeline.nextMessage())) pipeline.broadcast();
+ *   for each chunk:
+ *       if(interface.encodeData(chunks, pipeline.nextMessage())) pipeline.submit();
+ *   pipeline.finish();
+ */
+template <class INTERFACE>
+class Pipeline
+{
+public:
+    /**
+     * Start a replacement for the child at the given index, which has gone away, and return it. The old child
+     * must stay allocated until the pipeline is destroyed. Called from that child's I/O thread.
+     */
+    typedef std::function<ChildProcess* (size_t childIdx)> Respawn;
+
+private:
+    struct Exchange
+    {
+        Message request;
+        Message response;
+        size_t  seq;
+        bool    last;
+        bool    skip;      // no response to decode: the terminating message of a child that was let go, or dropped
+        std::string label; // names a data message in reports of dropped messages
+
+        Exchange():
+            seq(0),
+            last(false),
+            skip(false)
+        {}
+    };
+    typedef std::unique_ptr<Exchange> ExchangePtr;
+    typedef std::chrono::steady_clock Clock;
+
+    /**
+     * What one child is working on, for spotting stragglers.
+     */
+    struct Running
+    {
+        Exchange const*   ex;          // NULL if idle, or busy with a message that must not be copied
+        Clock::time_point start;
+        bool              copied;      // another child already took a copy
+
+        Running():
+            ex(NULL),
+            copied(false)
+        {}
+    };
+
+    static size_t const LATENCY_WINDOW = 64;   // recent data messages the median is taken over
+    static size_t const MIN_LATENCIES  = 4;    // no speculation before this many have completed
+
+    INTERFACE&                    _interface;
+    std::vector<ChildProcess*>    _children;
+    std::shared_ptr<Query>        _query;
+    size_t const                  _maxExchanges;
+    size_t                        _numExchanges;
+    size_t                        _inFlight;
+    size_t                        _nextSeq;
+    size_t                        _nextDecode;
+    ExchangePtr                   _current;
+    std::deque<ExchangePtr>       _free;     // ready to be encoded into
+    std::deque<ExchangePtr>       _todo;     // encoded, waiting for any free child
+    std::vector<std::deque<ExchangePtr> > _directed; // messages meant for one particular child
+    std::vector<ExchangePtr>      _finals;   // terminating messages, one per child
+    std::map<size_t, ExchangePtr> _done;     // response received, waiting to be decoded in order
+    std::mutex                    _mutex;
+    std::condition_variable       _cv;
+    bool                          _stop;
+    std::exception_ptr            _error;
+    size_t const                  _speculate;  // straggler threshold as a multiple of the median; 0 for none
+    std::vector<Running>          _running;
+    std::vector<bool>             _abandoned;  // let go while working on a message that a copy already answered
+    std::deque<double>            _latencies;  // seconds, most recent last
+    size_t                        _nSpeculated;
+    size_t                        _nSpeculationWins;
+    size_t const                  _retries;    // times a message may be resent to a new child
+    Respawn const                 _respawn;
+    std::deque<Message>           _preamble;   // copies of the broadcast messages, kept only with retries
+    std::vector<size_t>           _preambleDone; // how many of those each child has answered
+    std::vector<char>             _needsReplay;  // per child, set when it is replaced; each only touched by its I/O thread
+    size_t                        _nRestarts;
+    std::vector<std::string>      _dropped;    // labels of the data messages given up on
+    std::vector<std::thread>      _ioThreads;
+
+    /**
+     * @return the index of a child whose data message is overdue and not copied yet, or _children.size() if there
+     *         is none. Must be called with the lock held.
+     */
+    size_t findStraggler(size_t const childIdx) const
+    {
+        if(_speculate == 0 || _latencies.size() < MIN_LATENCIES)
+        {
+            return _children.size();
+        }
+        std::vector<double> sorted(_latencies.begin(), _latencies.end());
+        std::nth_element(sorted.begin(), sorted.begin() + sorted.size() / 2, sorted.end());
+        double const limit = sorted[sorted.size() / 2] * _speculate;
+        Clock::time_point const now = Clock::now();
+        size_t res = _children.size();
+        double longest = limit;
+        for(size_t i = 0; i < _running.size(); ++i)
+        {
+            Running const& r = _running[i];
+            if(i == childIdx || r.ex == NULL || r.copied)
+            {
+                continue;
+            }
+            double const elapsed = std::chrono::duration<double>(now - r.start).count();
+            if(elapsed > longest)
+            {
+                longest = elapsed;
+                res = i;
+            }
+        }
+        return res;
+    }
+
+    /**
+     * @return true if some child is working on a data message that could still need a spare child. Must be called
+     *         with the lock held.
+     */
+    bool dataRunning() const
+    {
+        for(size_t i = 0; i < _running.size(); ++i)
+        {
+            if(_running[i].ex != NULL && !_running[i].copied)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * @return true if the response to seq has already been received from another child. Must be called with the
+     *         lock held.
+     */
+    bool answered(size_t const seq) const
+    {
+        return seq < _nextDecode || _done.count(seq) != 0;
+    }
+
+    /**
+     * Write a request to the child and read back its response. If the child goes away on the way, start a new one,
+     * bring it up to date with the broadcast messages and try again, up to the retry limit. Past the limit, a data
+     * message is given up on, and the child is still replaced so the following messages have one to go to.
+     * @param droppable true for a data message, which may be given up on; false for the others, which fail the
+     *                  stream instead
+     * @return true if the response was read; false if the message was given up on
+     */
+    bool exchange(size_t const childIdx, Exchange& ex, bool const droppable)
+    {
+        for(size_t failures = 0; ; ++failures)
+        {
+            ChildProcess* child = _children[childIdx];   // only replaced by this thread
+            try
+            {
+                if(_needsReplay[childIdx])
+                {
+                    replayPreamble(childIdx, *child);
+                    _needsReplay[childIdx] = false;
+                }
+                _interface.writeRequest(*child, ex.request);
+                _interface.readResponse(*child, ex.response, ex.last);
+                return true;
+            }
+            catch(...)
+            {
+                // still there: interrupted, or broke the protocol
+                if(_retries == 0 || child->isAlive() || (failures == _retries && !droppable))
+                {
+                    throw;
+                }
+            }
+            Query::validateQueryPtr(_query);
+            ChildProcess* fresh = _respawn(childIdx);
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _children[childIdx] = fresh;
+                _needsReplay[childIdx] = true;
+                ++_nRestarts;
+                if(_stop || _abandoned[childIdx])
+                {
+                    fresh->interrupt();
+                }
+            }
+            if(failures == _retries)
+            {
+                return false;
+            }
+        }
+    }
+
+    /**
+     * Send a restarted child the broadcast messages its predecessor had answered, and drop the responses.
+     */
+    void replayPreamble(size_t const childIdx, ChildProcess& child)
+    {
+        std::vector<Message const*> preamble;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            for(size_t i = 0; i < _preambleDone[childIdx]; ++i)
+            {
+                preamble.push_back(&_preamble[i]);   // deque elements stay put while more are appended
+            }
+        }
+        Message response(0);
+        for(size_t i = 0; i < preamble.size(); ++i)
+        {
+            _interface.writeRequest(child, *preamble[i]);
+            _interface.readResponse(child, response, false);
+        }
+    }
+
+    void ioLoop(size_t const childIdx)
+    {
+        try
+        {
+            while(true)
+            {
+                ExchangePtr ex;
+                bool copy = false;
+                bool directed = false;
+                {
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    size_t straggler = _children.size();
+                    auto haveWork = [this, childIdx, &straggler]
+                    {
+                        if(_stop || _abandoned[childIdx] || !_directed[childIdx].empty() || !_todo.empty())
+                        {
+                            return true;
+                        }
+                        straggler = findStraggler(childIdx);
+                        // while speculating, hold the terminating message back as long as this child may be needed
+                        return straggler != _children.size() || (_finals[childIdx] && (_speculate == 0 || !dataRunning()));
+                    };
+                    while(!haveWork())
+                    {
+                        if(_speculate == 0)
+                        {
+                            _cv.wait(lock);
+                        }
+                        else
+                        {
+                            _cv.wait_for(lock, std::chrono::milliseconds(10));   //stragglers appear without a notify
+                        }
+                    }
+                    if(_stop || _abandoned[childIdx])
+                    {
+                        return;
+                    }
+                    if(!_directed[childIdx].empty())
+                    {
+                        ex = std::move(_directed[childIdx].front());
+                        _directed[childIdx].pop_front();
+                        directed = true;
+                    }
+                    else if(!_todo.empty())   // help with the data first; the terminating message goes out last
+                    {
+                        ex = std::move(_todo.front());
+                        _todo.pop_front();
+                        _running[childIdx].ex = ex.get();
+                        _running[childIdx].start = Clock::now();
+                        _running[childIdx].copied = false;
+                    }
+                    else if(straggler != _children.size())
+                    {
+                        Running& slow = _running[straggler];
+                        ex.reset(new Exchange());
+                        ex->request.pushData(slow.ex->request.data(), slow.ex->request.size());
+                        ex->seq = slow.ex->seq;
+                        slow.copied = true;
+                        copy = true;
+                        ++_nSpeculated;
+                    }
+                    else
+                    {
+                        ex = std::move(_finals[childIdx]);
+                    }
+                }
+                bool const last = ex->last;
+                bool const dropped = !exchange(childIdx, *ex, !directed && !last);
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    _preambleDone[childIdx] += directed ? 1 : 0;
+                    if(_running[childIdx].ex != NULL)
+                    {
+                        _latencies.push_back(std::chrono::duration<double>(Clock::now() - _running[childIdx].start).count());
+                        if(_latencies.size() > LATENCY_WINDOW)
+                        {
+                            _latencies.pop_front();
+                        }
+                        _running[childIdx].ex = NULL;
+                    }
+                    if(answered(ex->seq) || (dropped && copy))
+                    {
+                        ex.reset();   // lost the race, or a failed copy; the original is still out
+                    }
+                    else if(dropped)
+                    {
+                        ex->skip = true;
+                        _dropped.push_back(ex->label);
+                        _done[ex->seq] = std::move(ex);
+                    }
+                    else
+                    {
+                        _nSpeculationWins += copy ? 1 : 0;
+                        _done[ex->seq] = std::move(ex);
+                    }
+                }
+                _cv.notify_all();
+                if(last)
+                {
+                    return;
+                }
+            }
+        }
+        catch(...)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if(!_abandoned[childIdx])   // an abandoned child was interrupted on purpose
+            {
+                _error = std::current_exception();
+            }
+            _cv.notify_all();
+        }
+    }
+
+    /**
+     * Let go of the children whose only remaining work is a message that a copy has already answered, so the end
+     * of the stream does not wait for them. Must be called with the lock held, once every terminating message is
+     * queued.
+     */
+    void abandonLosers()
+    {
+        for(size_t i = 0; i < _children.size(); ++i)
+        {
+            Running const& r = _running[i];
+            if(_finals[i] && r.ex != NULL && r.copied && answered(r.ex->seq))
+            {
+                _abandoned[i] = true;
+                _children[i]->interrupt();
+                _finals[i]->skip = true;
+                _done[_finals[i]->seq] = std::move(_finals[i]);
+            }
+        }
+    }
+
+    /**
+     * Decode the responses received so far that are next in submission order. Must be called with the lock
+     * held; the lock is released while decoding.
+     */
+    void decodeDone(std::unique_lock<std::mutex>& lock)
+    {
+        while(!_done.empty() && _done.begin()->first == _nextDecode)
+        {
+            ExchangePtr ex = std::move(_done.begin()->second);
+            _done.erase(_done.begin());
+            if(!ex->skip)
+            {
+                lock.unlock();
+                _interface.decodeResponse(ex->response);
+                lock.lock();
+            }
+            ++_nextDecode;
+            --_inFlight;
+            _free.push_back(std::move(ex));
+        }
+    }
+
+    void waitForProgress(std::unique_lock<std::mutex>& lock)
+    {
+        if(_error)
+        {
+            std::rethrow_exception(_error);
+        }
+        _cv.wait_for(lock, std::chrono::milliseconds(100));
+        if(_error)
+        {
+            std::rethrow_exception(_error);
+        }
+        Query::validateQueryPtr(_query); //are we still OK to execute the query?
+    }
+
+public:
+    /**
+     * Start one I/O thread per child.
+     * @param interface the format interface that encodes, frames and decodes messages; its writeRequest and
+     *                  readResponse are called from several threads at once
+     * @param children the processes to stream to; must outlive this object
+     * @param query the query context
+     * @param depth the number of encoded messages allowed to wait while all the children are busy
+     * @param speculate if nonzero, a child with nothing left to do takes a copy of any data message that has been
+     *                  out for more than this many times the median time; the children must be pure
+     * @param retries how many times each message may be resent to a replacement child; a data message that fails
+     *                once more is dropped
+     * @param respawn starts the replacements; required if retries is nonzero
+     */
+    Pipeline(INTERFACE& interface, std::vector<ChildProcess*> const& children, std::shared_ptr<Query> const& query, size_t depth,
+             size_t speculate = 0, size_t retries = 0, Respawn const& respawn = Respawn()):
+        _interface(interface),
+        _children(children),
+        _query(query),
+        _maxExchanges(children.size() + depth),
+        _numExchanges(0),
+        _inFlight(0),
+        _nextSeq(0),
+        _nextDecode(0),
+        _directed(children.size()),
+        _finals(children.size()),
+        _stop(false),
+        _speculate(speculate),
+        _running(children.size()),
+        _abandoned(children.size(), false),
+        _nSpeculated(0),
+        _nSpeculationWins(0),
+        _retries(respawn ? retries : 0),
+        _respawn(respawn),
+        _preambleDone(children.size(), 0),
+        _needsReplay(children.size(), false),
+        _nRestarts(0)
+    {
+        try
+        {
+            for(size_t i = 0; i < _children.size(); ++i)
+            {
+                _ioThreads.push_back(std::thread(&Pipeline::ioLoop, this, i));
+            }
+        }
+        catch(...)
+        {
+            stop();
+            throw;
+        }
+    }
+
+    /**
+     * Stop the I/O threads, abandoning any outstanding messages.
+     */
+    ~Pipeline()
+    {
+        stop();
+    }
+
+    /**
+     * Return a message to encode the next request into, decoding received responses while waiting for the queue
+     * to drain. If the previous message was not submitted, the same message is returned again.
+     */
+    Message& nextMessage()
+    {
+        if(_current)
+        {
+            return _current->request;
+        }
+        std::unique_lock<std::mutex> lock(_mutex);
+        while(true)
+        {
+            decodeDone(lock);
+            if(!_free.empty())
+            {
+                _current = std::move(_free.front());
+                _free.pop_front();
+                break;
+            }
+            if(_numExchanges < _maxExchanges)
+            {
+                _current.reset(new Exchange());
+                ++_numExchanges;
+                break;
+            }
+            waitForProgress(lock);
+        }
+        return _current->request;
+    }
+
+    /**
+     * Queue the message most recently returned by nextMessage for whichever child is free first.
+     * @param label names the message in getDropped
+     */
+    void submit(std::string const& label = std::string())
+    {
+        _current->last = false;
+        _current->label = label;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _current->seq = _nextSeq++;
+            _todo.push_back(std::move(_current));
+            ++_inFlight;
+        }
+        _cv.notify_all();
+    }
+
+    /**
+     * Queue a copy of the message most recently returned by nextMessage for every child. Used for data that each
+     * child must see, such as the side input array. Must not be called after the first submit.
+     */
+    void broadcast()
+    {
+        std::vector<ExchangePtr> copies;
+        copies.push_back(std::move(_current));
+        while(copies.size() < _children.size())
+        {
+            Message& copy = nextMessage();
+            copy.reset();
+            copy.pushData(copies[0]->request.data(), copies[0]->request.size());
+            copies.push_back(std::move(_current));
+        }
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if(_retries != 0)
+            {
+                _preamble.push_back(Message(copies[0]->request.size()));
+                _preamble.back().pushData(copies[0]->request.data(), copies[0]->request.size());
+            }
+            for(size_t i = 0; i < _children.size(); ++i)
+            {
+                copies[i]->last = false;
+                copies[i]->seq = _nextSeq++;
+                _directed[i].push_back(std::move(copies[i]));
+                ++_inFlight;
+            }
+        }
+        _cv.notify_all();
+    }
+
+    /**
+     * Send every child its terminating message, then wait for the responses to all submitted messages and
+     * decode them.
+     */
+    void finish()
+    {
+        for(size_t i = 0; i < _children.size(); ++i)
+        {
+            _interface.encodeFinal(nextMessage());
+            _current->last = true;
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _current->seq = _nextSeq++;
+                _finals[i] = std::move(_current);
+                ++_inFlight;
+            }
+            _cv.notify_all();
+        }
+        std::unique_lock<std::mutex> lock(_mutex);
+        while(true)
+        {
+            if(_speculate != 0)
+            {
+                abandonLosers();
+            }
+            decodeDone(lock);
+            if(_inFlight == 0)
+            {
+                break;
+            }
+            waitForProgress(lock);
+        }
+    }
+
+    /**
+     * @param childIdx the index of a child in the constructor argument
+     * @return true if the child was let go before its conversation ended, and must not be reused
+     */
+    bool isAbandoned(size_t childIdx)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _abandoned[childIdx];
+    }
+
+    /**
+     * @return the number of messages a spare child took a copy of, and how many times the copy answered first
+     */
+    std::pair<size_t, size_t> getSpeculationStats()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return std::make_pair(_nSpeculated, _nSpeculationWins);
+    }
+
+    /**
+     * @return the labels of the data messages that were dropped after failing on every retry, in the order they
+     *         were given up on
+     */
+    std::vector<std::string> getDropped()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _dropped;
+    }
+
+    /**
+     * @return the number of children started to replace one that went away
+     */
+    size_t getRestarts()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _nRestarts;
+    }
+
+private:
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stop = true;
+            for(size_t i = 0; i < _ioThreads.size(); ++i)
+            {
+                _children[i]->interrupt();
+            }
+        }
+        _cv.notify_all();
+        for(size_t i = 0; i < _ioThreads.size(); ++i)
+        {
+            _ioThreads[i].join();
+        }
+    }
+};
+
+} } //namespace
+
+#endif /* SRC_PIPELINE_H_ */
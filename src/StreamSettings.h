@@ -30,6 +30,7 @@
 #include <boost/lexical_cast.hpp>
 #include <query/PhysicalOperator.h>
 #include <query/OperatorParam.h>
+#include <query/TypeSystem.h>
 #include <query/Query.h>
 #include <log4cxx/logger.h>
 
@@ -56,6 +57,23 @@ static const char* const KW_FORMAT = "format";
 static const char* const KW_CHUNK_SIZE = "chunk_size";
 static const char* const KW_TYPES = "types";
 static const char* const KW_NAMES = "names";
+static const char* const KW_PIPELINE = "pipeline";
+static const char* const KW_PARALLELISM = "parallelism";
+static const char* const KW_REUSE = "reuse";
+static const char* const KW_ZYGOTE = "zygote";
+static const char* const KW_TRANSPORT = "transport";
+static const char* const KW_SHM_SIZE = "shm_size";
+static const char* const KW_KILL_TIMEOUT = "kill_timeout";
+static const char* const KW_CONNECT = "connect";
+static const char* const KW_LIBRARY = "library";
+static const char* const KW_SPECULATE = "speculate";
+static const char* const KW_RETRIES = "retries";
+static const char* const KW_MAX_CHILDREN = "max_children";
+static const char* const KW_MEMORY_LIMIT = "memory_limit";
+static const char* const KW_AFFINITY = "affinity";
+static const char* const KW_RESPONSE_WINDOW = "response_window";
+static const char* const KW_REQUEST_WINDOW = "request_window";
+static const char* const KW_NULL_TOKEN = "null_token";
 
 typedef std::shared_ptr<OperatorParamLogicalExpression> ParamType_t ;
 
@@ -63,7 +81,23 @@ typedef std::shared_ptr<OperatorParamLogicalExpression> ParamType_t ;
 {
     TSV,     // text tsv
     DF,      // R data.frame
-    FEATHER  // Apache Arrow Feather format
+    FEATHER, // Apache Arrow Feather format
+    ARROW,   // Apache Arrow IPC stream format
+    NATIVE   // columns handed to a shared library in-process
+};
+
+enum Transport
+{
+    PIPE,    // write() into the pipe
+    SPLICE,  // vmsplice() large messages into the pipe
+    SHM      // pass messages through a memory region shared with the child
+};
+
+enum Affinity
+{
+    AFFINITY_NONE,      // children inherit the CPUs of the instance
+    AFFINITY_INSTANCE,  // children run on the NUMA node the instance runs on
+    AFFINITY_SPREAD     // like AFFINITY_INSTANCE, with each child on its own core
 };
 
 class Settings
@@ -75,6 +109,23 @@ private:
     ssize_t             _outputChunkSize;
     bool				_chunkSizeSet;
     string              _command;
+    size_t              _pipelineDepth;
+    size_t              _parallelism;
+    size_t              _reuseTimeout;
+    string              _zygote;
+    Transport           _transport;
+    size_t              _shmSize;
+    int64_t             _killTimeout;
+    string              _connect;
+    string              _library;
+    size_t              _speculate;
+    size_t              _retries;
+    size_t              _maxChildren;
+    size_t              _memoryLimit;
+    Affinity            _affinity;
+    size_t              _responseWindow;
+    size_t              _requestWindow;
+    string              _nullToken;
 
 public:
     static const size_t MAX_PARAMETERS = 1;
@@ -94,28 +145,27 @@ private:
         for(size_t i =0; i<tokens.size(); ++i)
         {
             string const& t = tokens[i];
-            if(t == "int32")
-            {
-                _types.push_back(TE_INT32);
-            }
-            else if(t == "int64")
-            {
-                _types.push_back(TE_INT64);
-            }
-            else if(t == "double")
-            {
-                _types.push_back(TE_DOUBLE);
-            }
-            else if(t == "string")
-            {
-                _types.push_back(TE_STRING);
-            }
-            else if(t == "binary")
-            {
-                _types.push_back(TE_BINARY);
-            }
-            else
+            TypeEnum const te = typeId2TypeEnum(t, true);
+            switch(te)
             {
+            case TE_BOOL:
+            case TE_CHAR:
+            case TE_INT8:
+            case TE_INT16:
+            case TE_INT32:
+            case TE_INT64:
+            case TE_UINT8:
+            case TE_UINT16:
+            case TE_UINT32:
+            case TE_UINT64:
+            case TE_FLOAT:
+            case TE_DOUBLE:
+            case TE_DATETIME:
+            case TE_STRING:
+            case TE_BINARY:
+                _types.push_back(te);
+                break;
+            default:
                 throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "could not parse types";
             }
             LOG4CXX_DEBUG(logger, "stream dataframe out type " << i << " is " << t);
@@ -142,6 +192,153 @@ private:
         _outputChunkSize = res;
     }
 
+    void setParamPipeline(vector<int64_t> keys)
+    {
+        int64_t res = keys[0];
+        if(res < 0)
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "pipeline depth must not be negative";
+        }
+        _pipelineDepth = res;
+    }
+
+    void setParamParallelism(vector<int64_t> keys)
+    {
+        int64_t res = keys[0];
+        if(res < 0)
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "parallelism must not be negative";
+        }
+        _parallelism = res;
+    }
+
+    void setParamReuse(vector<int64_t> keys)
+    {
+        int64_t res = keys[0];
+        if(res < 0)
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "reuse timeout must not be negative";
+        }
+        _reuseTimeout = res;
+    }
+
+    void setParamShmSize(vector<int64_t> keys)
+    {
+        int64_t res = keys[0];
+        if(res < 64*1024)
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "shm_size must be at least 65536";
+        }
+        _shmSize = res;
+    }
+
+    void setParamKillTimeout(vector<int64_t> keys)
+    {
+        int64_t res = keys[0];
+        if(res < 0 || res > 3600*1000)
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "kill_timeout must be between 0 and 3600000 milliseconds";
+        }
+        _killTimeout = res;
+    }
+
+    void setParamConnect(vector<string> keys)
+    {
+        string const scheme = "unix:";
+        if(keys[0].compare(0, scheme.size(), scheme) != 0 || keys[0].size() == scheme.size())
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "connect must be of the form 'unix:/path/to/socket'";
+        }
+        _connect = keys[0];
+    }
+
+    void setParamLibrary(vector<string> keys)
+    {
+        if(keys[0].empty() || keys[0][0] != '/')
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "library must be an absolute path";
+        }
+        _library = keys[0];
+    }
+
+    void setParamSpeculate(vector<int64_t> keys)
+    {
+        int64_t res = keys[0];
+        if(res != 0 && res < 2)
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "speculate must be 0 or at least 2";
+        }
+        _speculate = res;
+    }
+
+    void setParamRetries(vector<int64_t> keys)
+    {
+        int64_t res = keys[0];
+        if(res < 0 || res > 100)
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "retries must be between 0 and 100";
+        }
+        _retries = res;
+    }
+
+    void setParamMaxChildren(vector<int64_t> keys)
+    {
+        int64_t res = keys[0];
+        if(res < 0 || res > 65536)
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "max_children must be between 0 and 65536";
+        }
+        _maxChildren = res;
+    }
+
+    void setParamMemoryLimit(vector<int64_t> keys)
+    {
+        int64_t res = keys[0];
+        if(res != 0 && res < 1024*1024)
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "memory_limit must be 0 or at least 1048576 bytes";
+        }
+        _memoryLimit = res;
+    }
+
+    void setParamResponseWindow(vector<int64_t> keys)
+    {
+        int64_t res = keys[0];
+        if(res != 0 && res < 65536)
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "response_window must be 0 or at least 65536 bytes";
+        }
+        _responseWindow = res;
+    }
+
+    void setParamRequestWindow(vector<int64_t> keys)
+    {
+        int64_t res = keys[0];
+        if(res < 65536)
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "request_window must be at least 65536 bytes";
+        }
+        _requestWindow = res;
+    }
+
+    void setParamNullToken(vector<string> keys)
+    {
+        if(keys[0].find_first_of("\t\n") != string::npos)
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "null_token must not contain tabs or newlines";
+        }
+        _nullToken = keys[0];
+    }
+
+    void setParamZygote(vector<string> keys)
+    {
+        if(keys[0].empty())
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "zygote command must not be empty";
+        }
+        _zygote = keys[0];
+    }
+
     void setParamFormat(vector<string> keys)
     {
         string trimmedContent = keys[0];
@@ -157,12 +354,62 @@ private:
         {
             _transferFormat = FEATHER;
         }
+        else if(trimmedContent == "arrow")
+        {
+            _transferFormat = ARROW;
+        }
+        else if(trimmedContent == "native")
+        {
+            _transferFormat = NATIVE;
+        }
         else
         {
             throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "could not parse format";
         }
     }
 
+    void setParamTransport(vector<string> keys)
+    {
+        string trimmedContent = keys[0];
+        if(trimmedContent == "pipe")
+        {
+            _transport = PIPE;
+        }
+        else if(trimmedContent == "splice")
+        {
+            _transport = SPLICE;
+        }
+        else if(trimmedContent == "shm")
+        {
+            _transport = SHM;
+        }
+        else
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "could not parse transport";
+        }
+    }
+
+    void setParamAffinity(vector<string> keys)
+    {
+        string trimmedContent = keys[0];
+        if(trimmedContent == "none")
+        {
+            _affinity = AFFINITY_NONE;
+        }
+        else if(trimmedContent == "instance")
+        {
+            _affinity = AFFINITY_INSTANCE;
+        }
+        else if(trimmedContent == "spread")
+        {
+            _affinity = AFFINITY_SPREAD;
+        }
+        else
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "could not parse affinity";
+        }
+    }
+
     void setKeywordParamString(KeywordParameters const& kwParams, const char* const kw, bool& alreadySet, void (Settings::* innersetter)(vector<string>) )
     {
         checkIfSet(alreadySet, kw);
@@ -270,11 +517,42 @@ public:
                  _transferFormat(TSV),
                  _types(0),
                  _outputChunkSize(1024*1024*1024),
-                 _chunkSizeSet(false)
+                 _chunkSizeSet(false),
+                 _pipelineDepth(0),
+                 _parallelism(1),
+                 _reuseTimeout(0),
+                 _transport(PIPE),
+                 _shmSize(64*1024*1024),
+                 _killTimeout(500),
+                 _speculate(0),
+                 _retries(0),
+                 _maxChildren(0),
+                 _memoryLimit(0),
+                 _affinity(AFFINITY_NONE),
+                 _responseWindow(0),
+                 _requestWindow(64*1024*1024),
+                 _nullToken("\\N")
      {
         bool formatSet    = false;
         bool typesSet     = false;
         bool namesSet     = false;
+        bool pipelineSet  = false;
+        bool parallelismSet = false;
+        bool reuseSet     = false;
+        bool zygoteSet    = false;
+        bool transportSet = false;
+        bool shmSizeSet   = false;
+        bool killTimeoutSet = false;
+        bool connectSet   = false;
+        bool librarySet   = false;
+        bool speculateSet = false;
+        bool retriesSet   = false;
+        bool maxChildrenSet = false;
+        bool memoryLimitSet = false;
+        bool affinitySet  = false;
+        bool responseWindowSet = false;
+        bool requestWindowSet = false;
+        bool nullTokenSet = false;
         size_t const nParams = operatorParameters.size();
 
         if (nParams > MAX_PARAMETERS)
@@ -288,7 +566,43 @@ public:
         setKeywordParamString(kwParams, KW_FORMAT, formatSet, &Settings::setParamFormat);
         setKeywordParamString(kwParams, KW_TYPES, typesSet, &Settings::setParamDfTypes);
         setKeywordParamString(kwParams, KW_NAMES, namesSet, &Settings::setParamDfNames);
-
+        setKeywordParamInt64(kwParams, KW_PIPELINE, pipelineSet, &Settings::setParamPipeline);
+        setKeywordParamInt64(kwParams, KW_PARALLELISM, parallelismSet, &Settings::setParamParallelism);
+        setKeywordParamInt64(kwParams, KW_REUSE, reuseSet, &Settings::setParamReuse);
+        setKeywordParamString(kwParams, KW_ZYGOTE, zygoteSet, &Settings::setParamZygote);
+        setKeywordParamString(kwParams, KW_TRANSPORT, transportSet, &Settings::setParamTransport);
+        setKeywordParamInt64(kwParams, KW_SHM_SIZE, shmSizeSet, &Settings::setParamShmSize);
+        setKeywordParamInt64(kwParams, KW_KILL_TIMEOUT, killTimeoutSet, &Settings::setParamKillTimeout);
+        setKeywordParamString(kwParams, KW_CONNECT, connectSet, &Settings::setParamConnect);
+        setKeywordParamString(kwParams, KW_LIBRARY, librarySet, &Settings::setParamLibrary);
+        setKeywordParamInt64(kwParams, KW_SPECULATE, speculateSet, &Settings::setParamSpeculate);
+        setKeywordParamInt64(kwParams, KW_RETRIES, retriesSet, &Settings::setParamRetries);
+        setKeywordParamInt64(kwParams, KW_MAX_CHILDREN, maxChildrenSet, &Settings::setParamMaxChildren);
+        setKeywordParamInt64(kwParams, KW_MEMORY_LIMIT, memoryLimitSet, &Settings::setParamMemoryLimit);
+        setKeywordParamString(kwParams, KW_AFFINITY, affinitySet, &Settings::setParamAffinity);
+        setKeywordParamInt64(kwParams, KW_RESPONSE_WINDOW, responseWindowSet, &Settings::setParamResponseWindow);
+        setKeywordParamInt64(kwParams, KW_REQUEST_WINDOW, requestWindowSet, &Settings::setParamRequestWindow);
+        setKeywordParamString(kwParams, KW_NULL_TOKEN, nullTokenSet, &Settings::setParamNullToken);
+        if(connectSet && (zygoteSet || _transport != PIPE))
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "connect does not combine with zygote or transport";
+        }
+        if(connectSet && (maxChildrenSet || memoryLimitSet || _affinity != AFFINITY_NONE))
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "connect does not combine with max_children, memory_limit or affinity";
+        }
+        if(nullTokenSet && _transferFormat != TSV)
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "null_token is only for format:'tsv'";
+        }
+        if(librarySet != (_transferFormat == NATIVE))
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "format:'native' and library go together";
+        }
+        if(librarySet && (connectSet || zygoteSet))
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "library does not combine with connect or zygote";
+        }
     }
 
     TransferFormat getFormat() const
@@ -321,6 +635,141 @@ public:
         return _command;
     }
 
+    /**
+     * @return the number of encoded chunks that may wait while the child is busy; 0 means strict lockstep
+     */
+    size_t getPipelineDepth() const
+    {
+        return _pipelineDepth;
+    }
+
+    /**
+     * @return the number of children to run on each instance; 0 means pick automatically
+     */
+    size_t getParallelism() const
+    {
+        return _parallelism;
+    }
+
+    /**
+     * @return the number of seconds a child may wait idle for the next query; 0 means the child is not reused
+     */
+    size_t getReuseTimeout() const
+    {
+        return _reuseTimeout;
+    }
+
+    /**
+     * @return the command that starts the zygote to fork children from; empty if children are started with bash
+     */
+    string const& getZygote() const
+    {
+        return _zygote;
+    }
+
+    Transport getTransport() const
+    {
+        return _transport;
+    }
+
+    /**
+     * @return the size in bytes of the memory region shared with each child when the transport is shm; half of it
+     *         holds the current request and half the current response
+     */
+    size_t getShmSize() const
+    {
+        return _shmSize;
+    }
+
+    /**
+     * @return the number of milliseconds a child gets to exit after SIGTERM before it is sent SIGKILL
+     */
+    int64_t getKillTimeout() const
+    {
+        return _killTimeout;
+    }
+
+    /**
+     * @return the server to connect to instead of starting the command, as 'unix:/path/to/socket'; empty if the
+     *         command is started
+     */
+    string const& getConnect() const
+    {
+        return _connect;
+    }
+
+    /**
+     * @return the path of the shared library to load with format:'native'; empty for the other formats
+     */
+    string const& getLibrary() const
+    {
+        return _library;
+    }
+
+    /**
+     * @return how many times longer than the median a chunk may take before a spare child is given a copy of it;
+     *         0 means the children are not declared pure and chunks are never copied
+     */
+    size_t getSpeculate() const
+    {
+        return _speculate;
+    }
+
+    /**
+     * @return how many times a message may be resent to a fresh child after the child it was sent to went away
+     */
+    size_t getRetries() const
+    {
+        return _retries;
+    }
+
+    /**
+     * @return the most children that may run at once on the host, counting those of other queries; 0 for no limit
+     */
+    size_t getMaxChildren() const
+    {
+        return _maxChildren;
+    }
+
+    /**
+     * @return the most address space in bytes each child may use; 0 for no limit
+     */
+    size_t getMemoryLimit() const
+    {
+        return _memoryLimit;
+    }
+
+    Affinity getAffinity() const
+    {
+        return _affinity;
+    }
+
+    /**
+     * @return about how many bytes of a response are held in memory at a time, when the responses are decoded as
+     *         they arrive
+     */
+    size_t getResponseWindow() const
+    {
+        return _responseWindow;
+    }
+
+    /**
+     * @return about how many bytes of a request are encoded at a time, when the requests are written as they are
+     *         encoded
+     */
+    size_t getRequestWindow() const
+    {
+        return _requestWindow;
+    }
+
+    /**
+     * @return the text that stands for a null in TSV, both ways
+     */
+    string const& getNullToken() const
+    {
+        return _nullToken;
+    }
+
 };
 
 } }
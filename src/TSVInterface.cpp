@@ -27,9 +27,18 @@
 #include "ChildProcess.h"
 #include <vector>
 #include <string>
+#include <cmath>
+#include <limits>
+#include <ctype.h>
+#include <strings.h>
+#include <time.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "TSVInterface.h"
 #include <array/MemArray.h>
 #include <query/Query.h>
+#include "../extern/ryu/ryu.h"
 
 using std::vector;
 using std::shared_ptr;
@@ -37,15 +46,466 @@ using std::string;
 
 namespace scidb { namespace stream {
 
+/**
+ * Room enough for any number, coordinate or datetime formatted by the helpers below.
+ */
+static size_t const MAX_NUMBER_CHARS = 32;
+
+template <typename T>
+static T load(char const* value)
+{
+    T res;
+    memcpy(&res, value, sizeof(T));
+    return res;
+}
+
+/**
+ * Write the decimal digits of v at dst.
+ * @return the end of what was written
+ */
+static char* formatUnsigned(char* dst, uint64_t v)
+{
+    char digits[20];
+    char* p = digits + sizeof(digits);
+    do
+    {
+        *--p = (char) ('0' + v % 10);
+        v /= 10;
+    } while(v != 0);
+    size_t const n = digits + sizeof(digits) - p;
+    memcpy(dst, p, n);
+    return dst + n;
+}
+
+static char* formatSigned(char* dst, int64_t v)
+{
+    if(v < 0)
+    {
+        *dst++ = '-';
+        return formatUnsigned(dst, 0 - (uint64_t) v);
+    }
+    return formatUnsigned(dst, (uint64_t) v);
+}
+
+/**
+ * Write digits * 10^exponent, laid out like printf's %g at the given precision but without padding the digits:
+ * in scientific notation when the decimal exponent is below -4 or at least precision, in plain notation otherwise.
+ * @return the end of what was written
+ */
+static char* formatDecimal(char* dst, bool negative, uint64_t digits, int32_t exponent, int precision)
+{
+    char buf[20];
+    char* const bufEnd = buf + sizeof(buf);
+    char* p = bufEnd;
+    do
+    {
+        *--p = (char) ('0' + digits % 10);
+        digits /= 10;
+    } while(digits != 0);
+    int32_t const n = (int32_t) (bufEnd - p);
+    int32_t const point = exponent + n;     //digits before the decimal point
+    if(negative)
+    {
+        *dst++ = '-';
+    }
+    if(point - 1 < -4 || point - 1 >= precision)
+    {
+        *dst++ = *p++;
+        if(n > 1)
+        {
+            *dst++ = '.';
+            memcpy(dst, p, n - 1);
+            dst += n - 1;
+        }
+        int32_t e = point - 1;
+        *dst++ = 'e';
+        *dst++ = e < 0 ? '-' : '+';
+        e = e < 0 ? -e : e;
+        if(e < 10)
+        {
+            *dst++ = '0';
+        }
+        return formatUnsigned(dst, (uint64_t) e);
+    }
+    if(exponent >= 0)
+    {
+        memcpy(dst, p, n);
+        memset(dst + n, '0', exponent);
+        return dst + point;
+    }
+    if(point > 0)
+    {
+        memcpy(dst, p, point);
+        dst[point] = '.';
+        memcpy(dst + point + 1, p + point, n - point);
+        return dst + n + 1;
+    }
+    *dst++ = '0';
+    *dst++ = '.';
+    memset(dst, '0', -point);
+    memcpy(dst - point, p, n);
+    return dst - point + n;
+}
+
+/**
+ * Write the shortest text that reads back as v (found with Ryu), laid out like %.17g; integers below 2^53 are
+ * written as integers.
+ * @return the end of what was written
+ */
+static char* formatReal(char* dst, double v)
+{
+    if(std::fabs(v) < 9007199254740992.0 && v == (double) (int64_t) v && !(v == 0 && std::signbit(v)))
+    {
+        return formatSigned(dst, (int64_t) v);
+    }
+    uint64_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    bool const negative = (bits >> 63) != 0;
+    uint64_t const mantissa = bits & ((1ull << DOUBLE_MANTISSA_BITS) - 1);
+    uint32_t const exponent = (uint32_t) ((bits >> DOUBLE_MANTISSA_BITS) & ((1u << DOUBLE_EXPONENT_BITS) - 1));
+    if(exponent == (1u << DOUBLE_EXPONENT_BITS) - 1 || (exponent == 0 && mantissa == 0))
+    {
+        return dst + snprintf(dst, MAX_NUMBER_CHARS, "%g", v);    //infinity or -0
+    }
+    floating_decimal_64 const d = d2d(mantissa, exponent);
+    return formatDecimal(dst, negative, d.mantissa, d.exponent, std::numeric_limits<double>::max_digits10);
+}
+
+/**
+ * Write the shortest text that reads back as v (found with Ryu), laid out like %.9g; integers below 10^9 are
+ * written as integers.
+ * @return the end of what was written
+ */
+static char* formatReal(char* dst, float v)
+{
+    if(std::fabs(v) < 1e9f && v == (float) (int64_t) v && !(v == 0 && std::signbit(v)))
+    {
+        return formatSigned(dst, (int64_t) v);
+    }
+    uint32_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    bool const negative = (bits >> 31) != 0;
+    uint32_t const mantissa = bits & ((1u << FLOAT_MANTISSA_BITS) - 1);
+    uint32_t const exponent = (bits >> FLOAT_MANTISSA_BITS) & ((1u << FLOAT_EXPONENT_BITS) - 1);
+    if(exponent == (1u << FLOAT_EXPONENT_BITS) - 1 || (exponent == 0 && mantissa == 0))
+    {
+        return dst + snprintf(dst, MAX_NUMBER_CHARS, "%g", (double) v);
+    }
+    floating_decimal_32 const d = f2d(mantissa, exponent);
+    return formatDecimal(dst, negative, d.mantissa, d.exponent, std::numeric_limits<float>::max_digits10);
+}
+
+/**
+ * Write a datetime the way SciDB's converter to string does.
+ * @return the end of what was written
+ */
+static char* formatDatetime(char* dst, int64_t seconds)
+{
+    time_t const t = (time_t) seconds;
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    return dst + strftime(dst, MAX_NUMBER_CHARS, "%Y-%m-%d %H:%M:%S", &tm);
+}
+
+/**
+ * @return the first character in [s, end) that TSV escapes, or end; 16 characters at a time where SSE2 is there
+ */
+static char const* findEscape(char const* s, char const* end)
+{
+#ifdef __SSE2__
+    __m128i const tab = _mm_set1_epi8('\t');
+    __m128i const nl  = _mm_set1_epi8('\n');
+    __m128i const cr  = _mm_set1_epi8('\r');
+    __m128i const bs  = _mm_set1_epi8('\\');
+    for(; end - s >= 16; s += 16)
+    {
+        __m128i const v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(s));
+        __m128i const hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, tab), _mm_cmpeq_epi8(v, nl)),
+                                         _mm_or_si128(_mm_cmpeq_epi8(v, cr),  _mm_cmpeq_epi8(v, bs)));
+        int const mask = _mm_movemask_epi8(hit);
+        if(mask != 0)
+        {
+            return s + __builtin_ctz(mask);
+        }
+    }
+#endif
+    for(; s != end; ++s)
+    {
+        char const c = *s;
+        if(c == '\t' || c == '\n' || c == '\r' || c == '\\')
+        {
+            return s;
+        }
+    }
+    return end;
+}
+
+/**
+ * Count the lines in buf from begin up to size, or until the total reaches maxLines; 64 bytes at a time where SSE2
+ * is there.
+ * @param lines the lines counted so far, incremented by the lines found
+ * @param lineEnd set just past the last newline found, if any
+ * @return where counting stopped: size, or just past the newline that made maxLines
+ */
+static size_t countLines(char const* buf, size_t begin, size_t size, int64_t& lines, int64_t maxLines, size_t& lineEnd)
+{
+    size_t i = begin;
+#ifdef __SSE2__
+    __m128i const nl = _mm_set1_epi8('\n');
+    for(; size - i >= 64 && lines < maxLines; i += 64)
+    {
+        uint64_t mask = 0;
+        for(size_t k = 0; k < 4; ++k)
+        {
+            __m128i const v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(buf + i + 16 * k));
+            mask |= (uint64_t) (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(v, nl)) << (16 * k);
+        }
+        if(mask == 0)
+        {
+            continue;
+        }
+        int64_t const n = __builtin_popcountll(mask);
+        if(lines + n >= maxLines)
+        {
+            break;   // the last line ends in these 64 bytes
+        }
+        lines  += n;
+        lineEnd = i + 64 - __builtin_clzll(mask);
+    }
+#endif
+    for(; i < size && lines < maxLines; ++i)
+    {
+        if(buf[i] == '\n')
+        {
+            ++lines;
+            lineEnd = i + 1;
+        }
+    }
+    return i;
+}
+
+/**
+ * Parse the line count that starts a TSV message.
+ * @return the count
+ * @throw if the data does not start with a count and a newline
+ */
+static int64_t parseLineCount(char const* buf, size_t size)
+{
+    char const* nl = static_cast<char const*>(memchr(buf, '\n', size));
+    if(nl == NULL)
+    {
+        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "TSV header provided by child did not contain a newline";
+    }
+    char* end = const_cast<char*>(buf);
+    errno = 0;
+    int64_t const res = strtoll(buf, &end, 10);
+    if(end != nl || errno !=0 || res < 0)
+    {
+        LOG4CXX_DEBUG(logger, "Got this stuff "<<string(buf, size));
+        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "child provided invalid number of lines";
+    }
+    return res;
+}
+
+/**
+ * Write the string [s, end) at dst with tabs, newlines, carriage returns and backslashes escaped. The runs in
+ * between are copied whole.
+ * @return the end of what was written, no more than 2 * (end - s) past dst
+ */
+static char* escapeString(char* dst, char const* s, char const* end)
+{
+    while(true)
+    {
+        char const* run = findEscape(s, end);
+        memcpy(dst, s, run - s);
+        dst += run - s;
+        if(run == end)
+        {
+            return dst;
+        }
+        *dst++ = '\\';
+        switch(*run)
+        {
+        case '\t': *dst++ = 't';  break;
+        case '\n': *dst++ = 'n';  break;
+        case '\r': *dst++ = 'r';  break;
+        default:   *dst++ = '\\'; break;
+        }
+        s = run + 1;
+    }
+}
+
+/**
+ * Parse [s, end) as a decimal integer that fits T, with an optional sign.
+ * @return false if it is not one
+ */
+template <typename T>
+static bool parseInteger(char const* s, char const* end, T& out)
+{
+    bool const negative = s != end && *s == '-';
+    if(s != end && (*s == '-' || *s == '+'))
+    {
+        ++s;
+    }
+    if(s == end)
+    {
+        return false;
+    }
+    uint64_t v = 0;
+    for(; s != end; ++s)
+    {
+        unsigned const d = (unsigned char) *s - '0';
+        if(d > 9 || v > (std::numeric_limits<uint64_t>::max() - d) / 10)
+        {
+            return false;
+        }
+        v = v * 10 + d;
+    }
+    if(!negative)
+    {
+        if(v > (uint64_t) std::numeric_limits<T>::max())
+        {
+            return false;
+        }
+        out = (T) v;
+    }
+    else if(v == 0)
+    {
+        out = 0;
+    }
+    else
+    {
+        if(!std::numeric_limits<T>::is_signed || v - 1 > (uint64_t) std::numeric_limits<T>::max())
+        {
+            return false;
+        }
+        out = (T) (-(int64_t) (v - 1) - 1);
+    }
+    return true;
+}
+
+/**
+ * Parse [s, s+n) as n decimal digits.
+ * @return false if they are not
+ */
+static bool parseDigits(char const* s, size_t n, unsigned& out)
+{
+    out = 0;
+    for(size_t k = 0; k < n; ++k)
+    {
+        unsigned const d = (unsigned char) s[k] - '0';
+        if(d > 9)
+        {
+            return false;
+        }
+        out = out * 10 + d;
+    }
+    return true;
+}
+
+/**
+ * Parse a datetime as written by formatDatetime, YYYY-MM-DD HH:MM:SS, or a date alone, or seconds since 1970.
+ * @return false if it is none of these
+ */
+static bool parseDatetime(char const* s, char const* end, int64_t& out)
+{
+    if(parseInteger(s, end, out))
+    {
+        return true;
+    }
+    size_t const n = end - s;
+    unsigned y, m, d, hh = 0, mm = 0, ss = 0;
+    if((n != 10 && n != 19) || s[4] != '-' || s[7] != '-' ||
+       !parseDigits(s, 4, y) || !parseDigits(s + 5, 2, m) || !parseDigits(s + 8, 2, d) ||
+       m < 1 || m > 12 || d < 1 || d > 31)
+    {
+        return false;
+    }
+    if(n == 19 && ((s[10] != ' ' && s[10] != 'T') || s[13] != ':' || s[16] != ':' ||
+                   !parseDigits(s + 11, 2, hh) || !parseDigits(s + 14, 2, mm) || !parseDigits(s + 17, 2, ss) ||
+                   hh > 23 || mm > 59 || ss > 60))
+    {
+        return false;
+    }
+    // Days since 1970 of a date in the proleptic Gregorian calendar
+    int64_t const year = (int64_t) y - (m <= 2);
+    int64_t const era = (year >= 0 ? year : year - 399) / 400;
+    unsigned const yoe = (unsigned) (year - era * 400);
+    unsigned const doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    unsigned const doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    int64_t const days = era * 146097 + (int64_t) doe - 719468;
+    out = days * 86400 + hh * 3600 + mm * 60 + ss;
+    return true;
+}
+
+/**
+ * Undo escapeString: write [s, end) at dst with \t, \n, \r and \\ turned back into the characters. Any other
+ * backslash is kept as it is.
+ * @return the end of what was written, no more than end - s past dst
+ */
+static char* unescapeString(char* dst, char const* s, char const* end)
+{
+    while(true)
+    {
+        char const* bs = static_cast<char const*>(memchr(s, '\\', end - s));
+        if(bs == NULL || bs + 1 == end)
+        {
+            memcpy(dst, s, end - s);
+            return dst + (end - s);
+        }
+        memcpy(dst, s, bs - s);
+        dst += bs - s;
+        switch(bs[1])
+        {
+        case 't':  *dst++ = '\t';  break;
+        case 'n':  *dst++ = '\n';  break;
+        case 'r':  *dst++ = '\r';  break;
+        case '\\': *dst++ = '\\'; break;
+        default:   *dst++ = '\\'; *dst++ = bs[1];
+        }
+        s = bs + 2;
+    }
+}
+
 ArrayDesc TSVInterface::getOutputSchema(vector<ArrayDesc> const& inputSchemas, Settings const& settings, shared_ptr<Query> const& query)
 {
     if(settings.getFormat() != TSV)
     {
         throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "TSV interface invoked on improper format";
     }
-    if(settings.getTypes().size())
+    Dimensions outputDimensions;
+    outputDimensions.push_back(DimensionDesc("instance_id", 0,   query->getInstancesCount()-1, 1, 0));
+    outputDimensions.push_back(DimensionDesc("chunk_no",    0,   CoordinateBounds::getMax(),   1, 0));
+    Attributes outputAttributes;
+    vector<TypeEnum> const& outputTypes = settings.getTypes();
+    if(outputTypes.size())
     {
-        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "TSV interface does not support the types parameter";
+        // Typed: every line of a response becomes a cell, like a data frame
+        vector<string> outputNames = settings.getNames();
+        if(outputNames.size() == 0)
+        {
+            for(size_t i =0; i<outputTypes.size(); ++i)
+            {
+                ostringstream name;
+                name << "a" << i;
+                outputNames.push_back(name.str());
+            }
+        }
+        else if (outputNames.size() != outputTypes.size())
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "received inconsistent names and types";
+        }
+        outputDimensions.push_back(DimensionDesc("value_no",  0,   CoordinateBounds::getMax(),   settings.getChunkSize(), 0));
+        for(size_t i =0; i<outputTypes.size(); ++i)
+        {
+            if(outputTypes[i] == TE_BINARY)
+            {
+                throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "TSV interface does not support binary output";
+            }
+            outputAttributes.push_back(AttributeDesc(outputNames[i], typeEnum2TypeId(outputTypes[i]), AttributeDesc::IS_NULLABLE, CompressorType::NONE));
+        }
+        outputAttributes.addEmptyTagAttribute();
+        return ArrayDesc(inputSchemas[0].getName(), outputAttributes, outputDimensions, createDistribution(defaultDistType()), query->getDefaultArrayResidency());
     }
     if(settings.isChunkSizeSet())
     {
@@ -53,12 +513,8 @@ ArrayDesc TSVInterface::getOutputSchema(vector<ArrayDesc> const& inputSchemas, S
     }
     if(settings.getNames().size() > 1)
     {
-        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "TSV interface supports only one result name";
+        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "TSV interface supports only one result name without types";
     }
-    Dimensions outputDimensions;
-    outputDimensions.push_back(DimensionDesc("instance_id", 0,   query->getInstancesCount()-1, 1, 0));
-    outputDimensions.push_back(DimensionDesc("chunk_no",    0,   CoordinateBounds::getMax(),   1, 0));
-    Attributes outputAttributes;
     outputAttributes.push_back( AttributeDesc(settings.getNames().size() ? settings.getNames()[0] : "response",   TID_STRING,    0, CompressorType::NONE));
     outputAttributes.addEmptyTagAttribute();
     return ArrayDesc(inputSchemas[0].getName(), outputAttributes, outputDimensions, createDistribution(defaultDistType()), query->getDefaultArrayResidency());
@@ -68,19 +524,38 @@ TSVInterface::TSVInterface(Settings const& settings, ArrayDesc const& outputSche
     _attDelim(  '\t'),
     _lineDelim( '\n'),
     _printCoords(false),
+    _responseWindow(settings.getResponseWindow()),
+    _requestWindow(settings.getRequestWindow()),
+    _streamRequests(settings.getTransport() == PIPE),
+    _typed(settings.getTypes().size() != 0),
     _nanRepresentation("nan"),
-    _nullRepresentation("\\N"),
+    _nullRepresentation(settings.getNullToken()),
     _query(query),
     _result(new MemArray(outputSchema, query)),
-    _aiter(_result->getIterator(outputSchema.getAttributes(true).firstDataAttribute())),
-    _outPos{ ((Coordinate) _query->getInstanceID()), 0}
-{}
+    _outPos{ ((Coordinate) _query->getInstanceID()), 0},
+    _outputTypes(settings.getTypes()),
+    _outputChunkSize(settings.getChunkSize()),
+    _numLines(0)
+{
+    for (const auto& attr : outputSchema.getAttributes(true))
+    {
+        _aiters.push_back(_result->getIterator(attr));
+    }
+    if(_typed)
+    {
+        _outPos.push_back(0);
+        _ociters.resize(_aiters.size());
+    }
+    _nullVal.setNull();
+}
 
 void TSVInterface::setInputSchema(ArrayDesc const& inputSchema)
 {
     Attributes const& attrs = inputSchema.getAttributes(true);
     _inputTypes.resize(attrs.size());
     _inputConverters.resize(attrs.size());
+    _inputNullable.resize(attrs.size());
+    _inputColumns.resize(attrs.size());
 //    for(size_t i=0; i<_inputTypes.size(); ++i)
     size_t i = 0;
     for (const auto& attr : attrs)
@@ -89,11 +564,20 @@ void TSVInterface::setInputSchema(ArrayDesc const& inputSchema)
         _inputTypes[i] = typeId2TypeEnum(inputType, true);
         switch(_inputTypes[i])
         {
+        case TE_STRING:
         case TE_BOOL:
+        case TE_CHAR:
         case TE_DOUBLE:
         case TE_FLOAT:
-        case TE_UINT8:
         case TE_INT8:
+        case TE_INT16:
+        case TE_INT32:
+        case TE_INT64:
+        case TE_UINT8:
+        case TE_UINT16:
+        case TE_UINT32:
+        case TE_UINT64:
+        case TE_DATETIME:
             _inputConverters[i] = NULL;
             break;
         default:
@@ -102,270 +586,491 @@ void TSVInterface::setInputSchema(ArrayDesc const& inputSchema)
                 TID_STRING,
                 false);
         }
+        _inputNullable[i] = attr.isNullable();
         i++;
     }
 }
 
 void TSVInterface::streamData(std::vector<ConstChunk const*> const& inputChunks, ChildProcess& child)
 {
-    if(inputChunks.size() != _inputTypes.size())
-    {
-        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "received inconsistent number of input chunks";
-    }
-    if(inputChunks[0]->count() == 0)
+    if(!encodeData(inputChunks, _writeMsg, _streamRequests ? &child : NULL))
     {
         return;
     }
-    if(!child.isAlive())
+    if(!_streamRequests)
     {
-        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "child exited early";
+        if(!child.isAlive())
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "child exited early";
+        }
+        writeRequest(child, _writeMsg);
     }
-    vector<shared_ptr<ConstChunkIterator> > citers(inputChunks.size());
-    size_t nCells;
-    string output;
-    for(size_t i =0, n= _inputTypes.size(); i<n; ++i)
+    streamResponse(child, false);
+}
+
+shared_ptr<Array> TSVInterface::finalize(ChildProcess& child)
+{
+    encodeFinal(_writeMsg);
+    writeRequest(child, _writeMsg);
+    streamResponse(child, true);
+    return getResult();
+}
+
+shared_ptr<Array> TSVInterface::getResult()
+{
+    _ociters.clear();
+    _aiters.clear();
+    return _result;
+}
+
+bool TSVInterface::encodeData(std::vector<ConstChunk const*> const& inputChunks, Message& message)
+{
+    return encodeData(inputChunks, message, NULL);
+}
+
+bool TSVInterface::encodeData(std::vector<ConstChunk const*> const& inputChunks, Message& message, ChildProcess* child)
+{
+    if(inputChunks.size() != _inputTypes.size())
     {
-        citers[i] = inputChunks[i]->getConstIterator(ConstChunkIterator::IGNORE_OVERLAPS);
+        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "received inconsistent number of input chunks";
     }
-    convertChunks(citers, nCells, output);
-    writeTSV(nCells, output, child);
-    readTSV(output, child);
-    if(output.size() > MAX_RESPONSE_SIZE)
+    if(inputChunks[0]->count() == 0)
     {
-        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "response from child exceeds maximum size";
+        return false;
     }
-    if(output.size())
+    if(child != NULL && !child->isAlive())
     {
-        output.resize(output.size()-1);
-        addChunkToArray(output);
+        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "child exited early";
     }
+    message.reset();
+    encodeChunks(inputChunks, message, child);
+    return true;
 }
 
-shared_ptr<Array> TSVInterface::finalize(ChildProcess& child)
+void TSVInterface::encodeFinal(Message& message)
+{
+    message.reset();
+    message.pushData("0\n", 2);
+}
+
+void TSVInterface::writeRequest(ChildProcess& child, Message const& message)
 {
-    writeTSV(0, "", child);
-    string output;
-    readTSV(output, child, true);
-    if(output.size() > MAX_RESPONSE_SIZE)
+    child.hardWrite(message.data(), message.size());
+}
+
+void TSVInterface::encodeChunks(vector<ConstChunk const*> const& chunks, Message& message, ChildProcess* child)
+{
+    int64_t const numRows = chunks[0]->count();
+    char hdr[64];
+    snprintf(hdr, sizeof(hdr), "%ld\n", numRows);
+    message.pushData(hdr, strlen(hdr));
+
+    // Types the child gets in SciDB's own text form are converted while the columns are laid out
+    for(size_t i = 0, n = chunks.size(); i < n; ++i)
     {
-        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "response from child exceeds maximum size";
+        _inputColumns[i].begin(*chunks[i], _inputTypes[i], _inputConverters[i], _inputNullable[i], numRows);
     }
-    if(output.size())
+    shared_ptr<ConstChunkIterator> posIter;
+    if(_printCoords)
     {
-        output.resize(output.size()-1);
-        addChunkToArray(output);
+        posIter = chunks[0]->getConstIterator(ConstChunkIterator::IGNORE_OVERLAPS);
+    }
+    int64_t const sliceRows = ChunkColumn<>::sliceRows(chunks, _requestWindow);
+    for(int64_t done = 0; done < numRows; )
+    {
+        int64_t rows = 0;
+        for(size_t i = 0, n = chunks.size(); i < n; ++i)
+        {
+            rows = _inputColumns[i].next(sliceRows);
+        }
+        convertRows(chunks.size(), rows, posIter.get(), message);
+        done += rows;
+        LOG4CXX_DEBUG(logger, "Encoded "<< done << " of " << numRows << " lines");
+        if(child != NULL)
+        {
+            writeRequest(*child, message);
+            message.reset();
+        }
     }
-    _aiter.reset();
-    return _result;
 }
 
-
-void TSVInterface::convertChunks(vector< shared_ptr<ConstChunkIterator> > citers, size_t &nCells, string& output)
+void TSVInterface::convertRows(size_t nColumns, int64_t numRows, ConstChunkIterator* posIter, Message& message)
 {
-    Value stringVal;
-    nCells = 0;
-    ostringstream outputBuf;
-    while(!citers[0]->end())
+    for(int64_t j = 0; j < numRows; ++j)
     {
         if(_printCoords)
         {
-            Coordinates const& pos = citers[0]->getPosition();
+            Coordinates const& pos = posIter->getPosition();
+            char* dst = message.reserve(pos.size() * MAX_NUMBER_CHARS);
+            char* const start = dst;
             for(size_t i =0, n=pos.size(); i<n; ++i)
             {
                 if(i)
                 {
-                    outputBuf<<_attDelim;
+                    *dst++ = _attDelim;
                 }
-                outputBuf<<pos[i];
+                dst = formatSigned(dst, pos[i]);
             }
+            message.shrink(pos.size() * MAX_NUMBER_CHARS - (dst - start));
+            ++(*posIter);
         }
-        for (size_t i = 0, n=citers.size(); i < n; ++i)
+        for (size_t i = 0; i < nColumns; ++i)
         {
-            Value const& v = citers[i]->getItem();
+            ChunkColumn<> const& column = _inputColumns[i];
             if (i || _printCoords)
             {
-                outputBuf<<_attDelim;
+                message.pushData(&_attDelim, 1);
             }
-            if(v.isNull())
+            if(column.isNull(j))
             {
-                outputBuf<<_nullRepresentation; //TODO: note all missing codes are converted to this representation
+                message.pushData(_nullRepresentation.data(), _nullRepresentation.size()); //TODO: note all missing codes are converted to this representation
+                continue;
             }
-            else
+            if(_inputConverters[i] != NULL)
+            {
+                message.pushData(column.values() + column.offsets()[j], column.offsets()[j + 1] - column.offsets()[j]);
+                continue;
+            }
+            if(_inputTypes[i] == TE_STRING)
             {
-                switch(_inputTypes[i])
+                char const* s   = column.values() + column.offsets()[j];
+                size_t const size = column.offsets()[j + 1] - column.offsets()[j];
+                char* dst = message.reserve(2 * size);   // every character escaped, at worst
+                message.shrink(2 * size - (escapeString(dst, s, s + size) - dst));
+                continue;
+            }
+            char const* value = column.values() + j * ChunkColumn<>::width(_inputTypes[i]);
+            char* const dst = message.reserve(MAX_NUMBER_CHARS);
+            char* end = dst;
+            switch(_inputTypes[i])
+            {
+            case TE_BOOL:
+                if(*value)
+                {
+                    memcpy(dst, "true", 4);
+                    end = dst + 4;
+                }
+                else
                 {
-                case TE_STRING:
+                    memcpy(dst, "false", 5);
+                    end = dst + 5;
+                }
+                break;
+            case TE_CHAR:
+                if(*value)
+                {
+                    *end++ = *value;
+                }
+                break;
+            case TE_DOUBLE:
+            case TE_FLOAT:
+                {
+                    bool nan;
+                    if(_inputTypes[i] == TE_DOUBLE)
                     {
-                        char const* s = v.getString();
-                        while (char c = *s++)
+                        double nbr;
+                        memcpy(&nbr, value, sizeof(double));
+                        nan = std::isnan(nbr);
+                        if(!nan)
                         {
-                            if (c == '\n')
-                            {
-                                outputBuf << "\\n";
-                            }
-                            else if (c == '\t')
-                            {
-                                outputBuf << "\\t";
-                            }
-                            else if (c == '\r')
-                            {
-                                outputBuf << "\\r";
-                            }
-                            else if (c == '\\')
-                            {
-                                outputBuf << "\\\\";
-                            }
-                            else
-                            {
-                                outputBuf << c;
-                            }
+                            end = formatReal(dst, nbr);
                         }
                     }
-                    break;
-                case TE_BOOL:
-                    if(v.getBool())
-                    {
-                        outputBuf<<"true";
-                    }
                     else
                     {
-                        outputBuf<<"false";
-                    }
-                    break;
-                case TE_DOUBLE:
-                    {
-                        double nbr =v.getDouble();
-                        if(std::isnan(nbr))
-                        {
-                            outputBuf<<_nanRepresentation;
-                        }
-                        else
+                        float nbr;
+                        memcpy(&nbr, value, sizeof(float));
+                        nan = std::isnan(nbr);
+                        if(!nan)
                         {
-                            outputBuf.precision(std::numeric_limits<double>::max_digits10);
-                            outputBuf<<nbr;
+                            end = formatReal(dst, nbr);
                         }
                     }
-                    break;
-                case TE_FLOAT:
+                    if(nan)
                     {
-                        float fnbr =v.getFloat();
-                        if(std::isnan(fnbr))
-                        {
-                            outputBuf<<_nanRepresentation;
-                        }
-                        else
-                        {
-                            outputBuf.precision(std::numeric_limits<float>::max_digits10);
-                            outputBuf<<fnbr;
-                        }
-                    }
-                    break;
-                case TE_UINT8:
-                    {
-                        uint8_t nbr =v.getUint8();
-                        outputBuf<<(int16_t) nbr;
-                    }
-                    break;
-                case TE_INT8:
-                    {
-                        int8_t nbr =v.getUint8();
-                        outputBuf<<(int16_t) nbr;
-                    }
-                    break;
-                default:
-                    {
-                        Value const * vv = &v;
-                        (*_inputConverters[i])(&vv, &stringVal, NULL);
-                        outputBuf<<stringVal.getString();
+                        message.shrink(MAX_NUMBER_CHARS);
+                        message.pushData(_nanRepresentation.data(), _nanRepresentation.size());
+                        continue;
                     }
                 }
+                break;
+            case TE_INT8:     end = formatSigned(dst, load<int8_t>(value));    break;
+            case TE_INT16:    end = formatSigned(dst, load<int16_t>(value));   break;
+            case TE_INT32:    end = formatSigned(dst, load<int32_t>(value));   break;
+            case TE_INT64:    end = formatSigned(dst, load<int64_t>(value));   break;
+            case TE_UINT8:    end = formatUnsigned(dst, load<uint8_t>(value)); break;
+            case TE_UINT16:   end = formatUnsigned(dst, load<uint16_t>(value)); break;
+            case TE_UINT32:   end = formatUnsigned(dst, load<uint32_t>(value)); break;
+            case TE_UINT64:   end = formatUnsigned(dst, load<uint64_t>(value)); break;
+            case TE_DATETIME: end = formatDatetime(dst, load<int64_t>(value)); break;
+            default:
+                throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "internal error: unsupported type";
             }
+            message.shrink(MAX_NUMBER_CHARS - (end - dst));
         }
-        outputBuf<<_lineDelim;
-        ++nCells;
-        for(size_t i = 0, n=citers.size(); i<n; ++i)
+        message.pushData(&_lineDelim, 1);
+    }
+}
+
+void TSVInterface::readResponse(ChildProcess& child, Message& response, bool last)
+{
+    size_t const readSize = 1024*1024;
+    response.reset();
+    size_t dataSize = child.softRead(response.reserve(readSize), readSize, !last);
+    response.shrink(readSize - dataSize);
+    int64_t const expectedNumLines = parseLineCount(response.data(), dataSize);
+    size_t idx = static_cast<char const*>(memchr(response.data(), '\n', dataSize)) - response.data() + 1;
+    size_t lineEnd = idx;
+    int64_t linesReceived = 0;
+    while(true)
+    {
+        idx = countLines(response.data(), idx, dataSize, linesReceived, expectedNumLines, lineEnd);
+        if(linesReceived == expectedNumLines)
         {
-            ++(*citers[i]);
+            break;
         }
+        LOG4CXX_DEBUG(logger, "linesReceived: "<< linesReceived);
+        size_t const nRead = child.softRead(response.reserve(readSize), readSize, !last);
+        response.shrink(readSize - nRead);
+        dataSize += nRead;
+    }
+    if(dataSize > idx)
+    {
+        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "received extraneous characters at end of message";
     }
-    output = outputBuf.str();
 }
 
-void TSVInterface::writeTSV(size_t const nLines, string const& inputData, ChildProcess& child)
+void TSVInterface::decodeResponse(Message& response)
 {
-    LOG4CXX_DEBUG(logger, "Input of stream: "<< inputData);
-    char hdr[4096];
-    snprintf (hdr, 4096, "%lu\n", nLines);
-    size_t n = strlen (hdr);
-    child.hardWrite (hdr, n);
-    if(n>0)
+    char* data = response.data();
+    char* tsvStart = static_cast<char*>(memchr(data, '\n', response.size())) + 1;
+    size_t const tsvSize = response.size() - (tsvStart - data);
+    addBlocks(tsvStart, tsvSize, true);
+    endResponse();
+}
+
+void TSVInterface::streamResponse(ChildProcess& child, bool last)
+{
+    size_t const readSize = 1024*1024;
+    Message& response = _readMsg;
+    response.reset();
+    size_t dataSize = child.softRead(response.reserve(readSize), readSize, !last);
+    response.shrink(readSize - dataSize);
+    int64_t const expectedNumLines = parseLineCount(response.data(), dataSize);
+    response.dropFront(static_cast<char const*>(memchr(response.data(), '\n', dataSize)) - response.data() + 1);
+    dataSize = response.size();
+    int64_t linesReceived = 0;
+    size_t idx = 0;        // scanned up to here
+    size_t blockEnd = 0;   // just past the last complete line
+    while(true)
     {
-        child.hardWrite (inputData.c_str(), inputData.size());
+        char* buf = response.data();
+        idx = countLines(buf, idx, dataSize, linesReceived, expectedNumLines, blockEnd);
+        bool const done = linesReceived == expectedNumLines;
+        if(done && dataSize > idx)
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "received extraneous characters at end of message";
+        }
+        size_t const added = addBlocks(buf, blockEnd, done);
+        if(added > 0)
+        {
+            response.dropFront(added);
+            dataSize -= added;
+            idx      -= added;
+            blockEnd -= added;
+        }
+        if(done)
+        {
+            endResponse();
+            return;
+        }
+        LOG4CXX_DEBUG(logger, "linesReceived: "<< linesReceived);
+        size_t const nRead = child.softRead(response.reserve(readSize), readSize, !last);
+        response.shrink(readSize - nRead);
+        dataSize += nRead;
     }
 }
 
-void TSVInterface::readTSV (std::string& output, ChildProcess& child, bool last)
+size_t TSVInterface::addBlocks(char* data, size_t size, bool last)
 {
-    size_t bufSize = 1024*1024;
-    vector<char> buf(bufSize);
-    size_t dataSize = child.softRead( &(buf[0]), bufSize, !last);
-    size_t idx =0;
-    while ( idx < dataSize && buf[idx] != '\n')
+    size_t done = 0;
+    while(_responseWindow != 0 && size - done >= _responseWindow)
     {
-        ++ idx;
+        // data ends with a newline, so the line that reaches the window ends within it
+        char const* const lineEnd = static_cast<char const*>(memchr(data + done + _responseWindow - 1, _lineDelim,
+                                                                   size - done - _responseWindow + 1));
+        size_t const blockEnd = lineEnd - data + 1;
+        addLines(data + done, blockEnd - done);
+        done = blockEnd;
     }
-    if( idx >= dataSize)
+    if(last && done < size)
     {
-        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "TSV header provided by child did not contain a newline";
+        addLines(data + done, size - done);
+        done = size;
     }
-    char* end = &(buf[0]);
-    errno = 0;
-    int64_t expectedNumLines = strtoll(&(buf[0]), &end, 10);
-    if(*end != '\n' || (size_t) (end - &(buf[0])) != idx || errno !=0 || expectedNumLines < 0)
+    return done;
+}
+
+void TSVInterface::addLines(char* data, size_t size)
+{
+    if(!_typed)
     {
-        LOG4CXX_DEBUG(logger, "Got this stuff "<<(&buf[0]));
-        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "child provided invalid number of lines";
+        if(size > MAX_RESPONSE_SIZE)
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "response from child exceeds maximum size";
+        }
+        data[size-1] = 0; //the final newline is dropped and becomes the string terminator
+        addChunkToArray(data, size);
+        return;
     }
-    ++idx;
-    size_t const tsvStartIdx = idx;
-    int64_t linesReceived = 0;
-    while(linesReceived < expectedNumLines)
+    size_t const nAttrs = _outputTypes.size();
+    char const* p = data;
+    char const* const end = data + size;
+    while(p != end)
     {
-        while(idx < dataSize && linesReceived < expectedNumLines)
+        char const* const lineEnd = static_cast<char const*>(memchr(p, _lineDelim, end - p));
+        if(_numLines == 0)
         {
-            if(buf[idx] == '\n')
+            // The iterator of the first attribute fills in the empty tag as it goes
+            _outPos[2] = 0;
+            for(size_t i = 0; i < nAttrs; ++i)
             {
-                ++linesReceived;
+                _ociters[i] = _aiters[i]->newChunk(_outPos).getIterator(_query,
+                                                                        i == 0 ? ChunkIterator::SEQUENTIAL_WRITE :
+                                                                        ChunkIterator::SEQUENTIAL_WRITE | ChunkIterator::NO_EMPTY_CHECK);
+                _ociters[i]->setPosition(_outPos);
             }
-            ++idx;
         }
-        LOG4CXX_DEBUG(logger, "linesReceived: "<< linesReceived);
-        if(linesReceived < expectedNumLines)
+        if((size_t) _numLines >= _outputChunkSize)
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "received more lines than chunk_size in one response";
+        }
+        for(size_t i = 0; i < nAttrs; ++i)
+        {
+            char const* fieldEnd = static_cast<char const*>(memchr(p, _attDelim, lineEnd - p));
+            if(i + 1 < nAttrs ? fieldEnd == NULL : fieldEnd != NULL)
+            {
+                throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "received line " << _numLines << " with other than " << nAttrs << " fields";
+            }
+            if(fieldEnd == NULL)
+            {
+                fieldEnd = lineEnd;
+            }
+            _ociters[i]->writeItem(parseField(p, fieldEnd, _outputTypes[i]));
+            ++(*_ociters[i]);
+            p = fieldEnd + 1;
+        }
+        ++_numLines;
+    }
+}
+
+Value const& TSVInterface::parseField(char const* s, char const* end, TypeEnum type)
+{
+    size_t const size = end - s;
+    if(size == _nullRepresentation.size() && memcmp(s, _nullRepresentation.data(), size) == 0)
+    {
+        return _nullVal;
+    }
+    bool ok = true;
+    switch(type)
+    {
+    case TE_STRING:
+        if(memchr(s, '\\', size) == NULL)
+        {
+            _val.setSize(size + 1);
+            char* dst = static_cast<char*>(_val.data());
+            memcpy(dst, s, size);
+            dst[size] = 0;
+        }
+        else
+        {
+            _field.resize(size + 1);
+            char* dstEnd = unescapeString(_field.data(), s, end);
+            *dstEnd = 0;
+            _val.setData(_field.data(), dstEnd - _field.data() + 1);
+        }
+        break;
+    case TE_CHAR:
+        {
+            char c[2] = { 0, 0 };
+            ok = size <= 2 && unescapeString(c, s, end) - c <= 1;   // one character, maybe escaped, or none
+            _val.setChar(c[0]);
+        }
+        break;
+    case TE_BOOL:
+        if((size == 4 && strncasecmp(s, "true", 4) == 0) || (size == 1 && *s == '1'))
+        {
+            _val.setBool(true);
+        }
+        else if((size == 5 && strncasecmp(s, "false", 5) == 0) || (size == 1 && *s == '0'))
+        {
+            _val.setBool(false);
+        }
+        else
+        {
+            ok = false;
+        }
+        break;
+    case TE_DOUBLE:
+    case TE_FLOAT:
         {
-            if(idx >= bufSize)
+            // strtod stops at the tab or newline after a number, but would skip whitespace before one
+            if(size == 0 || isspace((unsigned char) *s))
+            {
+                ok = false;
+                break;
+            }
+            char* numEnd = const_cast<char*>(s);
+            if(type == TE_DOUBLE)
+            {
+                _val.setDouble(strtod(s, &numEnd));
+            }
+            else
             {
-                bufSize = bufSize * 2;
-                buf.resize(bufSize);
+                _val.setFloat(strtof(s, &numEnd));
             }
-            dataSize += child.softRead( &(buf[0]) + dataSize, bufSize - dataSize, !last);
+            ok = numEnd == end;
         }
+        break;
+    case TE_INT8:     { int8_t   v; ok = parseInteger(s, end, v); _val.setInt8(v);   } break;
+    case TE_INT16:    { int16_t  v; ok = parseInteger(s, end, v); _val.setInt16(v);  } break;
+    case TE_INT32:    { int32_t  v; ok = parseInteger(s, end, v); _val.setInt32(v);  } break;
+    case TE_INT64:    { int64_t  v; ok = parseInteger(s, end, v); _val.setInt64(v);  } break;
+    case TE_UINT8:    { uint8_t  v; ok = parseInteger(s, end, v); _val.setUint8(v);  } break;
+    case TE_UINT16:   { uint16_t v; ok = parseInteger(s, end, v); _val.setUint16(v); } break;
+    case TE_UINT32:   { uint32_t v; ok = parseInteger(s, end, v); _val.setUint32(v); } break;
+    case TE_UINT64:   { uint64_t v; ok = parseInteger(s, end, v); _val.setUint64(v); } break;
+    case TE_DATETIME: { int64_t  v; ok = parseDatetime(s, end, v); _val.setDateTime(v); } break;
+    default:
+        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "internal error: unsupported type";
     }
-    if(dataSize > idx)
+    if(!ok)
     {
-        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "received extraneous characters at end of message";
+        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "could not parse '" << string(s, size) << "' as " << typeEnum2TypeId(type);
     }
-    if(buf[dataSize-1] != '\n')
+    return _val;
+}
+
+void TSVInterface::endResponse()
+{
+    if(!_typed || _numLines == 0)
     {
-        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "child did not end message with newline";
+        return;
+    }
+    for(size_t i = 0; i < _ociters.size(); ++i)
+    {
+        _ociters[i]->flush();
+        _ociters[i].reset();
     }
-    output.assign( &(buf[tsvStartIdx]), dataSize - tsvStartIdx);
+    _numLines = 0;
+    _outPos[1]++;
 }
 
-void TSVInterface::addChunkToArray(string const& output)
+void TSVInterface::addChunkToArray(char const* data, size_t size)
 {
-    shared_ptr<ChunkIterator> citer = _aiter->newChunk(_outPos).getIterator(_query, ChunkIterator::SEQUENTIAL_WRITE);
+    shared_ptr<ChunkIterator> citer = _aiters[0]->newChunk(_outPos).getIterator(_query, ChunkIterator::SEQUENTIAL_WRITE);
     citer->setPosition(_outPos);
-    _stringBuf.setString(output);
+    _stringBuf.setData(data, size);
     citer->writeItem(_stringBuf);
     citer->flush();
     _outPos[1]++;
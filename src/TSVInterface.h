@@ -28,6 +28,8 @@
 
 #include <query/PhysicalOperator.h>
 #include <query/TypeSystem.h>
+#include "ChunkColumn.h"
+#include "Message.h"
 
 namespace scidb { namespace stream
 {
@@ -52,6 +54,10 @@ class ChildProcess;
  * strings should be escaped. See the Ctor or the Settings class for some defaults. Couldn't easily reuse any existing
  * SciDB components for the TSV conversion so, sadly, implemented our own TSV conversion here. Upside: more flexibility
  * right here. For UDTs we do attempt to locate a UDT->string conversion function.
+ *
+ * Responses are stored as one string per response, or, if the types setting is given, parsed into one cell per
+ * line with one attribute per tab-separated field, laid out as [instance_id, chunk_no, value_no] like the
+ * data frame formats.
  */
 class TSVInterface
 {
@@ -84,7 +90,9 @@ public:
     void setInputSchema(ArrayDesc const& inputSchema);
 
     /**
-     * Write data to the child and record the response into an internal array.
+     * Write data to the child and record the response into an internal array. With the pipe transport the data is
+     * written as it is encoded, in blocks of about the request window each. The response is added as it arrives,
+     * in blocks of whole lines of about the response window each, so a large response becomes several cells.
      * @param inputChunks the data must match the attributes from the most recent setInputSchema call,
      *                    excluding the empty tag.
      * @param child the process to stream to
@@ -99,26 +107,132 @@ public:
      */
     std::shared_ptr<Array> finalize(ChildProcess& child);
 
+    // Split streaming interface methods, for callers that move the bytes themselves //
+
+    /**
+     * Encode a set of input chunks into a message for the child.
+     * @param inputChunks the data must match the attributes from the most recent setInputSchema call,
+     *                    excluding the empty tag.
+     * @param message overwritten with the encoded data
+     * @return false if the chunks were empty and there is nothing to send; true otherwise
+     */
+    bool encodeData(std::vector<ConstChunk const*> const& inputChunks, Message& message);
+
+    /**
+     * Encode the terminating message that tells the child there is no more data.
+     * @param message overwritten with the encoded data
+     */
+    void encodeFinal(Message& message);
+
+    /**
+     * Write a message produced by encodeData or encodeFinal to the child. Safe to call from several threads at
+     * once, for different children.
+     * @param child the process to write to
+     * @param message the encoded data
+     */
+    void writeRequest(ChildProcess& child, Message const& message);
+
+    /**
+     * Read one complete response from the child without interpreting it. Touches no SciDB arrays, so it may be
+     * called from a thread other than the query thread.
+     * @param child the process to read from
+     * @param response overwritten with the raw response
+     * @param last true if this is the response to the terminating message
+     */
+    void readResponse(ChildProcess& child, Message& response, bool last = false);
+
+    /**
+     * Record a response previously obtained from readResponse into the internal array.
+     * @param response the raw response
+     */
+    void decodeResponse(Message& response);
+
+    /**
+     * Return a pointer to the array containing all the accumulated result data. This object is invalidated after
+     * this call.
+     */
+    std::shared_ptr<Array> getResult();
+
     static size_t const MAX_RESPONSE_SIZE = 1024*1024*1024;
 
 private:
     char const                     _attDelim;
     char const                     _lineDelim;
     bool const                     _printCoords;
+    size_t const                   _responseWindow;
+    size_t const                   _requestWindow;
+    bool const                     _streamRequests;
+    bool const                     _typed;          // parse the lines into the types setting, one cell per line
     std::string                    _nanRepresentation;
     std::string                    _nullRepresentation;
     std::shared_ptr<Query>         _query;
     std::shared_ptr<Array>         _result;
-    std::shared_ptr<ArrayIterator> _aiter;
+    std::vector<std::shared_ptr<ArrayIterator>> _aiters;
+    std::vector<std::shared_ptr<ChunkIterator>> _ociters;  // into the chunk of the current typed response
     Coordinates                    _outPos;
+    std::vector<TypeEnum>          _outputTypes;
+    size_t                         _outputChunkSize;
+    int64_t                        _numLines;       // of the current typed response so far
+    Value                          _val;
+    Value                          _nullVal;
+    std::vector<char>              _field;
     std::vector <TypeEnum>         _inputTypes;
     std::vector<FunctionPointer>   _inputConverters;
+    std::vector<bool>              _inputNullable;
+    std::vector<ChunkColumn<>>     _inputColumns;
     Value                          _stringBuf;
+    Message                        _writeMsg;
+    Message                        _readMsg;
 
-    void convertChunks(std::vector< std::shared_ptr<ConstChunkIterator> > citers, size_t &nCells, std::string& output);
-    void writeTSV(size_t const nLines, std::string const& inputData, ChildProcess& child);
-    void readTSV (std::string& output, ChildProcess& child, bool last = false);
-    void addChunkToArray(std::string const& output);
+    /**
+     * Like the public encodeData, but if child is not NULL, write the message to it as it is encoded.
+     */
+    bool encodeData(std::vector<ConstChunk const*> const& inputChunks, Message& message, ChildProcess* child);
+
+    /**
+     * Encode a set of input chunks a slice of about _requestWindow bytes at a time, appending to message.
+     * @param child if not NULL, each slice is written to it as soon as it is encoded and the message is reset
+     */
+    void encodeChunks(std::vector<ConstChunk const*> const& chunks, Message& message, ChildProcess* child);
+
+    /**
+     * Append the lines of the slice currently laid out in _inputColumns to message.
+     * @param posIter positioned at the first cell of the slice if coordinates are printed, NULL otherwise
+     */
+    void convertRows(size_t nColumns, int64_t numRows, ConstChunkIterator* posIter, Message& message);
+    void addChunkToArray(char const* data, size_t size);
+
+    /**
+     * Add a block of whole lines of a response, each ending with a newline, to the array: as one string cell, or
+     * with types, as one cell per line in the chunk of the response. The block may be modified.
+     */
+    void addLines(char* data, size_t size);
+
+    /**
+     * Add the whole lines at data to the array with addLines, in blocks that each end with the first line that
+     * brings them to _responseWindow bytes, so a response is split at the same lines however it was read.
+     * @param last true if data ends the response: the lines after the last full block form one more block
+     * @return the number of bytes added; with last false, the lines after the last full block wait for more
+     */
+    size_t addBlocks(char* data, size_t size, bool last);
+
+    /**
+     * Finish the response whose lines were given to addLines.
+     */
+    void endResponse();
+
+    /**
+     * @return the field [s, end) parsed as type, or a null if it is the null token
+     * @throw if the field does not parse
+     */
+    Value const& parseField(char const* s, char const* end, TypeEnum type);
+
+    /**
+     * Read one response from the child and add it to the array with addBlocks as it arrives, so no more than
+     * _responseWindow bytes, plus the longest line, are held at a time; the whole response if _responseWindow is 0.
+     * @param last true if this is the response to the terminating message
+     */
+    void streamResponse(ChildProcess& child, bool last);
 };
 
 }}
@@ -0,0 +1,207 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* Copyright (C) 2008-2020 Paradigm4 Inc.
+* All Rights Reserved.
+*
+* stream is a plugin for SciDB, an Open Source Array DBMS maintained
+* by Paradigm4. See http://www.paradigm4.com/
+*
+* stream is free software: you can redistribute it and/or modify
+* it under the terms of the AFFERO GNU General Public License as published by
+* the Free Software Foundation.
+*
+* stream is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND,
+* INCLUDING ANY IMPLIED WARRANTY OF MERCHANTABILITY,
+* NON-INFRINGEMENT, OR FITNESS FOR A PARTICULAR PURPOSE. See
+* the AFFERO GNU General Public License for the complete license terms.
+*
+* You should have received a copy of the AFFERO GNU General Public License
+* along with stream.  If not, see <http://www.gnu.org/licenses/agpl-3.0.html>
+*
+* END_COPYRIGHT
+*/
+
+
+#include "Zygote.h"
+#include "ChildProcess.h"
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+using std::shared_ptr;
+using std::string;
+
+namespace scidb { namespace stream
+{
+
+static log4cxx::LoggerPtr logger(log4cxx::Logger::getLogger("scidb.operators.stream.zygote"));
+
+Zygote::Zygote(string const& commandLine):
+    _commandLine(commandLine),
+    _pid(-1),
+    _pidFd(-1),
+    _sock(-1),
+    _alive(false),
+    _killTimeoutMillis(500)
+{
+    LOG4CXX_DEBUG(logger, "Starting zygote "<<commandLine);
+    int socks[2];
+    if(socketpair(AF_UNIX, SOCK_STREAM, 0, socks) < 0)
+    {
+        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "socketpair failed, bummer";
+    }
+    try
+    {
+        _pid = ChildProcess::spawn(commandLine, socks[1], socks[1]);
+    }
+    catch(...)
+    {
+        close(socks[0]);
+        close(socks[1]);
+        throw;
+    }
+    close(socks[1]);
+    _pidFd = ChildProcess::openPidFd(_pid);
+    _sock  = socks[0];
+    _alive = true;
+}
+
+Zygote::~Zygote()
+{
+    close(_sock);
+    if(_pid >= 0)
+    {
+        ChildProcess::endProcess(_pid, _pidFd, true, _killTimeoutMillis);
+    }
+    if(_pidFd >= 0)
+    {
+        close(_pidFd);
+    }
+}
+
+void Zygote::setKillTimeout(int millis)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _killTimeoutMillis = millis;
+}
+
+bool Zygote::isAlive()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if(_alive && waitpid(_pid, NULL, WNOHANG) == _pid)
+    {
+        _alive = false;
+        _pid = -1;    //reaped; nothing left to kill
+    }
+    return _alive;
+}
+
+void Zygote::sendRequest(string const& program, int stdinFd, int stdoutFd, int shmFd)
+{
+    uint64_t size = program.size();
+    struct iovec iov;
+    iov.iov_base = &size;
+    iov.iov_len  = sizeof(size);
+    int fds[3] = { stdinFd, stdoutFd, shmFd };
+    size_t const fdsSize = (shmFd < 0 ? 2 : 3) * sizeof(int);
+    char control[CMSG_SPACE(sizeof(fds))];
+    memset(control, 0, sizeof(control));
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = control;
+    msg.msg_controllen = CMSG_SPACE(fdsSize);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type  = SCM_RIGHTS;
+    cmsg->cmsg_len   = CMSG_LEN(fdsSize);
+    memcpy(CMSG_DATA(cmsg), fds, fdsSize);
+    if(sendmsg(_sock, &msg, MSG_NOSIGNAL) != sizeof(size))
+    {
+        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "could not send request to zygote; errno "<<errno;
+    }
+    size_t sent = 0;
+    while(sent < program.size())
+    {
+        ssize_t ret = send(_sock, program.data() + sent, program.size() - sent, MSG_NOSIGNAL);
+        if(ret <= 0)
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "could not send request to zygote; errno "<<errno;
+        }
+        sent += ret;
+    }
+}
+
+int64_t Zygote::readReply(shared_ptr<Query> const& query)
+{
+    int64_t reply = 0;
+    size_t received = 0;
+    while(received < sizeof(reply))
+    {
+        struct pollfd pollstat [1];
+        pollstat[0].fd = _sock;
+        pollstat[0].events = POLLIN;
+        int ret = 0;
+        while( ret == 0 )
+        {
+            Query::validateQueryPtr(query); //the first reply waits for the zygote to load; stay cancellable
+            ret = poll(pollstat, 1, 100);
+        }
+        if(ret < 0)
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "poll failed";
+        }
+        ssize_t nRead = recv(_sock, ((char*) &reply) + received, sizeof(reply) - received, 0);
+        if(nRead <= 0)
+        {
+            throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "zygote exited; check that it starts on its own";
+        }
+        received += nRead;
+    }
+    return reply;
+}
+
+pid_t Zygote::spawn(string const& program, int stdinFd, int stdoutFd, int shmFd, shared_ptr<Query> const& query)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if(!_alive)
+    {
+        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "zygote is not running";
+    }
+    int64_t pid;
+    try
+    {
+        sendRequest(program, stdinFd, stdoutFd, shmFd);
+        pid = readReply(query);
+    }
+    catch(...)
+    {
+        _alive = false;   //the conversation is out of step, or the zygote is gone; start over next time
+        throw;
+    }
+    if(pid <= 0)
+    {
+        throw SYSTEM_EXCEPTION(SCIDB_SE_INTERNAL, SCIDB_LE_ILLEGAL_OPERATION) << "zygote could not fork";
+    }
+    LOG4CXX_DEBUG(logger, "Zygote forked child "<<pid);
+    return pid;
+}
+
+shared_ptr<Zygote> ZygoteRegistry::get(string const& commandLine)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    shared_ptr<Zygote>& zygote = _zygotes[commandLine];
+    if(!zygote || !zygote->isAlive())
+    {
+        zygote.reset();
+        zygote.reset(new Zygote(commandLine));
+    }
+    return zygote;
+}
+
+} } //namespace
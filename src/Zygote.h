@@ -0,0 +1,123 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* Copyright (C) 2008-2020 Paradigm4 Inc.
+* All Rights Reserved.
+*
+* stream is a plugin for SciDB, an Open Source Array DBMS maintained
+* by Paradigm4. See http://www.paradigm4.com/
+*
+* stream is free software: you can redistribute it and/or modify
+* it under the terms of the AFFERO GNU General Public License as published by
+* the Free Software Foundation.
+*
+* stream is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND,
+* INCLUDING ANY IMPLIED WARRANTY OF MERCHANTABILITY,
+* NON-INFRINGEMENT, OR FITNESS FOR A PARTICULAR PURPOSE. See
+* the AFFERO GNU General Public License for the complete license terms.
+*
+* You should have received a copy of the AFFERO GNU General Public License
+* along with stream.  If not, see <http://www.gnu.org/licenses/agpl-3.0.html>
+*
+* END_COPYRIGHT
+*/
+
+
+#ifndef SRC_ZYGOTE_H_
+#define SRC_ZYGOTE_H_
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unistd.h>
+#include <query/Query.h>
+
+namespace scidb { namespace stream
+{
+
+/**
+ * A long-lived, pre-initialized interpreter that forks copies of itself on request. The zygote is started with
+ * "/bin/bash -c commandLine" and a unix socket as its stdin and stdout. It is expected to load whatever is slow to
+ * load (R packages, Python modules), then serve requests one at a time. A request is a native-endian uint64 length
+ * followed by that many bytes naming the program to run; the child's stdin and stdout pipe ends are attached to the
+ * first byte as SCM_RIGHTS. The zygote forks, runs the program in the copy with the pipes as its stdin and stdout,
+ * reaps the copy when it exits, and answers with the copy's pid as a native-endian int64, or a negative number if
+ * the fork failed. The zygote exits when the socket is closed.
+ */
+class Zygote
+{
+public:
+    /**
+     * Start the zygote. Returns right away; the first spawn waits for the zygote to finish loading.
+     * @param commandLine the bash command that starts the zygote
+     */
+    Zygote(std::string const& commandLine);
+
+    /**
+     * Close the socket and end the zygote the way ChildProcess::terminate ends a child, with the last kill timeout
+     * set. Children already forked are not affected.
+     */
+    ~Zygote();
+
+    /**
+     * @param millis how long the destructor waits for the zygote to exit after SIGTERM before sending SIGKILL
+     */
+    void setKillTimeout(int millis);
+
+    /**
+     * @return false if the zygote has exited or broke the protocol
+     */
+    bool isAlive();
+
+    /**
+     * Fork a copy of the zygote. Safe to call from concurrent queries; requests are served one at a time.
+     * @param program the program the copy should run
+     * @param stdinFd the descriptor to give the copy as its stdin
+     * @param stdoutFd the descriptor to give the copy as its stdout
+     * @param shmFd a shared memory descriptor to give the copy as descriptor 3, or -1
+     * @param query the query context, checked while waiting for the zygote
+     * @return the pid of the copy
+     */
+    pid_t spawn(std::string const& program, int stdinFd, int stdoutFd, int shmFd, std::shared_ptr<Query> const& query);
+
+private:
+    std::string _commandLine;
+    std::mutex  _mutex;
+    pid_t       _pid;
+    int         _pidFd;     // -1 if the kernel has no pidfd
+    int         _sock;
+    bool        _alive;
+    int         _killTimeoutMillis;
+
+    void sendRequest(std::string const& program, int stdinFd, int stdoutFd, int shmFd);
+    int64_t readReply(std::shared_ptr<Query> const& query);
+};
+
+/**
+ * The zygotes running on this instance, one per command line, owned by the plugin. A zygote is started when a query
+ * first asks for it and restarted if it has died since.
+ */
+class ZygoteRegistry
+{
+public:
+    /**
+     * @return the registry of this instance
+     */
+    static ZygoteRegistry& getInstance();
+
+    /**
+     * @param commandLine the bash command that starts the zygote
+     * @return the running zygote for commandLine
+     */
+    std::shared_ptr<Zygote> get(std::string const& commandLine);
+
+private:
+    std::mutex _mutex;
+    std::map<std::string, std::shared_ptr<Zygote> > _zygotes;
+};
+
+} } //namespace
+
+#endif /* SRC_ZYGOTE_H_ */
@@ -28,6 +28,10 @@
 #include <SciDBAPI.h>
 #include <system/ErrorsLibrary.h>
 
+#include "ChildPool.h"
+#include "ChildSlots.h"
+#include "Zygote.h"
+
 using namespace scidb;
 
 EXPORTED_FUNCTION void GetPluginVersion(uint32_t& major, uint32_t& minor, uint32_t& patch, uint32_t& build)
@@ -47,4 +51,44 @@ public:
     ~Instance()
     {}
 
+    stream::ChildPool& getChildPool()
+    {
+        return _childPool;
+    }
+
+    stream::ZygoteRegistry& getZygotes()
+    {
+        return _zygotes;
+    }
+
+    stream::ChildSlots& getChildSlots()
+    {
+        return _childSlots;
+    }
+
+private:
+    stream::ChildSlots _childSlots; //declared first: outlives the pooled children holding slots
+    stream::ZygoteRegistry _zygotes;
+    stream::ChildPool _childPool; //idle children are killed when the plugin is unloaded
+
 } _instance;
+
+namespace scidb { namespace stream
+{
+
+ChildPool& ChildPool::getInstance()
+{
+    return _instance.getChildPool();
+}
+
+ZygoteRegistry& ZygoteRegistry::getInstance()
+{
+    return _instance.getZygotes();
+}
+
+ChildSlots& ChildSlots::getInstance()
+{
+    return _instance.getChildSlots();
+}
+
+} }
@@ -0,0 +1,124 @@
+/*
+**
+* BEGIN_COPYRIGHT
+*
+* Copyright (C) 2008-2020 Paradigm4 Inc.
+* All Rights Reserved.
+*
+* stream is a plugin for SciDB, an Open Source Array DBMS maintained
+* by Paradigm4. See http://www.paradigm4.com/
+*
+* stream is free software: you can redistribute it and/or modify
+* it under the terms of the AFFERO GNU General Public License as published by
+* the Free Software Foundation.
+*
+* stream is distributed "AS-IS" AND WITHOUT ANY WARRANTY OF ANY KIND,
+* INCLUDING ANY IMPLIED WARRANTY OF MERCHANTABILITY,
+* NON-INFRINGEMENT, OR FITNESS FOR A PARTICULAR PURPOSE. See
+* the AFFERO GNU General Public License for the complete license terms.
+*
+* You should have received a copy of the AFFERO GNU General Public License
+* along with stream.  If not, see <http://www.gnu.org/licenses/agpl-3.0.html>
+*
+* END_COPYRIGHT
+*/
+
+
+/*
+ * The C interface between stream() and a shared library loaded with format:'native', library:'/path/libfoo.so'.
+ * The library runs inside the SciDB instance: there is no child process, and the data is not serialized. Include
+ * this header from C or C++ and export the functions below with C linkage; see examples/native_client.cpp.
+ *
+ * The library is called from one thread per query, once per input chunk:
+ *
+ *   stream_native_init           once, before any data
+ *   stream_native_process_batch  for every non-empty chunk of ARRAY2 (if any), then of ARRAY
+ *   stream_native_finalize       once, also when the query fails after a successful init
+ *
+ * Each call may return output rows by filling in the output columns, which act as the output builder: SciDB sets
+ * type and name, the library points values, offsets and validity at its own memory and sets length. The memory
+ * must stay valid until the next call into the library. Every output column must have the same length. A
+ * function returns 0 on success; on failure stream() fails the query with the message from stream_native_error,
+ * if the library exports it. Library code must not let C++ exceptions escape, and must not exit the process.
+ */
+
+#ifndef SRC_STREAM_NATIVE_H_
+#define SRC_STREAM_NATIVE_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define STREAM_NATIVE_ABI_VERSION 1
+
+/* Column types. Fixed-width values are stored in their native C representation; bool and char take one byte. */
+enum stream_native_type
+{
+    STREAM_NATIVE_BOOL     = 1,
+    STREAM_NATIVE_CHAR     = 2,
+    STREAM_NATIVE_INT8     = 3,
+    STREAM_NATIVE_INT16    = 4,
+    STREAM_NATIVE_INT32    = 5,
+    STREAM_NATIVE_INT64    = 6,
+    STREAM_NATIVE_UINT8    = 7,
+    STREAM_NATIVE_UINT16   = 8,
+    STREAM_NATIVE_UINT32   = 9,
+    STREAM_NATIVE_UINT64   = 10,
+    STREAM_NATIVE_FLOAT    = 11,
+    STREAM_NATIVE_DOUBLE   = 12,
+    STREAM_NATIVE_DATETIME = 13,   /* int64 seconds since the epoch */
+    STREAM_NATIVE_STRING   = 14,   /* UTF-8, not terminated */
+    STREAM_NATIVE_BINARY   = 15
+};
+
+typedef struct stream_native_column
+{
+    int32_t        type;      /* a stream_native_type */
+    char const*    name;      /* the attribute name */
+    int64_t        length;    /* the number of rows */
+    void const*    values;    /* fixed width: length values; string and binary: all the bytes back to back */
+    int64_t const* offsets;   /* string and binary only: length+1 offsets into values, the first one 0 */
+    uint8_t const* validity;  /* bit i (least significant first) is set if row i is not null; NULL if none is */
+} stream_native_column;
+
+/* Must return STREAM_NATIVE_ABI_VERSION. */
+int32_t stream_native_abi_version(void);
+
+/*
+ * Set up for a query.
+ * @param state set to whatever the library wants passed to the other calls
+ * @param args the PROGRAM argument of stream()
+ * @param num_outputs the number of output columns, from types:
+ * @param outputs the output columns, with only type and name set
+ */
+int32_t stream_native_init(void** state, char const* args, int32_t num_outputs, stream_native_column const* outputs);
+
+/*
+ * Process the cells of one input chunk, in the order SciDB iterates them.
+ * @param array 1 for a chunk of ARRAY2, 0 for a chunk of ARRAY
+ * @param num_inputs the number of attributes of the array
+ * @param inputs one column per attribute, valid until the call returns
+ * @param outputs the output builder
+ */
+int32_t stream_native_process_batch(void* state, int32_t array, int32_t num_inputs, stream_native_column const* inputs,
+                                    stream_native_column* outputs);
+
+/*
+ * Return any last output and release the state. Called once for each successful init.
+ */
+int32_t stream_native_finalize(void* state, stream_native_column* outputs);
+
+/*
+ * Optional: describe the last failure, or return NULL. Called after every call that fails, with the state as that
+ * call left it. A failed stream_native_init may leave the state NULL, and stream_native_error is called with NULL
+ * then too, so the library must accept a NULL state here.
+ */
+char const* stream_native_error(void* state);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SRC_STREAM_NATIVE_H_ */
@@ -0,0 +1,69 @@
+"""
+Microbenchmark of decoding the responses of the child. The child
+answers each of a few small input chunks with the same large data
+frame, so the time goes into reading the responses and storing them
+in SciDB. Run it against a build before and after a change and
+compare the rows/s:
+
+  python bench_decode.py --format feather --type int64 --rows 1000000
+
+With --format tsv the child answers with one int64 per line, --type
+is ignored, and the throughput is also reported in GB/s of TSV:
+
+  python bench_decode.py --format tsv --rows 10000000
+"""
+import argparse
+import scidbpy
+import time
+
+
+parser = argparse.ArgumentParser()
+parser.add_argument('--format', default='feather',
+                    choices=('feather', 'arrow', 'tsv'))
+parser.add_argument('--type', default='int64',
+                    choices=('int32', 'int64', 'double', 'string'))
+parser.add_argument('--rows', type=int, default=1000000,
+                    help='rows in each response')
+parser.add_argument('--chunks', type=int, default=20,
+                    help='input chunks, one response each')
+parser.add_argument('--nulls', action='store_true',
+                    help='make every 7th value null')
+parser.add_argument('--repeat', type=int, default=3)
+parser.add_argument('--scripts', default='/stream/tests/scripts')
+args = parser.parse_args()
+
+db = scidbpy.connect()
+query = """
+    op_count(
+      stream(
+        build(<x:int64>[i=1:{chunks}:0:1], i),
+        'python -u {scripts}/bench_child.py {rows} {format} {type} {nulls}',
+        format:'{format}'{types}))""".format(
+            chunks=args.chunks,
+            scripts=args.scripts,
+            rows=args.rows,
+            format=args.format,
+            type=args.type,
+            nulls=int(args.nulls),
+            types='' if args.format == 'tsv' else ", types:'{}'".format(
+                args.type))
+
+best = None
+for _ in range(args.repeat):
+    start = time.time()
+    db.iquery(query, fetch=True)
+    elapsed = time.time() - start
+    best = elapsed if best is None else min(best, elapsed)
+
+total = args.chunks * args.rows
+if args.format == 'tsv':
+    # The same lines as bench_child.py sends
+    size = sum(2 if args.nulls and i % 7 == 0 else len(str(i))
+               for i in range(args.rows)) + args.rows
+    print('tsv{}: {} rows in {:.3f} s, {:.0f} rows/s, {:.2f} GB/s'.format(
+        ' with nulls' if args.nulls else '',
+        total, best, total / best, args.chunks * size / best / 1e9))
+else:
+    print('{} {}{}: {} rows in {:.3f} s, {:.0f} rows/s'.format(
+        args.format, args.type, ' with nulls' if args.nulls else '',
+        total, best, total / best))
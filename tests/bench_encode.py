@@ -0,0 +1,51 @@
+"""
+Microbenchmark of encoding the TSV requests to the child. A few large
+chunks of doubles go to stream_test_client SUMMARIZE, which only counts
+the lines, so the time goes into formatting the numbers and writing
+them to the pipe. Run it against a build before and after a change and
+compare the values/s:
+
+  python bench_encode.py --rows 1000000
+
+--type float sends floats; --type int64 sends integers for reference.
+"""
+import argparse
+import os
+import scidbpy
+import time
+
+
+parser = argparse.ArgumentParser()
+parser.add_argument('--type', default='double',
+                    choices=('double', 'float', 'int64'))
+parser.add_argument('--rows', type=int, default=1000000,
+                    help='values in each chunk')
+parser.add_argument('--chunks', type=int, default=20)
+parser.add_argument('--repeat', type=int, default=3)
+parser.add_argument('--examples',
+                    default=os.path.join(os.path.dirname(
+                        os.path.abspath(__file__)), '..', 'examples'))
+args = parser.parse_args()
+
+db = scidbpy.connect()
+query = """
+    op_count(
+      stream(
+        build(<x:{type}>[i=1:{total}:0:{rows}],
+              {type}(double(random() % 1000000) / (1 + random() % 1000))),
+        '{examples}/stream_test_client SUMMARIZE'))""".format(
+            type=args.type,
+            total=args.chunks * args.rows,
+            rows=args.rows,
+            examples=args.examples)
+
+best = None
+for _ in range(args.repeat):
+    start = time.time()
+    db.iquery(query, fetch=True)
+    elapsed = time.time() - start
+    best = elapsed if best is None else min(best, elapsed)
+
+total = args.chunks * args.rows
+print('tsv {}: {} values in {:.3f} s, {:.0f} values/s'.format(
+    args.type, total, best, total / best))
@@ -0,0 +1,37 @@
+import numpy
+import pandas
+import scidbstrm
+import sys
+
+# Answer every chunk with the same data frame, or with the same TSV
+# lines, one int64 each, for format tsv:
+# bench_child.py ROWS FORMAT TYPE NULLS
+rows = int(sys.argv[1])
+if sys.argv[2] == 'tsv':
+    lines = numpy.arange(rows).astype(str).astype(object)
+    if sys.argv[4] == '1':
+        lines[::7] = '\\N'
+    response = '{}\n{}\n'.format(rows, '\n'.join(lines)).encode()
+    stdin = sys.stdin.buffer
+    while True:
+        n = int(stdin.readline())
+        for _ in range(n):
+            stdin.readline()
+        if n == 0:
+            sys.stdout.buffer.write(b'0\n')
+            sys.stdout.buffer.flush()
+            break
+        sys.stdout.buffer.write(response)
+        sys.stdout.buffer.flush()
+    sys.exit(0)
+if sys.argv[3] == 'string':
+    col = pandas.Series(numpy.arange(rows).astype(str), dtype=object)
+else:
+    col = pandas.Series(numpy.arange(rows).astype(sys.argv[3]))
+if sys.argv[4] == '1':
+    if sys.argv[3].startswith('int'):
+        col = col.astype(sys.argv[3].capitalize())   # nullable integers
+    col[::7] = None
+df = pandas.DataFrame({'a0': col})
+
+scidbstrm.map(lambda _: df, format=sys.argv[2])
@@ -0,0 +1,15 @@
+import os
+import sys
+
+# Send every TSV message back unchanged, but die on any message that
+# has a line equal to the argument, however many times it is sent
+while True:
+    n = int(sys.stdin.readline())
+    lines = [sys.stdin.readline() for _ in range(n)]
+    if sys.argv[1] + '\n' in lines:
+        os.abort()
+    sys.stdout.write('{}\n'.format(n))
+    sys.stdout.writelines(lines)
+    sys.stdout.flush()
+    if n == 0:
+        break
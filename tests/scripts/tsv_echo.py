@@ -0,0 +1,11 @@
+import sys
+
+# Send every TSV message back unchanged
+while True:
+    n = int(sys.stdin.readline())
+    lines = [sys.stdin.readline() for _ in range(n)]
+    sys.stdout.write('{}\n'.format(n))
+    sys.stdout.writelines(lines)
+    sys.stdout.flush()
+    if n == 0:
+        break
@@ -0,0 +1,34 @@
+import os
+import signal
+import sys
+import time
+
+# Consume every TSV message without answering any lines, and answer the
+# terminating one with the pid of this process, the number of lines it
+# read, and the times it started and answered. With the argument
+# 'reuse', stay alive for the next query; with 'stubborn', ignore
+# SIGTERM and linger after answering.
+start = time.time()
+if sys.argv[1:] == ['stubborn']:
+    signal.signal(signal.SIGTERM, signal.SIG_IGN)
+lines = 0
+while True:
+    line = sys.stdin.readline()
+    if not line:
+        break    # let go by the pool
+    n = int(line)
+    for _ in range(n):
+        sys.stdin.readline()
+    lines += n
+    if n != 0:
+        sys.stdout.write('0\n')
+        sys.stdout.flush()
+        continue
+    sys.stdout.write('1\n{}\t{}\t{}\t{}\n'.format(
+        os.getpid(), lines, start, time.time()))
+    sys.stdout.flush()
+    if sys.argv[1:] == ['stubborn']:
+        time.sleep(600)
+    if sys.argv[1:] != ['reuse']:
+        break
+    lines = 0
@@ -0,0 +1,28 @@
+import os
+import sys
+import time
+
+# Send every TSV message back with one more line naming this process.
+# The first process to get a message with a line equal to the first
+# argument writes its pid to the file named by the second argument and
+# takes a minute over that message.
+while True:
+    n = int(sys.stdin.readline())
+    lines = [sys.stdin.readline() for _ in range(n)]
+    if n == 0:
+        sys.stdout.write('0\n')
+        sys.stdout.flush()
+        break
+    if sys.argv[1] + '\n' in lines:
+        try:
+            fd = os.open(sys.argv[2], os.O_CREAT | os.O_EXCL | os.O_WRONLY)
+        except OSError:
+            pass
+        else:
+            os.write(fd, str(os.getpid()).encode())
+            os.close(fd)
+            time.sleep(60)
+    sys.stdout.write('{}\n'.format(n + 1))
+    sys.stdout.writelines(lines)
+    sys.stdout.write('pid {}\n'.format(os.getpid()))
+    sys.stdout.flush()
@@ -0,0 +1,35 @@
+"""Stand-in for a host-wide server, for testing the ``connect`` option
+of ``stream``. Answers each connection in its own thread by running
+COMMAND with the connection as its standard input and output::
+
+  python unix_server.py /path/to/socket COMMAND [ARG ...]
+
+"""
+import os
+import socket
+import subprocess
+import sys
+import threading
+
+
+def serve(conn, command):
+    subprocess.call(command, stdin=conn.fileno(), stdout=conn.fileno())
+    conn.close()
+
+
+def main():
+    path, command = sys.argv[1], sys.argv[2:]
+    if os.path.exists(path):
+        os.unlink(path)
+    server = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    server.bind(path)
+    server.listen(64)
+    while True:
+        conn, _ = server.accept()
+        thread = threading.Thread(target=serve, args=(conn, command))
+        thread.daemon = True
+        thread.start()
+
+
+if __name__ == '__main__':
+    main()
@@ -8,12 +8,30 @@ MY_DIR=`dirname $0`
 pushd $MY_DIR > /dev/null
 MY_DIR=`pwd`
 EX_DIR=`pwd`/../examples
+make -C $EX_DIR > /dev/null || exit 1
 
 iquery -aq "remove(foo)" > /dev/null 2>&1
 rm -rf $MY_DIR/test.out
 
 iquery -anq "store(build(<val:double>[i=1:800000:0:100000], i), foo)" > /dev/null 2>&1
 iquery -aq "op_count(stream(foo, '$EX_DIR/stream_test_client'))" >> $MY_DIR/test.out 2>&1
+iquery -aq "op_count(stream(foo, '$EX_DIR/stream_test_client', pipeline:2))" >> $MY_DIR/test.out 2>&1
+iquery -aq "op_count(stream(foo, '$EX_DIR/stream_test_client', parallelism:3))" >> $MY_DIR/test.out 2>&1
+iquery -aq "op_count(stream(foo, '$EX_DIR/stream_test_client', parallelism:3, speculate:3))" >> $MY_DIR/test.out 2>&1
+iquery -aq "op_count(stream(foo, '$EX_DIR/stream_test_client', transport:'splice'))" >> $MY_DIR/test.out 2>&1
+iquery -aq "op_count(stream(foo, '$EX_DIR/stream_test_client', kill_timeout:50))" >> $MY_DIR/test.out 2>&1
+rm -f /tmp/stream_test_client.crashed
+iquery -aq "op_count(stream(foo, '$EX_DIR/stream_test_client CRASH_ONCE', retries:1))" >> $MY_DIR/test.out 2>&1
+iquery -aq "op_count(stream(foo, '$EX_DIR/stream_test_client', parallelism:3, max_children:2, memory_limit:1073741824))" >> $MY_DIR/test.out 2>&1
+iquery -aq "op_count(stream(foo, '$EX_DIR/stream_test_client', parallelism:2, affinity:'spread'))" >> $MY_DIR/test.out 2>&1
+iquery -aq "op_count(stream(foo, '$EX_DIR/stream_test_client REUSE', reuse:60))" >> $MY_DIR/test.out 2>&1
+iquery -aq "op_count(stream(foo, '$EX_DIR/stream_test_client REUSE', reuse:60))" >> $MY_DIR/test.out 2>&1
+python $MY_DIR/scripts/unix_server.py /tmp/stream_test.sock $EX_DIR/stream_test_client > /dev/null 2>&1 &
+SERVER_PID=$!
+sleep 1
+iquery -aq "op_count(stream(foo, '', connect:'unix:/tmp/stream_test.sock'))" >> $MY_DIR/test.out 2>&1
+kill $SERVER_PID
+iquery -aq "op_count(stream(foo, '', format:'native', library:'$EX_DIR/libstream_test_native.so', types:('int64','double')))" >> $MY_DIR/test.out 2>&1
 iquery -aq "stream(foo, '$EX_DIR/stream_test_client')" | head -n 5 >> $MY_DIR/test.out 2>&1
 iquery -otsv -aq "stream(_sg(foo, 2,0), '$EX_DIR/stream_test_client SUMMARIZE')" | head -n 1 >> $MY_DIR/test.out 2>&1
 
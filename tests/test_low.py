@@ -1,6 +1,11 @@
+import multiprocessing
 import numpy
+import os
+import pandas
 import pytest
 import scidbpy
+import sys
+import time
 
 
 @pytest.fixture(scope='module')
@@ -10,7 +15,16 @@ def db():
 
 # SciDB Supported Types
 scidb_types = (
+    'bool',
+    'int8',
+    'int16',
+    'int32',
     'int64',
+    'uint8',
+    'uint16',
+    'uint32',
+    'uint64',
+    'float',
     'double',
     'string',
     'binary',
@@ -19,6 +33,7 @@ scidb_types = (
 
 # NumPy Type Map: SciDB Type -> NumPy Type
 np_type_map = {
+    'float': 'float32',
     'string': 'O',
     'binary': 'O',
 }
@@ -26,7 +41,15 @@ np_type_map = {
 
 # Python Type Map: SciDB Type -> Python Type
 py_type_map = {
+    'int8': 'int',
+    'int16': 'int',
+    'int32': 'int',
     'int64': 'int',
+    'uint8': 'int',
+    'uint16': 'int',
+    'uint32': 'int',
+    'uint64': 'int',
+    'float': 'float',
     'double': 'float',
     'string': 'str',
     'binary': 'bytes',
@@ -114,6 +137,399 @@ def test_any_chunks(db, scidb_ty, name):
                               ('val', np_type_map.get(scidb_ty, scidb_ty))])]))
 
 
+@pytest.mark.parametrize(('scidb_ty', 'transport'), [
+    (scidb_ty, transport)
+    for scidb_ty in scidb_types
+    for transport in ('pipe', 'shm')
+    if transport == 'pipe' or sys.version_info >= (3,)
+])
+def test_arrow(db, scidb_ty, transport):
+    # Two input chunks per instance, so that the stream outlives a chunk
+    if scidb_ty == 'binary':
+        input_ar = db.input(
+            '<x:binary not null>[i=0:9:0:3]',
+            upload_data=numpy.array([str(i).encode() for i in range(10)],
+                                    dtype='object')).store()
+        input = input_ar.name
+    else:
+        input = 'build(<x:{scidb_ty}>[i=0:9:0:3], {scidb_ty}(i))'.format(
+            scidb_ty=scidb_ty)
+
+    res = db.iquery("""
+        stream(
+          {input},
+          'python -uc "
+import scidbstrm
+scidbstrm.map(lambda df: df, format=\\"arrow\\")"',
+          format:'arrow',
+          types:'{scidb_ty}',
+          transport:'{transport}')""".format(
+              input=input,
+              scidb_ty=scidb_ty,
+              transport=transport),
+                    fetch=True,
+                    atts_only=True,
+                    as_dataframe=False)
+    assert numpy.array_equal(
+        res[res['a0']['val'].argsort()],
+        numpy.array(
+            [((255, eval('{}({})'.format(
+                py_type_map.get(scidb_ty, scidb_ty),
+                str(i).encode() if scidb_ty == 'binary' else i))),)
+             for i in range(10)],
+            dtype=[('a0', [('null', 'u1'),
+                           ('val', np_type_map.get(scidb_ty, scidb_ty))])]))
+
+
+@pytest.mark.parametrize('format', ('feather', 'arrow'))
+def test_nulls(db, format):
+    # Nulls both in runs and scattered, across several 64-row words
+    res = db.iquery("""
+        stream(
+          build(<x:double>[i=0:299:0:300], iif(i < 64 or i % 3 = 0, null, i)),
+          'python -uc "
+import scidbstrm
+scidbstrm.map(lambda df: df, format=\\"{format}\\")"',
+          format:'{format}',
+          types:'double')""".format(format=format),
+                    fetch=True,
+                    atts_only=True,
+                    as_dataframe=False)
+    expected = [i >= 64 and i % 3 != 0 for i in range(300)]
+    assert numpy.array_equal(res['a0']['null'] == 255, expected)
+    assert numpy.array_equal(res['a0']['val'][expected],
+                             numpy.arange(300, dtype='float64')[expected])
+
+
+def test_tsv_types(db):
+    # Numbers and datetimes reach the child in their plain text form
+    df = db.iquery("""
+        stream(
+          apply(
+            build(<x:int16>[i=0:0], int16(-7)),
+            u, uint64(12884901888),
+            d, 0.1,
+            f, float(2.5),
+            t, datetime('2020-09-13 12:26:40')),
+          'python -u /stream/tests/scripts/tsv_echo.py')""",
+                   fetch=True)
+    assert df['response'][0] == '\t'.join(
+        ('-7', '12884901888', '0.1', '2.5', '2020-09-13 12:26:40'))
+
+
+def test_tsv_typed(db):
+    # With types, the lines of the response are parsed into attributes
+    df = db.iquery("""
+        stream(
+          apply(
+            build(<x:int64>[i=0:2], iif(i = 1, null, i)),
+            d, i / 2.0,
+            s, 'v' + string(i)),
+          'python -u /stream/tests/scripts/tsv_echo.py',
+          types:('int64', 'double', 'string'),
+          names:('x', 'd', 's'))""",
+                   fetch=True)
+    df = df.sort_values('value_no')
+    assert df['x'].isnull().tolist() == [False, True, False]
+    assert df['d'].tolist() == [0, 0.5, 1]
+    assert df['s'].tolist() == ['v0', 'v1', 'v2']
+
+
+def test_tsv_typed_bool_datetime(db):
+    # Bools and datetimes read back in the form they were sent
+    df = db.iquery("""
+        stream(
+          apply(
+            build(<b:bool>[i=0:1], i = 0),
+            t, datetime('2020-09-13 12:26:40')),
+          'python -u /stream/tests/scripts/tsv_echo.py',
+          types:('bool', 'datetime'),
+          names:('b', 't'))""",
+                   fetch=True)
+    df = df.sort_values('value_no')
+    assert df['b'].tolist() == [True, False]
+    assert df['t'].tolist() == [pandas.Timestamp('2020-09-13 12:26:40')] * 2
+
+
+def test_tsv_null_token(db):
+    # The child sees the null_token for nulls, and its null_token lines
+    # come back as nulls
+    query = """
+        stream(
+          build(<x:int64>[i=0:2], iif(i = 1, null, i)),
+          'python -u /stream/tests/scripts/tsv_echo.py',
+          null_token:'NA'{})"""
+    df = db.iquery(query.format(''), fetch=True)
+    assert df['response'][0].split('\n') == ['0', 'NA', '2']
+    df = db.iquery(query.format(", types:'int64'"), fetch=True)
+    df = df.sort_values('value_no')
+    assert df['a0'].isnull().tolist() == [False, True, False]
+
+
+@pytest.mark.parametrize(('array', 'error'), [
+    ("build(<x:string>[i=0:0], 'abc')", "could not parse 'abc' as int64"),
+    ("apply(build(<x:int64>[i=0:0], 1), y, 2)", 'other than 1 fields'),
+])
+def test_tsv_typed_error(db, array, error):
+    # A response that does not match the types fails the query
+    with pytest.raises(Exception, match=error):
+        db.iquery("""
+            stream(
+              {},
+              'python -u /stream/tests/scripts/tsv_echo.py',
+              types:'int64')""".format(array))
+
+
+@pytest.mark.parametrize('mode', ('', ', pipeline:1', ', retries:1'))
+def test_response_window(db, mode):
+    # A TSV response larger than the window is stored in several cells,
+    # split at the same lines whether or not it is decoded as it arrives
+    df = db.iquery("""
+        stream(
+          build(<x:int64>[i=0:99999:0:100000], i),
+          'python -u /stream/tests/scripts/tsv_echo.py',
+          response_window:65536{})""".format(mode),
+                   fetch=True)
+    cells = df.sort_values(['instance_id', 'chunk_no'])['response'].tolist()
+    assert '\n'.join(cells).split('\n') == [str(i) for i in range(100000)]
+    # each cell is the first lines that reach 65536 bytes with newlines
+    for cell in cells[:-1]:
+        assert len(cell) + 1 >= 65536
+        assert len(cell) + 1 - len(cell.split('\n')[-1]) - 1 < 65536
+    assert len(cells) > 1
+
+
+def test_response_whole(db):
+    # Without response_window, a large TSV response is one cell
+    df = db.iquery("""
+        stream(
+          build(<x:int64>[i=0:99999:0:100000], i),
+          'python -u /stream/tests/scripts/tsv_echo.py')""",
+                   fetch=True)
+    assert len(df) == 1
+
+
+def test_request_window(db):
+    # A TSV request larger than the window is written in several slices,
+    # which the child reads as one message
+    df = db.iquery("""
+        stream(
+          build(<x:int64>[i=0:99999:0:100000], i),
+          'python -u /stream/tests/scripts/tsv_echo.py',
+          request_window:65536)""",
+                   fetch=True)
+    assert len(df) == 1
+    assert df['response'][0].split('\n') == [str(i) for i in range(100000)]
+
+
+@pytest.mark.parametrize('mode', (
+    'pipeline:2',
+    'parallelism:3',
+    "transport:'splice'",
+))
+def test_same_responses(db, mode):
+    # However the chunks reach the children, the responses come back
+    # whole and in chunk order
+    query = """
+        stream(
+          build(<x:int64>[i=0:99999:0:20000], i),
+          'python -u /stream/tests/scripts/tsv_echo.py'{})"""
+    expected = db.iquery(query.format(''), fetch=True)
+    df = db.iquery(query.format(', ' + mode), fetch=True)
+    key = ['instance_id', 'chunk_no']
+    assert (df.sort_values(key)['response'].tolist() ==
+            expected.sort_values(key)['response'].tolist())
+    values = sorted(int(v) for cell in df['response']
+                    for v in cell.split('\n') if v)
+    assert values == list(range(100000))
+
+
+def pid_rows(df):
+    # The pid, line count, start and end time reported by tsv_pid.py
+    return [(int(r[0]), int(r[1]), float(r[2]), float(r[3]))
+            for r in (cell.split('\t') for cell in df['response'])]
+
+
+def test_parallelism(db):
+    # Each instance runs three children, which share the chunks
+    df = db.iquery("""
+        stream(
+          build(<x:int64>[i=0:999:0:10], i),
+          'python -u /stream/tests/scripts/tsv_pid.py',
+          parallelism:3)""",
+                   fetch=True)
+    for _, group in df.groupby('instance_id'):
+        assert len(set(r[0] for r in pid_rows(group))) == 3
+    assert sum(r[1] for r in pid_rows(df)) == 1000
+
+
+def test_reuse(db):
+    # The second query is answered by the children the first one left in
+    # the pool
+    query = """
+        stream(
+          build(<x:int64>[i=0:99:0:10], i),
+          'python -u /stream/tests/scripts/tsv_pid.py reuse',
+          reuse:60)"""
+    pids = []
+    for _ in range(2):
+        df = db.iquery(query, fetch=True)
+        pids.append({inst: pid_rows(group)[0][0]
+                     for inst, group in df.groupby('instance_id')})
+    assert pids[0] == pids[1]
+
+
+def test_speculate(db):
+    # A spare child takes a copy of the chunk another child is stuck on,
+    # and the copy's answer is used without waiting for the first child
+    marker = '/tmp/stream_test_slow.pid'
+    if os.path.exists(marker):
+        os.remove(marker)
+    start = time.time()
+    df = db.iquery("""
+        stream(
+          build(<x:int64>[i=0:999:0:10], i),
+          'python -u /stream/tests/scripts/tsv_slow.py 942 {}',
+          parallelism:3,
+          speculate:3)""".format(marker),
+                   fetch=True)
+    assert time.time() - start < 30
+    with open(marker) as f:
+        slow = 'pid ' + f.read()
+    cells = [cell.split('\n') for cell in df['response']]
+    cell = [c for c in cells if '942' in c][0]
+    assert cell[:-1] == [str(i) for i in range(940, 950)]
+    assert cell[-1] != slow
+
+
+def test_kill_timeout(db):
+    # A child that ignores SIGTERM and lingers after its final response
+    # is killed kill_timeout milliseconds after the SIGTERM
+    query = """
+        stream(
+          build(<x:int64>[i=0:9:0:10], i),
+          'python -u /stream/tests/scripts/tsv_pid.py stubborn',
+          kill_timeout:{})"""
+    for timeout, low, high in ((50, 0, 2.5), (3000, 3, 30)):
+        start = time.time()
+        df = db.iquery(query.format(timeout), fetch=True)
+        assert low <= time.time() - start < high
+        for row in pid_rows(df):
+            assert not os.path.exists('/proc/{}'.format(row[0]))
+
+
+def test_max_children(db):
+    # The instances together never run more than max_children children
+    # at once on the host (the test setup has all instances on one), and
+    # parallelism is capped at it
+    df = db.iquery("""
+        stream(
+          build(<x:int64>[i=0:999:0:10], i),
+          'python -u /stream/tests/scripts/tsv_pid.py',
+          parallelism:3,
+          max_children:2)""",
+                   fetch=True)
+    rows = pid_rows(df)
+    assert sum(r[1] for r in rows) == 1000
+    for _, group in df.groupby('instance_id'):
+        assert len(group) == 2
+    # an end sorts before a start at the same time
+    events = sorted([(r[2], 1) for r in rows] + [(r[3], -1) for r in rows])
+    running = 0
+    for _, change in events:
+        running += change
+        assert running <= 2
+
+
+def test_retries_drop(db):
+    # A chunk that kills every child it is sent to is dropped after the
+    # last retry, and the output of the other chunks is kept
+    df = db.iquery("""
+        stream(
+          build(<x:int64>[i=0:99:0:10], i),
+          'python -u /stream/tests/scripts/tsv_crash.py 42',
+          retries:1)""",
+                   fetch=True)
+    values = sorted(int(v) for cell in df['response']
+                    for v in cell.split('\n') if v)
+    assert values == [i for i in range(100) if i // 10 != 4]
+
+
+@pytest.mark.skipif(
+    not os.path.exists('/stream/examples/libstream_test_native.so'),
+    reason='the example library is built by make in examples')
+def test_native_init_error(db):
+    # A library that fails to initialize can still say why
+    with pytest.raises(Exception,
+                       match=r"stream_native_init failed with 1: types must"):
+        db.iquery("""
+            stream(
+              build(<x:double>[i=0:9], i),
+              '',
+              format:'native',
+              library:'/stream/examples/libstream_test_native.so',
+              types:'int64')""")
+
+
+@pytest.mark.skipif(multiprocessing.cpu_count() < 2,
+                    reason='spreading needs more than one CPU')
+def test_affinity_spread(db):
+    # Each child of an instance runs on a single core of its own
+    df = db.iquery("""
+        stream(
+          build(<x:int64>[i=0:99:0:10], i),
+          'python -u /stream/tests/scripts/cpus_allowed.py',
+          parallelism:2,
+          affinity:'spread')""",
+                   fetch=True)
+    for _, cpus in df.groupby('instance_id')['response']:
+        cpus = cpus.tolist()
+        assert len(cpus) == 2
+        assert all(c.isdigit() for c in cpus)
+        assert cpus[0] != cpus[1]
+
+
+@pytest.mark.skipif(sys.version_info < (3,),
+                    reason='scidbstrm.zygote requires Python 3')
+def test_zygote(db):
+    # The second query forks the zygote started by the first one
+    for _ in range(2):
+        res = db.iquery("""
+            stream(
+              build(<x:int64>[i=0:2:0:3], i),
+              '/stream/tests/scripts/one_chunk.py',
+              format:'feather',
+              types:'int64',
+              zygote:'python -um scidbstrm.zygote')""",
+                        fetch=True,
+                        as_dataframe=False)
+        assert numpy.array_equal(
+            res, numpy.array(
+                [(0, 0, i, (255, i)) for i in range(3)],
+                dtype=[('instance_id', '<i8'),
+                       ('chunk_no', '<i8'),
+                       ('value_no', '<i8'),
+                       ('a0', [('null', 'u1'), ('val', '<i8')])]))
+
+
+@pytest.mark.skipif(sys.version_info < (3,),
+                    reason='shared memory in scidbstrm requires Python 3')
+def test_shm(db):
+    res = db.iquery("""
+        stream(
+          build(<x:int64>[i=0:999:0:1000], i),
+          'python -u /stream/tests/scripts/one_chunk.py',
+          format:'feather',
+          types:'int64',
+          transport:'shm',
+          shm_size:65536)""",
+                    fetch=True,
+                    atts_only=True,
+                    as_dataframe=False)
+    assert numpy.array_equal(
+        res['a0']['val'], numpy.arange(1000, dtype='<i8'))
+
+
 def test_arrow_1676(db):
     """
     https://issues.apache.org/jira/browse/ARROW-1676